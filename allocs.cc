@@ -0,0 +1,74 @@
+/* ####################################################################################
+ *                                  ALLOCS.CC
+ *  Counts heap allocations. Built with -DSMASH_COUNT_ALLOCS, this file replaces the
+ *  global operator new and delete with malloc and free plus a counter, which the
+ *  stats builtin prints. bench/bench_alloc runs command lines over and over and
+ *  checks that the counter stays put once smash is warm. Without the flag it is empty.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include "allocs.h"
+
+#ifdef SMASH_COUNT_ALLOCS
+#include <stdlib.h>
+#include <new>
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static unsigned long long allocs = 0;	// smash is single threaded, a fork counts on its own copy
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * allocsCount function
+ * @return the calls to operator new so far
+ */
+unsigned long long allocsCount()
+{
+	return allocs;
+}
+/****************************************************************************************/
+void* operator new(size_t size)
+{
+	allocs++;
+	void* p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+/****************************************************************************************/
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+/****************************************************************************************/
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+/****************************************************************************************/
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+/****************************************************************************************/
+void operator delete(void* p, size_t size) noexcept
+{
+	free(p);
+}
+/****************************************************************************************/
+void operator delete[](void* p, size_t size) noexcept
+{
+	free(p);
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _ALLOCS_H
+#define _ALLOCS_H
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+#ifdef SMASH_COUNT_ALLOCS
+// build with -DSMASH_COUNT_ALLOCS (make smash-allocs) to count the calls to operator new
+unsigned long long allocsCount();
+#endif
+
+
+#endif
@@ -0,0 +1,190 @@
+/* ####################################################################################
+ *                                  BENCH_ALLOC.CC
+ *  Checks that the steady state of the command path (parse, dispatch, spawn, job
+ *  table, history) makes no heap allocation. It drives a smash built with
+ *  -DSMASH_COUNT_ALLOCS (make smash-allocs), whose stats builtin prints how many
+ *  times operator new was called. Every line of the workload first runs WARMUP times
+ *  in a row, so the history, the finished jobs and the job name buffers are full,
+ *  then each runs RUNS more times between two stats, and the counter must not move.
+ *  smash runs in a directory whose path is longer than a small string, so cd and pwd
+ *  copy paths that do not fit in one.
+ *
+ *  usage: bench_alloc [-w WARMUP] [-r RUNS] [SMASH]
+ *         defaults: WARMUP=200, RUNS=200, SMASH=./smash-allocs
+ *  output: one line per workload line, key=value separated by spaces:
+ *    bench=alloc line="..." runs=.. allocs=..
+ *  exits with 1 if a line allocated.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "smashpipe.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_WARMUP 200
+#define DEFAULT_RUNS 200
+#define ALLOCS_KEY "heap_allocations "
+#define LONG_DIR_NAME "a-directory-name-longer-than-a-small-string"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static const char* workload[] =
+{
+	"stats",					// first: what the measurement itself costs
+	"/bin/true a b c",			// external command in the foreground
+	"/bin/true --an-argument-too-long-for-a-small-string",
+	"sleep 0 &",				// background job, then jobs until it is reaped
+	"/bin/true 1 && /bin/true 2 &",	// background list, named by its line
+	"pwd",
+	"X=abc; Y=$X",
+	"true && false || true",
+	"cd .",
+	"cd -",
+	"jobs",
+	"history",
+};
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * run_line function
+ * runs a line of the workload; after a background job, until the job table is empty again,
+ * so the number of jobs alive at once, and of their name buffers, is the same on every run
+ * @param sp
+ * @param line
+ * @return false if smash went away
+ */
+static bool run_line(SmashPipe& sp, const char* line)
+{
+	if (smashRunLine(sp, line) == -1)
+		return false;
+	if (line[strlen(line) - 1] != '&')
+		return true;
+	string out;
+	do
+	{
+		if (smashRunLine(sp, "jobs", &out) == -1)
+			return false;
+	} while (!out.empty());
+	return true;
+}
+/****************************************************************************************/
+/**
+ * allocations function
+ * @param sp
+ * @return the heap allocations smash counted, -1 if it went away or does not count
+ */
+static long long allocations(SmashPipe& sp)
+{
+	string out;
+	if (smashRunLine(sp, "stats", &out) == -1)
+		return -1;
+	size_t at = out.find(ALLOCS_KEY);
+	if (at == string::npos)
+		return -1;
+	return atoll(out.c_str() + at + strlen(ALLOCS_KEY));
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int warmup = DEFAULT_WARMUP;
+	int runs = DEFAULT_RUNS;
+	int i = 1;
+	for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+	{
+		if (!strcmp(argv[i], "-w"))
+			warmup = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-r"))
+			runs = atoi(argv[i + 1]);
+	}
+	if (warmup < 0)
+		warmup = DEFAULT_WARMUP;
+	if (runs <= 0)
+		runs = DEFAULT_RUNS;
+	char* smash_path = realpath((i < argc) ? argv[i] : "./smash-allocs", NULL);
+	char top_dir[] = "/tmp/bench_alloc.XXXXXX";
+	string long_dir;
+	if (smash_path == NULL || mkdtemp(top_dir) == NULL)
+	{
+		perror("bench_alloc");
+		return 1;
+	}
+	long_dir = string(top_dir) + "/" LONG_DIR_NAME;
+	if (mkdir(long_dir.c_str(), 0700) == -1 || chdir(long_dir.c_str()) == -1)
+	{
+		perror(long_dir.c_str());
+		rmdir(top_dir);
+		return 1;
+	}
+	char* smash_argv[] = { smash_path, NULL };
+	signal(SIGPIPE, SIG_IGN);
+
+	SmashPipe sp;
+	if (!smashStart(sp, smash_argv))
+	{
+		printf("bench=alloc error=smash_exited\n");
+		return 1;
+	}
+	size_t num_lines = sizeof(workload) / sizeof(workload[0]);
+	for (size_t l = 0; l < num_lines; l++)
+	{
+		// in a row, as measured, so the job table grows as far as it will
+		for (int w = 0; w < warmup; w++)
+		{
+			if (!run_line(sp, workload[l]))
+			{
+				printf("bench=alloc error=smash_exited\n");
+				return 1;
+			}
+		}
+	}
+
+	int result = 0;
+	for (size_t l = 0; l < num_lines; l++)
+	{
+		long long before = allocations(sp);
+		for (int r = 0; r < runs && before != -1; r++)
+		{
+			if (!run_line(sp, workload[l]))
+				before = -1;
+		}
+		long long after = (before != -1) ? allocations(sp) : -1;
+		if (after == -1)
+		{
+			printf("bench=alloc error=no_count (not a smash-allocs build?)\n");
+			result = 1;
+			break;
+		}
+		printf("bench=alloc line=\"%s\" runs=%d allocs=%lld\n", workload[l], runs, after - before);
+		if (after != before)
+			result = 1;
+	}
+	fflush(stdout);
+	smashStop(sp);
+	rmdir(long_dir.c_str());
+	rmdir(top_dir);
+	free(smash_path);
+	return result;
+}
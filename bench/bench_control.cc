@@ -0,0 +1,183 @@
+/* ####################################################################################
+ *                                  BENCH_CONTROL.CC
+ *  Load test for smash --listen: keeps one request in flight on each of N connections
+ *  and reports requests per second and latency percentiles.
+ *
+ *  usage: bench_control SOCKET [clients] [requests] [request]
+ *         the default request is "jobs"
+ *  output: one line, key=value separated by spaces
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_CLIENTS 8
+#define DEFAULT_REQUESTS 20000
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct Conn
+{
+	int fd;
+	string in;
+	long long sent_at;
+};
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * now_ns function
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+/****************************************************************************************/
+/**
+ * send_request function
+ * @param c
+ * @param req
+ * @return false on error
+ */
+static bool send_request(Conn& c, const string& req)
+{
+	uint32_t len = htonl(req.size());
+	string frame((const char*)&len, 4);
+	frame += req;
+	c.sent_at = now_ns();
+	return write(c.fd, frame.data(), frame.size()) == (ssize_t)frame.size();
+}
+/****************************************************************************************/
+/**
+ * connect_to function
+ * @param path
+ * @return connected fd, or -1
+ */
+static int connect_to(const char* path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1)
+	{
+		perror("connect");
+		return -1;
+	}
+	return fd;
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: %s SOCKET [clients] [requests] [request]\n", argv[0]);
+		return 1;
+	}
+	int clients = (argc > 2) ? atoi(argv[2]) : DEFAULT_CLIENTS;
+	int total = (argc > 3) ? atoi(argv[3]) : DEFAULT_REQUESTS;
+	string req = (argc > 4) ? argv[4] : "jobs";
+
+	vector<Conn> conns(clients);
+	vector<struct pollfd> pfds(clients);
+	int sent = 0;
+	for (int i = 0; i < clients; i++)
+	{
+		conns[i].fd = connect_to(argv[1]);
+		if (conns[i].fd == -1)
+			return 1;
+		pfds[i].fd = conns[i].fd;
+		pfds[i].events = POLLIN;
+		if (sent < total && send_request(conns[i], req))
+			sent++;
+	}
+
+	vector<long long> lat;
+	lat.reserve(total);
+	int errors = 0;
+	long long start = now_ns();
+	while ((int)lat.size() < sent)
+	{
+		if (poll(&pfds[0], clients, -1) == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			return 1;
+		}
+		for (int i = 0; i < clients; i++)
+		{
+			if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			Conn& c = conns[i];
+			char buf[65536];
+			ssize_t n = read(c.fd, buf, sizeof(buf));
+			if (n <= 0)
+			{
+				fprintf(stderr, "connection closed by smash\n");
+				return 1;
+			}
+			c.in.append(buf, n);
+			while (c.in.size() >= 4)
+			{
+				uint32_t len;
+				memcpy(&len, c.in.data(), 4);
+				len = ntohl(len);
+				if (c.in.size() < 4 + len)
+					break;
+				if (c.in.compare(4, 2, "0\n") != 0)
+					errors++;
+				c.in.erase(0, 4 + len);
+				lat.push_back(now_ns() - c.sent_at);
+				if (sent < total && send_request(c, req))
+					sent++;
+			}
+		}
+	}
+	double secs = (now_ns() - start) / 1e9;
+
+	sort(lat.begin(), lat.end());
+	printf("bench=control request=\"%s\" clients=%d requests=%d errors=%d rps=%.0f p50_us=%.1f p99_us=%.1f max_us=%.1f\n",
+		   req.c_str(), clients, (int)lat.size(), errors, lat.size() / secs,
+		   lat[lat.size() / 2] / 1000.0, lat[lat.size() * 99 / 100] / 1000.0, lat.back() / 1000.0);
+	for (int i = 0; i < clients; i++)
+		close(conns[i].fd);
+	return 0;
+}
@@ -0,0 +1,146 @@
+/* ####################################################################################
+ *                                  BENCH_GLOB.CC
+ *  Glob latency over one large directory: glob(3), smash's pathGlob reading the
+ *  directory every time, and pathGlob with the listing cache. The directory is
+ *  created in /tmp with one file per entry and removed at the end.
+ *
+ *  usage: bench_glob [entries] [iterations]
+ *  output: one line per (impl, pattern) pair, key=value separated by spaces
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <fcntl.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "pathglob.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_ENTRIES 100000
+#define DEFAULT_ITERATIONS 20
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * now_ns function
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+/****************************************************************************************/
+/**
+ * run function
+ * times iterations globs of pattern, and prints the percentiles
+ * @param impl "glob3", "pathglob" or "pathglob_cached"
+ * @param pattern
+ * @param entries
+ * @param iterations
+ */
+static void run(const char* impl, const string& pattern, int entries, int iterations)
+{
+	vector<char> words;
+	vector<size_t> offsets;
+	vector<long long> lat;
+	size_t matches = 0;
+	pathGlobCache(!strcmp(impl, "pathglob_cached"));
+	for (int i = 0; i < iterations; i++)
+	{
+		long long start = now_ns();
+		if (!strcmp(impl, "glob3"))
+		{
+			glob_t g;
+			glob(pattern.c_str(), 0, NULL, &g);
+			matches = g.gl_pathc;
+			globfree(&g);
+		}
+		else
+		{
+			words.clear();
+			offsets.clear();
+			matches = pathGlob(pattern.c_str(), words, offsets);
+		}
+		lat.push_back(now_ns() - start);
+	}
+	sort(lat.begin(), lat.end());
+	printf("bench=glob impl=%s pattern=%s entries=%d n=%d matches=%zu p50_us=%.1f p99_us=%.1f\n", impl,
+		   pattern.substr(pattern.rfind('/') + 1).c_str(), entries, iterations, matches,
+		   lat[lat.size() / 2] / 1000.0, lat[lat.size() * 99 / 100] / 1000.0);
+	fflush(stdout);
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int entries = (argc > 1) ? atoi(argv[1]) : DEFAULT_ENTRIES;
+	int iterations = (argc > 2) ? atoi(argv[2]) : DEFAULT_ITERATIONS;
+	if (entries <= 0)
+		entries = DEFAULT_ENTRIES;
+	if (iterations <= 0)
+		iterations = DEFAULT_ITERATIONS;
+
+	char dir[] = "/tmp/bench_glob.XXXXXX";
+	if (mkdtemp(dir) == NULL)
+	{
+		perror("mkdtemp");
+		return 1;
+	}
+	const char* exts[] = { ".log", ".txt", ".c", ".h" };
+	char name[64];
+	for (int i = 0; i < entries; i++)
+	{
+		snprintf(name, sizeof(name), "%s/f%07d%s", dir, i, exts[i % 4]);
+		int fd = open(name, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+		if (fd == -1)
+		{
+			perror(name);
+			return 1;
+		}
+		close(fd);
+	}
+	// a directory changed in the last second is never cached, see GLOB_RACY_NS
+	struct timespec times[2] = { { time(NULL) - 10, 0 }, { time(NULL) - 10, 0 } };
+	utimensat(AT_FDCWD, dir, times, 0);
+
+	const char* patterns[] = { "*.log", "f00012*", "f[0-9]?????[26].c" };
+	const char* impls[] = { "glob3", "pathglob", "pathglob_cached" };
+	for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+	{
+		for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); i++)
+			run(impls[i], string(dir) + "/" + patterns[p], entries, iterations);
+	}
+
+	for (int i = 0; i < entries; i++)
+	{
+		snprintf(name, sizeof(name), "%s/f%07d%s", dir, i, exts[i % 4]);
+		unlink(name);
+	}
+	rmdir(dir);
+	return 0;
+}
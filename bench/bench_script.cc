@@ -0,0 +1,250 @@
+/* ####################################################################################
+ *                                  BENCH_SCRIPT.CC
+ *  Time to first command, and to the end, of a large generated script: run by a new
+ *  smash ("smash FILE", parsed as it runs), sourced the first time (cold: compiled as
+ *  it runs) and sourced again (warm: rebuilt from the script cache, no parsing).
+ *  The script starts and ends with an echo that smash flushes, the lines in between
+ *  are builtins, assignments and lists that print nothing. It is written to /tmp and
+ *  removed at the end.
+ *
+ *  usage: bench_script [-n LINES] [-r RUNS] [SMASH]
+ *         defaults: LINES=100000, RUNS=5, SMASH=./smash
+ *  output: one line per mode, key=value separated by spaces:
+ *    bench=script mode=<batch|source_cold|source_warm> lines=.. ttfc_ms=.. total_ms=..
+ *  batch and source_warm are the median of RUNS runs.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+#include "smashpipe.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_LINES 100000
+#define DEFAULT_RUNS 5
+#define FIRST_MARK "first-command\n"
+#define LAST_MARK "last-command\n"
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * wait_for function
+ * reads smash's stdout until mark
+ * @param sp
+ * @param mark
+ * @return false if smash went away
+ */
+static bool wait_for(SmashPipe& sp, const char* mark)
+{
+	while (1)
+	{
+		size_t at = sp.pending.find(mark);
+		if (at != string::npos)
+		{
+			sp.pending.erase(0, at + strlen(mark));
+			return true;
+		}
+		char buf[65536];
+		ssize_t n = read(sp.from, buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		sp.pending.append(buf, n);
+	}
+}
+/****************************************************************************************/
+/**
+ * write_script function
+ * @param path
+ * @param lines
+ * @return false if it could not be written
+ */
+static bool write_script(const char* path, int lines)
+{
+	FILE* f = fopen(path, "w");
+	if (f == NULL)
+		return false;
+	fprintf(f, "# generated by bench_script\necho first-command; sleep 0\n");
+	for (int i = 0; i < lines - 2; i++)
+	{
+		switch (i % 4)
+		{
+			case 0: fprintf(f, "V%d=value%d\n", i % 100, i); break;
+			case 1: fprintf(f, "true && X=$V%d || false\n", i % 100); break;
+			case 2: fprintf(f, "test -n line%d -a %d -ge 0 || echo never\n", i, i); break;
+			case 3: fprintf(f, "export E%d=%d; unset E%d\n", i % 10, i, i % 10); break;
+		}
+	}
+	fprintf(f, "echo last-command; sleep 0\n");
+	fclose(f);
+	// a file changed in the last second is never cached, see SCRIPT_RACY_NS
+	struct timespec times[2] = { { time(NULL) - 10, 0 }, { time(NULL) - 10, 0 } };
+	utimensat(AT_FDCWD, path, times, 0);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * run_once function
+ * @param sp a smash at its prompt
+ * @param line the command that runs the script
+ * @param ttfc receives the time to its first command in ms
+ * @param total receives the time until the prompt after it in ms
+ * @return false if smash went away
+ */
+static bool run_once(SmashPipe& sp, const string& line, double* ttfc, double* total)
+{
+	long long start = now_ns();
+	if (!smashSend(sp, line) || !wait_for(sp, FIRST_MARK))
+		return false;
+	*ttfc = (now_ns() - start) / 1e6;
+	if (!wait_for(sp, LAST_MARK) || !smashWaitPrompt(sp, NULL))
+		return false;
+	*total = (now_ns() - start) / 1e6;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * run_batch function
+ * runs "smash FILE" as a new process
+ * @param smash_path
+ * @param path
+ * @param ttfc receives the time to its first command in ms
+ * @param total receives the time until it exited in ms
+ * @return false if it failed
+ */
+static bool run_batch(const char* smash_path, const char* path, double* ttfc, double* total)
+{
+	int out_pipe[2];
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+		return false;
+	long long start = now_ns();
+	pid_t pid = fork();
+	if (pid == -1)
+		return false;
+	if (pid == 0)
+	{
+		dup2(out_pipe[1], STDOUT_FILENO);
+		execl(smash_path, smash_path, path, (char*)NULL);
+		_exit(127);
+	}
+	close(out_pipe[1]);
+	SmashPipe sp;
+	sp.pid = pid;
+	sp.from = out_pipe[0];
+	bool ok = wait_for(sp, FIRST_MARK);
+	*ttfc = (now_ns() - start) / 1e6;
+	ok = ok && wait_for(sp, LAST_MARK);
+	int status;
+	close(out_pipe[0]);
+	waitpid(pid, &status, 0);
+	*total = (now_ns() - start) / 1e6;
+	return ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+/****************************************************************************************/
+/**
+ * median function
+ * @param v
+ * @return its median
+ */
+static double median(vector<double> v)
+{
+	sort(v.begin(), v.end());
+	return v[v.size() / 2];
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int lines = DEFAULT_LINES;
+	int runs = DEFAULT_RUNS;
+	int i = 1;
+	for (; i + 1 < argc && argv[i][0] == '-'; i += 2)
+	{
+		if (!strcmp(argv[i], "-n"))
+			lines = atoi(argv[i + 1]);
+		else if (!strcmp(argv[i], "-r"))
+			runs = atoi(argv[i + 1]);
+	}
+	if (lines < 2)
+		lines = DEFAULT_LINES;
+	if (runs <= 0)
+		runs = DEFAULT_RUNS;
+	char* smash_argv[] = { (char*)((i < argc) ? argv[i] : "./smash"), NULL };
+
+	char path[] = "/tmp/bench_script.XXXXXX";
+	int fd = mkstemp(path);
+	if (fd == -1 || !write_script(path, lines))
+	{
+		perror(path);
+		return 1;
+	}
+	close(fd);
+	signal(SIGPIPE, SIG_IGN);
+
+	int result = 0;
+	vector<double> ttfcs, totals;
+	double ttfc, total;
+	for (int r = 0; r < runs; r++)
+	{
+		if (!run_batch(smash_argv[0], path, &ttfc, &total))
+		{
+			printf("bench=script mode=batch error=failed\n");
+			result = 1;
+			break;
+		}
+		ttfcs.push_back(ttfc);
+		totals.push_back(total);
+	}
+	if (!ttfcs.empty())
+		printf("bench=script mode=batch lines=%d ttfc_ms=%.2f total_ms=%.2f\n", lines, median(ttfcs), median(totals));
+
+	SmashPipe sp;
+	string line = string("source ") + path;
+	if (!smashStart(sp, smash_argv) || !run_once(sp, line, &ttfc, &total))
+	{
+		printf("bench=script mode=source_cold error=smash_exited\n");
+		unlink(path);
+		return 1;
+	}
+	printf("bench=script mode=source_cold lines=%d ttfc_ms=%.2f total_ms=%.2f\n", lines, ttfc, total);
+	ttfcs.clear();
+	totals.clear();
+	for (int r = 0; r < runs; r++)
+	{
+		if (!run_once(sp, line, &ttfc, &total))
+		{
+			printf("bench=script mode=source_warm error=smash_exited\n");
+			result = 1;
+			break;
+		}
+		ttfcs.push_back(ttfc);
+		totals.push_back(total);
+	}
+	if (!ttfcs.empty())
+		printf("bench=script mode=source_warm lines=%d ttfc_ms=%.2f total_ms=%.2f\n", lines, median(ttfcs),
+			   median(totals));
+	fflush(stdout);
+	smashStop(sp);
+	unlink(path);
+	return result;
+}
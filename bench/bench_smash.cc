@@ -0,0 +1,259 @@
+/* ####################################################################################
+ *                                  BENCH_SMASH.CC
+ *  Throughput benchmark for smash itself: runs smash on a pipe and feeds it scripted
+ *  workloads one line at a time. A line is done when smash prints its next prompt,
+ *  so the latency of a line is from writing it until that prompt.
+ *
+ *  workloads:
+ *    seq_true     N sequential /bin/true (fork, exec, wait)
+ *    fast_true    N sequential "true", run inside smash
+ *    fast_echo    N "echo" and fast_test N "test -f", inside smash
+ *    ext_echo     N/10 "external echo", the same through fork+exec
+ *    bg_jobs      N/10 "sleep S &", all alive at the same time
+ *    jobs_list    "jobs" with those jobs alive
+ *    jobs_json    "jobs --json" with those jobs alive
+ *    bg_drain     polling "jobs" until the sleeps are reaped
+ *    sigchld_storm  N/5 "/bin/true &", children exit while smash keeps dispatching
+ *    history      "history" with a full history
+ *    long_line    N/2 lines of LEN bytes through the tokenizer
+ *
+ *  usage: bench_smash [-n N] [-l LEN] [-s SLEEP] [SMASH [smash options...]]
+ *         defaults: N=10000, LEN=4096, SLEEP=2, SMASH=./smash
+ *  output: one line per workload, key=value separated by spaces:
+ *    bench=<name> n=<lines> secs=<wall> cmds_per_sec=.. p50_us=.. p99_us=.. max_us=.. peak_rss_kb=..
+ *  peak_rss_kb is smash's VmHWM, reset before each workload where the kernel allows it.
+ *  If smash dies the workload reports bench=<name> error=smash_exited status=.. signal=..
+ *  and the rest run on a new smash; the exit status is then 1.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <signal.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+#include "smashpipe.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_N 10000
+#define DEFAULT_LINE_LEN 4096
+#define DEFAULT_SLEEP 2
+#define JOBS_LISTINGS 200
+#define HISTORY_LISTINGS 1000
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static SmashPipe smash;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * reset_peak_rss function
+ * clears smash's VmHWM (clear_refs 5, Linux 4.0+); harmless if not permitted
+ */
+static void reset_peak_rss()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/clear_refs", (int)smash.pid);
+	int fd = open(path, O_WRONLY);
+	if (fd == -1)
+		return;
+	if (write(fd, "5", 1) != 1)
+		; // older kernel: the peak stays cumulative
+	close(fd);
+}
+/****************************************************************************************/
+/**
+ * peak_rss_kb function
+ * @return smash's VmHWM in kB, -1 if unknown
+ */
+static long peak_rss_kb()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/%d/status", (int)smash.pid);
+	FILE* f = fopen(path, "r");
+	if (f == NULL)
+		return -1;
+	char line[256];
+	long kb = -1;
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		if (sscanf(line, "VmHWM: %ld", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+/****************************************************************************************/
+/**
+ * report function
+ * prints one result line
+ * @param name
+ * @param lat per line latencies (sorted here)
+ * @param secs wall time of the workload
+ */
+static void report(const char* name, vector<long long>& lat, double secs)
+{
+	if (lat.empty())
+		return;
+	sort(lat.begin(), lat.end());
+	printf("bench=%s n=%zu secs=%.3f cmds_per_sec=%.0f p50_us=%.1f p99_us=%.1f max_us=%.1f peak_rss_kb=%ld\n",
+		   name, lat.size(), secs, lat.size() / secs, lat[lat.size() / 2] / 1000.0,
+		   lat[lat.size() * 99 / 100] / 1000.0, lat.back() / 1000.0, peak_rss_kb());
+	fflush(stdout);
+}
+/****************************************************************************************/
+/**
+ * run_workload function
+ * runs count lines and reports them as one workload
+ * @param name
+ * @param line
+ * @param count
+ * @return false if smash went away
+ */
+static bool run_workload(const char* name, const string& line, int count)
+{
+	vector<long long> lat;
+	lat.reserve(count);
+	reset_peak_rss();
+	long long start = now_ns();
+	for (int i = 0; i < count; i++)
+	{
+		long long ns = smashRunLine(smash, line);
+		if (ns == -1)
+			return false;
+		lat.push_back(ns);
+	}
+	report(name, lat, (now_ns() - start) / 1e9);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * drain_jobs function
+ * polls "jobs" until smash lists no job, and reports it as one workload
+ * @param name
+ * @return false if smash went away
+ */
+static bool drain_jobs(const char* name)
+{
+	vector<long long> lat;
+	long long start = now_ns();
+	string out;
+	while (1)
+	{
+		long long ns = smashRunLine(smash, "jobs", &out);
+		if (ns == -1)
+			return false;
+		lat.push_back(ns);
+		if (out.find('[') == string::npos)
+			break;
+		usleep(10000);
+	}
+	report(name, lat, (now_ns() - start) / 1e9);
+	return true;
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int n = DEFAULT_N;
+	int line_len = DEFAULT_LINE_LEN;
+	int sleep_secs = DEFAULT_SLEEP;
+	int opt;
+	while ((opt = getopt(argc, argv, "+n:l:s:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': n = atoi(optarg); break;
+			case 'l': line_len = atoi(optarg); break;
+			case 's': sleep_secs = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n N] [-l LEN] [-s SLEEP] [SMASH [smash options...]]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (n < 10 || line_len < 8 || sleep_secs < 1)
+	{
+		fprintf(stderr, "bench_smash: N >= 10, LEN >= 8, SLEEP >= 1\n");
+		return 1;
+	}
+	char default_smash[] = "./smash";
+	char* default_argv[] = { default_smash, NULL };
+	char** smash_argv = (optind < argc) ? &argv[optind] : default_argv;
+
+	signal(SIGPIPE, SIG_IGN);
+	if (!smashStart(smash, smash_argv))
+	{
+		fprintf(stderr, "bench_smash: could not start %s\n", smash_argv[0]);
+		return 1;
+	}
+
+	char sleep_line[32];
+	snprintf(sleep_line, sizeof(sleep_line), "sleep %d &", sleep_secs);
+	// a valid builtin padded with arguments up to LEN bytes
+	string long_line = "jobs";
+	while ((int)long_line.size() + 2 <= line_len)
+		long_line += " x";
+
+	struct
+	{
+		const char* name;
+		string line;
+		int count;		// 0: drain the job table instead
+	} workloads[] = {
+		{ "seq_true", "/bin/true", n },
+		{ "fast_true", "true", n },
+		{ "fast_echo", "echo hello world", n },
+		{ "fast_test", "test -f /etc/passwd", n },
+		{ "ext_echo", "external echo hello world", n / 10 },
+		{ "bg_jobs", sleep_line, n / 10 },
+		{ "jobs_list", "jobs", JOBS_LISTINGS },
+		{ "jobs_json", "jobs --json", JOBS_LISTINGS },
+		{ "bg_drain", "", 0 },
+		{ "sigchld_storm", "/bin/true &", n / 5 },
+		{ "storm_drain", "", 0 },
+		{ "history", "history", HISTORY_LISTINGS },
+		{ "long_line", long_line, n / 2 },
+	};
+
+	int failures = 0;
+	for (size_t i = 0; i < sizeof(workloads) / sizeof(workloads[0]); i++)
+	{
+		bool ok = workloads[i].count ? run_workload(workloads[i].name, workloads[i].line, workloads[i].count)
+									 : drain_jobs(workloads[i].name);
+		if (ok)
+			continue;
+		// a crash is a result too: report it and go on with a fresh smash
+		int status = smashStop(smash);
+		printf("bench=%s error=smash_exited status=%d signal=%d\n", workloads[i].name,
+			   WIFEXITED(status) ? WEXITSTATUS(status) : -1, WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+		fflush(stdout);
+		failures++;
+		if (!smashStart(smash, smash_argv))
+		{
+			fprintf(stderr, "bench_smash: could not restart %s\n", smash_argv[0]);
+			return 1;
+		}
+	}
+
+	smashStop(smash);
+	return failures ? 1 : 0;
+}
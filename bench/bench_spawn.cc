@@ -0,0 +1,134 @@
+/* ####################################################################################
+ *                                  BENCH_SPAWN.CC
+ *  Launch latency of /bin/true through fork+exec and through the zygote helper,
+ *  while the launching process grows. fork() gets slower with the caller's RSS,
+ *  the zygote should stay flat.
+ *
+ *  usage: bench_spawn [iterations]
+ *  output: one line per (mode, rss) pair, key=value separated by spaces
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <vector>
+#include "zygote.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_ITERATIONS 300
+#define STEP_MB 256
+#define NUM_STEPS 4
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * now_ns function
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+/****************************************************************************************/
+/**
+ * spawn_fork function
+ * @param args
+ * @return pid of the child
+ */
+static pid_t spawn_fork(char* args[])
+{
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setpgrp();
+		execv(args[0], args);
+		_exit(127);
+	}
+	return pid;
+}
+/****************************************************************************************/
+/**
+ * run function
+ * times iterations launches until the child is reaped, and prints the percentiles
+ * @param mode "fork" or "zygote"
+ * @param rss_mb
+ * @param iterations
+ */
+static void run(const char* mode, int rss_mb, int iterations)
+{
+	char* args[] = { (char*)"/bin/true", NULL };
+	char* envp[] = { NULL };
+	vector<long long> lat;
+	for (int i = 0; i < iterations; i++)
+	{
+		long long start = now_ns();
+		pid_t pid;
+		if (!strcmp(mode, "fork"))
+			pid = spawn_fork(args);
+		else
+			pid = zygoteSpawn(args, envp, 1, STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO);
+		if (pid == -1)
+		{
+			perror(mode);
+			exit(1);
+		}
+		waitpid(pid, NULL, 0);
+		lat.push_back(now_ns() - start);
+	}
+	sort(lat.begin(), lat.end());
+	printf("bench=spawn mode=%s rss_mb=%d n=%d p50_us=%.1f p99_us=%.1f\n", mode, rss_mb, iterations,
+		   lat[lat.size() / 2] / 1000.0, lat[lat.size() * 99 / 100] / 1000.0);
+	fflush(stdout);
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int iterations = (argc > 1) ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+	if (iterations <= 0)
+		iterations = DEFAULT_ITERATIONS;
+
+	// like smash, start the helper while we are small
+	if (zygoteStart() == -1)
+		return 1;
+
+	vector<char*> ballast;
+	for (int step = 0; step < NUM_STEPS; step++)
+	{
+		int rss_mb = step * STEP_MB;
+		if (step > 0)
+		{
+			char* block = (char*)malloc((size_t)STEP_MB << 20);
+			if (block == NULL)
+				break;
+			memset(block, 1, (size_t)STEP_MB << 20);	// touch it, so it is really resident
+			ballast.push_back(block);
+		}
+		run("fork", rss_mb, iterations);
+		run("zygote", rss_mb, iterations);
+	}
+	return 0;
+}
@@ -0,0 +1,298 @@
+/* ####################################################################################
+ *                                  CHECK_SMASH.CC
+ *  Regression checks for inputs that once broke smash. Each case feeds its lines to a
+ *  new smash on stdin (from a file, so a large output cannot block the writer) and
+ *  passes if smash exits by itself within CASE_TIMEOUT_SECS, not by a signal, and its
+ *  output holds the expected text.
+ *
+ *  usage: check_smash [SMASH]
+ *         defaults: SMASH=./smash
+ *  output: one line per case, key=value separated by spaces:
+ *    check=<name> ok=<0|1> [status=..]
+ *  exits with 1 if a case failed.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "smashpipe.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define MAX_CASE_ARGS 4
+#define LISTEN_FILE "/tmp/check_smash.listen"
+#define LISTEN_WAIT_MS 2000
+#define CASE_TIMEOUT_SECS 30
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct CheckCase
+{
+	const char* name;
+	string (*input)();			// the lines smash reads
+	const char* expect;			// must appear in its output
+	const char* args[MAX_CASE_ARGS];	// smash options, NULL terminated
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static const char* smash_path = "./smash";
+static pid_t listener = -1;			// the first smash of listen_twice
+
+
+/* ####################################################################################
+ *                                  CASES
+#####################################################################################*/
+
+/**
+ * here_doc_unclosed_subst function
+ * @return a here-document whose body has a "$(" that is not closed
+ */
+static string here_doc_unclosed_subst()
+{
+	return "cat <<END\nx $(date\nEND\necho alive\n";
+}
+/****************************************************************************************/
+/**
+ * here_string_unclosed_subst function
+ * @return a here-string with a "$(" that is not closed, also through a variable
+ */
+static string here_string_unclosed_subst()
+{
+	return "cat <<< $(echo\nX=$(\ncat <<< $X\necho alive\n";
+}
+
+/****************************************************************************************/
+/**
+ * listen_on_regular_file function
+ * puts a regular file where smash is told to listen
+ * @return input that runs only if smash started anyway
+ */
+static string listen_on_regular_file()
+{
+	unlink(LISTEN_FILE);	// a socket left there would be replaced, and smash would keep serving it
+	int fd = open(LISTEN_FILE, O_WRONLY | O_CREAT | O_EXCL, 0600);
+	if (fd != -1)
+		close(fd);
+	return "echo started\n";
+}
+
+/****************************************************************************************/
+/**
+ * zygote_big_env function
+ * @return an environment larger than a spawn request of the helper, then a command
+ */
+static string zygote_big_env()
+{
+	string in = "X=0123456789abcdef\n";
+	for (int i = 0; i < 12; i++)	// 16 << 12 = 64KB
+		in += "X=$X$X\n";
+	return in + "export X\n/bin/echo spawned\n";
+}
+
+/****************************************************************************************/
+/**
+ * jobs_json_1000 function
+ * @return 1000 background jobs that end over a second, listed as JSON again and again
+ * while they do (the SIGCHLD handler once erased jobs under the listing)
+ */
+static string jobs_json_1000()
+{
+	string in;
+	char line[32];
+	for (int i = 0; i < 1000; i++)
+	{
+		snprintf(line, sizeof(line), "sleep 0.%d &\n", i % 10);
+		in += line;
+	}
+	for (int i = 0; i < 50; i++)
+		in += "jobs --json\n";
+	return in + "jobs --ndjson\n";
+}
+
+/****************************************************************************************/
+/**
+ * function_before_builtin function
+ * @return a function named like a built-in command, then a call of it
+ */
+static string function_before_builtin()
+{
+	return "pwd() {\necho own pwd\n}\npwd\n";
+}
+
+/****************************************************************************************/
+/**
+ * temp_assign_env function
+ * @return a command with a temporary assignment, then one without, through the helper
+ */
+static string temp_assign_env()
+{
+	return "export A=base\nA=tmp /usr/bin/env\n/usr/bin/env\n";
+}
+
+/****************************************************************************************/
+/**
+ * listen_twice function
+ * starts a smash that listens where the checked one is told to listen
+ * @return input that runs only if the checked smash started anyway
+ */
+static string listen_twice()
+{
+	unlink(LISTEN_FILE);
+	listener = fork();
+	if (listener == 0)
+	{
+		int null_fd = open("/dev/null", O_RDWR);
+		dup2(null_fd, STDIN_FILENO);
+		dup2(null_fd, STDOUT_FILENO);
+		dup2(null_fd, STDERR_FILENO);
+		execl(smash_path, smash_path, "--listen", LISTEN_FILE, (char*)NULL);
+		_exit(127);
+	}
+	struct stat st;
+	for (int ms = 0; ms < LISTEN_WAIT_MS && lstat(LISTEN_FILE, &st) == -1; ms += 10)
+		usleep(10000);
+	return "echo started\n";
+}
+
+/****************************************************************************************/
+
+static const CheckCase cases[] =
+{
+	{ "here_doc_unclosed_subst", here_doc_unclosed_subst, "x $(date\n", { NULL } },
+	{ "here_string_unclosed_subst", here_string_unclosed_subst, "alive\n", { NULL } },
+	{ "listen_on_regular_file", listen_on_regular_file, "exists and is not a socket", { "--listen", LISTEN_FILE, NULL } },
+	{ "listen_twice", listen_twice, "socket in use", { "--listen", LISTEN_FILE, NULL } },
+	{ "jobs_json_1000", jobs_json_1000, "{\"id\":1000,", { NULL } },
+	{ "function_before_builtin", function_before_builtin, "own pwd\n", { NULL } },
+	{ "temp_assign_env", temp_assign_env, "A=tmp\n", { "--zygote", NULL } },
+	{ "temp_assign_env_restored", temp_assign_env, "smash > A=base\n", { "--zygote", NULL } },
+	{ "zygote_big_env", zygote_big_env, "spawned\n", { "--zygote", NULL } },
+};
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * run_case function
+ * @param smash_path
+ * @param c
+ * @param out receives smash's output
+ * @return smash's wait status, -1 if it could not be run
+ */
+static int run_case(const char* smash_path, const CheckCase& c, string& out)
+{
+	char path[] = "/tmp/check_smash.XXXXXX";
+	int in_fd = mkstemp(path);
+	if (in_fd == -1)
+		return -1;
+	unlink(path);
+	string input = c.input();
+	if (write(in_fd, input.data(), input.size()) != (ssize_t)input.size() || lseek(in_fd, 0, SEEK_SET) == -1)
+	{
+		close(in_fd);
+		return -1;
+	}
+	int out_pipe[2];
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		close(in_fd);
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		const char* argv[MAX_CASE_ARGS + 2] = { smash_path };
+		for (int i = 0; i < MAX_CASE_ARGS && c.args[i] != NULL; i++)
+			argv[i + 1] = c.args[i];
+		dup2(in_fd, STDIN_FILENO);
+		dup2(out_pipe[1], STDOUT_FILENO);
+		dup2(out_pipe[1], STDERR_FILENO);
+		execv(smash_path, (char**)argv);
+		_exit(127);
+	}
+	close(in_fd);
+	close(out_pipe[1]);
+	out.clear();
+	char buf[65536];
+	ssize_t n = -1;
+	long long deadline = now_ns() + CASE_TIMEOUT_SECS * 1000000000LL;
+	while (1)
+	{
+		// a smash that does not end by itself (one still listening, say) fails the case
+		long long left_ms = (deadline - now_ns()) / 1000000;
+		struct pollfd pfd = { out_pipe[0], POLLIN, 0 };
+		int ready = (left_ms > 0) ? poll(&pfd, 1, (int)left_ms) : 0;
+		if (ready == -1 && errno == EINTR)
+			continue;
+		if (ready == 0)
+		{
+			if (pid > 0)
+				kill(pid, SIGKILL);
+			break;
+		}
+		n = read(out_pipe[0], buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		out.append(buf, n);
+	}
+	close(out_pipe[0]);
+	int status = -1;
+	if (pid != -1)
+		waitpid(pid, &status, 0);
+	return status;
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	if (argc > 1)
+		smash_path = argv[1];
+	signal(SIGPIPE, SIG_IGN);
+	int result = 0;
+	string out;
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+	{
+		int status = run_case(smash_path, cases[i], out);
+		bool ok = status != -1 && WIFEXITED(status) && out.find(cases[i].expect) != string::npos;
+		printf("check=%s ok=%d", cases[i].name, ok ? 1 : 0);
+		if (!ok)
+		{
+			printf(" status=%d", status);
+			result = 1;
+		}
+		printf("\n");
+	}
+	if (listener > 0)
+	{
+		kill(listener, SIGKILL);
+		waitpid(listener, NULL, 0);
+	}
+	unlink(LISTEN_FILE);
+	return result;
+}
@@ -0,0 +1,173 @@
+#ifndef _SMASHPIPE_H
+#define _SMASHPIPE_H
+
+/* ####################################################################################
+ *                                  SMASHPIPE.H
+ *  Runs smash on a pair of pipes for the bench and stress harnesses. A line is done
+ *  when smash prints its next prompt.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <string>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define SMASH_PROMPT "smash > "
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct SmashPipe
+{
+	pid_t pid;
+	int to;				// smash's stdin
+	int from;			// smash's stdout
+	string pending;		// output not consumed yet
+};
+
+
+/* ####################################################################################
+ *                                  FUNCTIONS
+#####################################################################################*/
+
+/**
+ * now_ns function
+ * @return CLOCK_MONOTONIC in nanoseconds
+ */
+static inline long long now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+/****************************************************************************************/
+/**
+ * smashWaitPrompt function
+ * reads smash's stdout until the next prompt
+ * @param sp
+ * @param out if not NULL, receives what smash printed before the prompt
+ * @return false if smash went away
+ */
+static inline bool smashWaitPrompt(SmashPipe& sp, string* out)
+{
+	while (1)
+	{
+		size_t at = sp.pending.find(SMASH_PROMPT);
+		if (at != string::npos)
+		{
+			if (out != NULL)
+				out->assign(sp.pending, 0, at);
+			sp.pending.erase(0, at + strlen(SMASH_PROMPT));
+			return true;
+		}
+		char buf[65536];
+		ssize_t n = read(sp.from, buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		sp.pending.append(buf, n);
+	}
+}
+/****************************************************************************************/
+/**
+ * smashSend function
+ * writes a line without waiting for its prompt
+ * @param sp
+ * @param line without the newline
+ * @return false if smash went away
+ */
+static inline bool smashSend(SmashPipe& sp, const string& line)
+{
+	string data = line + "\n";
+	return write(sp.to, data.data(), data.size()) == (ssize_t)data.size();
+}
+/****************************************************************************************/
+/**
+ * smashRunLine function
+ * @param sp
+ * @param line without the newline
+ * @param out if not NULL, receives smash's output for the line
+ * @return the latency in ns, -1 if smash went away
+ */
+static inline long long smashRunLine(SmashPipe& sp, const string& line, string* out = NULL)
+{
+	long long start = now_ns();
+	if (!smashSend(sp, line) || !smashWaitPrompt(sp, out))
+		return -1;
+	return now_ns() - start;
+}
+/****************************************************************************************/
+/**
+ * smashStart function
+ * @param sp
+ * @param argv smash and its options
+ * @return false if it could not be started. smash's stderr goes to /dev/null.
+ */
+static inline bool smashStart(SmashPipe& sp, char* argv[])
+{
+	int in_pipe[2], out_pipe[2];
+	if (pipe2(in_pipe, O_CLOEXEC) == -1 || pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return false;
+	}
+	sp.pid = fork();
+	if (sp.pid == -1)
+	{
+		perror("fork");
+		return false;
+	}
+	if (sp.pid == 0)
+	{
+		dup2(in_pipe[0], STDIN_FILENO);
+		dup2(out_pipe[1], STDOUT_FILENO);
+		int null_fd = open("/dev/null", O_WRONLY);
+		if (null_fd != -1)
+			dup2(null_fd, STDERR_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	close(in_pipe[0]);
+	close(out_pipe[1]);
+	sp.to = in_pipe[1];
+	sp.from = out_pipe[0];
+	sp.pending.clear();
+	return smashWaitPrompt(sp, NULL);
+}
+/****************************************************************************************/
+/**
+ * smashStop function
+ * closes smash's stdin (EOF ends it) and reaps it
+ * @param sp
+ * @return the wait status
+ */
+static inline int smashStop(SmashPipe& sp)
+{
+	int status = 0;
+	close(sp.to);
+	close(sp.from);
+	sp.pending.clear();
+	waitpid(sp.pid, &status, 0);
+	return status;
+}
+
+
+#endif
@@ -0,0 +1,382 @@
+/* ####################################################################################
+ *                                  STRESS_JOBS.CC
+ *  Job table consistency under signal storms. Drives smash through phases that churn
+ *  short-lived jobs, stop/continue cycle long ones from the outside while jobs, fg, bg
+ *  and kill run inside smash, and finally kill everything. After each phase it lets
+ *  smash settle and checks its job table against /proc:
+ *    phantom        a listed job that is not a living child of smash
+ *    missing        a living child of smash that is not listed
+ *    unreaped       a zombie child of smash
+ *    state_mismatch listed Stopped but not stopped in /proc, or the other way around
+ *    duplicates     two jobs with the same id or pid
+ *
+ *  usage: stress_jobs [-n CHURN] [-j JOBS] [-t SECS] [SMASH [smash options...]]
+ *         defaults: CHURN=2000, JOBS=200, SECS=5, SMASH=./smash
+ *  output: one line per phase, key=value separated by spaces. The exit status is 1 if
+ *  any check failed or smash died (make stress-asan / stress-tsan run it on sanitizer
+ *  builds, whose reports go to smash's stderr: set ASAN_OPTIONS/TSAN_OPTIONS log_path).
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <map>
+#include <set>
+#include <vector>
+#include "smashpipe.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define DEFAULT_CHURN 2000
+#define DEFAULT_JOBS 200
+#define DEFAULT_SECS 5
+#define SETTLE_MS 300
+#define FG_STOP_RETRY_MS 20
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct ListedJob
+{
+	int id;
+	pid_t pid;
+	bool stopped;
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static SmashPipe smash;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * list_jobs function
+ * runs "jobs" and parses "[id] name : pid secs [Stopped]"
+ * @param jobs
+ * @return false if smash went away
+ */
+static bool list_jobs(vector<ListedJob>& jobs)
+{
+	string out;
+	if (smashRunLine(smash, "jobs", &out) == -1)
+		return false;
+	jobs.clear();
+	size_t pos = 0;
+	while (pos < out.size())
+	{
+		size_t eol = out.find('\n', pos);
+		if (eol == string::npos)
+			eol = out.size();
+		string line = out.substr(pos, eol - pos);
+		pos = eol + 1;
+		ListedJob j;
+		size_t colon = line.find(" : ");
+		if (line[0] != '[' || colon == string::npos)
+			continue;
+		j.id = atoi(line.c_str() + 1);
+		j.pid = atoi(line.c_str() + colon + 3);
+		j.stopped = line.find("Stopped") != string::npos;
+		jobs.push_back(j);
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * proc_children function
+ * @param parent
+ * @return the /proc state letter of every child of parent, except smash's own helpers
+ */
+static map<pid_t, char> proc_children(pid_t parent)
+{
+	map<pid_t, char> children;
+	DIR* dir = opendir("/proc");
+	if (dir == NULL)
+		return children;
+	struct dirent* e;
+	while ((e = readdir(dir)) != NULL)
+	{
+		pid_t pid = atoi(e->d_name);
+		if (pid <= 0)
+			continue;
+		char path[64], buf[512];
+		snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+		int fd = open(path, O_RDONLY);
+		if (fd == -1)
+			continue;
+		ssize_t n = read(fd, buf, sizeof(buf) - 1);
+		close(fd);
+		if (n <= 0)
+			continue;
+		buf[n] = '\0';
+		// "pid (comm) state ppid ...", comm may hold spaces and parentheses
+		char* open_paren = strchr(buf, '(');
+		char* close_paren = strrchr(buf, ')');
+		if (open_paren == NULL || close_paren == NULL)
+			continue;
+		char state;
+		int ppid;
+		if (sscanf(close_paren + 2, "%c %d", &state, &ppid) != 2 || ppid != parent)
+			continue;
+		string comm(open_paren + 1, close_paren - open_paren - 1);
+		if (comm == "smash")	// the zygote helper
+			continue;
+		children[pid] = state;
+	}
+	closedir(dir);
+	return children;
+}
+/****************************************************************************************/
+/**
+ * check_phase function
+ * lets smash settle, compares its job table with /proc and prints the result line
+ * @param phase
+ * @param failures incremented for every failed check
+ * @param jobs receives the job table
+ * @return false if smash went away
+ */
+static bool check_phase(const char* phase, int* failures, vector<ListedJob>& jobs)
+{
+	usleep(SETTLE_MS * 1000);
+	// the first listing lets smash handle the SIGCHLDs that arrived meanwhile
+	if (!list_jobs(jobs) || !list_jobs(jobs))
+		return false;
+	map<pid_t, char> children = proc_children(smash.pid);
+
+	int phantom = 0, missing = 0, unreaped = 0, mismatch = 0, duplicates = 0;
+	set<int> ids;
+	set<pid_t> pids;
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		if (!ids.insert(jobs[i].id).second || !pids.insert(jobs[i].pid).second)
+			duplicates++;
+		map<pid_t, char>::iterator c = children.find(jobs[i].pid);
+		if (c == children.end() || c->second == 'Z')
+		{
+			phantom += (c == children.end());
+			continue;
+		}
+		bool proc_stopped = (c->second == 'T' || c->second == 't');
+		if (proc_stopped != jobs[i].stopped)
+			mismatch++;
+	}
+	for (map<pid_t, char>::iterator c = children.begin(); c != children.end(); ++c)
+	{
+		if (c->second == 'Z')
+			unreaped++;
+		else if (!pids.count(c->first))
+			missing++;
+	}
+	bool ok = !phantom && !missing && !unreaped && !mismatch && !duplicates;
+	printf("phase=%s jobs=%zu children=%zu phantom=%d missing=%d unreaped=%d state_mismatch=%d duplicates=%d ok=%d\n",
+		   phase, jobs.size(), children.size(), phantom, missing, unreaped, mismatch, duplicates, ok);
+	fflush(stdout);
+	if (!ok)
+		(*failures)++;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * run_fg function
+ * runs "fg id" and keeps stopping the job from the outside (as CTRL+Z would) until
+ * smash prompts again
+ * @param id
+ * @param pid
+ * @return false if smash went away
+ */
+static bool run_fg(int id, pid_t pid)
+{
+	char line[32];
+	snprintf(line, sizeof(line), "fg %d", id);
+	if (!smashSend(smash, line))
+		return false;
+	while (1)
+	{
+		size_t at = smash.pending.find(SMASH_PROMPT);
+		if (at != string::npos)
+			return smashWaitPrompt(smash, NULL);
+		struct pollfd pfd = { smash.from, POLLIN, 0 };
+		int n = poll(&pfd, 1, FG_STOP_RETRY_MS);
+		if (n == 0)
+		{
+			kill(pid, SIGSTOP);
+			continue;
+		}
+		char buf[4096];
+		ssize_t got = read(smash.from, buf, sizeof(buf));
+		if (got <= 0)
+			return false;
+		smash.pending.append(buf, got);
+	}
+}
+/****************************************************************************************/
+/**
+ * start_cycler function
+ * forks a process that sends SIGSTOP and SIGCONT to random pids until killed
+ * @param pids
+ * @return its pid
+ */
+static pid_t start_cycler(const vector<pid_t>& pids)
+{
+	pid_t cycler = fork();
+	if (cycler != 0)
+		return cycler;
+	srand(getpid());
+	while (1)
+	{
+		pid_t target = pids[rand() % pids.size()];
+		kill(target, (rand() & 1) ? SIGSTOP : SIGCONT);
+		usleep(200 + rand() % 800);
+	}
+}
+/****************************************************************************************/
+/**
+ * report_death function
+ * @param phase
+ */
+static void report_death(const char* phase)
+{
+	int status = smashStop(smash);
+	printf("phase=%s error=smash_exited status=%d signal=%d ok=0\n", phase,
+		   WIFEXITED(status) ? WEXITSTATUS(status) : -1, WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+
+/* ####################################################################################
+ *                                 MAIN FUNCTION
+#####################################################################################*/
+
+int main(int argc, char *argv[])
+{
+	int churn = DEFAULT_CHURN;
+	int num_jobs = DEFAULT_JOBS;
+	int secs = DEFAULT_SECS;
+	int opt;
+	while ((opt = getopt(argc, argv, "+n:j:t:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': churn = atoi(optarg); break;
+			case 'j': num_jobs = atoi(optarg); break;
+			case 't': secs = atoi(optarg); break;
+			default:
+				fprintf(stderr, "usage: %s [-n CHURN] [-j JOBS] [-t SECS] [SMASH [smash options...]]\n", argv[0]);
+				return 1;
+		}
+	}
+	if (churn < 1 || num_jobs < 1 || secs < 1)
+	{
+		fprintf(stderr, "stress_jobs: CHURN, JOBS and SECS must be positive\n");
+		return 1;
+	}
+	char default_smash[] = "./smash";
+	char* default_argv[] = { default_smash, NULL };
+	char** smash_argv = (optind < argc) ? &argv[optind] : default_argv;
+
+	signal(SIGPIPE, SIG_IGN);
+	srand(getpid());
+	if (!smashStart(smash, smash_argv))
+	{
+		fprintf(stderr, "stress_jobs: could not start %s\n", smash_argv[0]);
+		return 1;
+	}
+	int failures = 0;
+	vector<ListedJob> jobs;
+
+	// short-lived children exiting while smash keeps dispatching
+	static const char* churn_lines[] = { "/bin/true &", "sleep 0.01 &", "sleep 0.05 &", "/bin/true", "jobs" };
+	for (int i = 0; i < churn; i++)
+	{
+		if (smashRunLine(smash, churn_lines[rand() % 5]) == -1)
+		{
+			report_death("churn");
+			return 1;
+		}
+	}
+	if (!check_phase("churn", &failures, jobs))
+	{
+		report_death("churn");
+		return 1;
+	}
+
+	// long jobs, stopped and continued from the outside while jobs/fg/bg/kill run inside
+	for (int i = 0; i < num_jobs; i++)
+	{
+		if (smashRunLine(smash, "sleep 1000 &") == -1)
+		{
+			report_death("stopcont");
+			return 1;
+		}
+	}
+	if (!list_jobs(jobs) || jobs.empty())
+	{
+		report_death("stopcont");
+		return 1;
+	}
+	vector<pid_t> pids;
+	for (size_t i = 0; i < jobs.size(); i++)
+		pids.push_back(jobs[i].pid);
+	pid_t cycler = start_cycler(pids);
+	long long end = now_ns() + secs * 1000000000LL;
+	bool alive = true;
+	while (alive && now_ns() < end)
+	{
+		const ListedJob& j = jobs[rand() % jobs.size()];
+		char line[64];
+		switch (rand() % 5)
+		{
+			case 0: snprintf(line, sizeof(line), "jobs"); break;
+			case 1: snprintf(line, sizeof(line), "bg %d", j.id); break;
+			case 2: snprintf(line, sizeof(line), "kill -%d %d", SIGSTOP, j.id); break;
+			case 3: snprintf(line, sizeof(line), "kill -%d %d", SIGCONT, j.id); break;
+			case 4: line[0] = '\0'; break;
+		}
+		alive = line[0] ? smashRunLine(smash, line) != -1 : run_fg(j.id, j.pid);
+	}
+	kill(cycler, SIGKILL);
+	waitpid(cycler, NULL, 0);
+	if (!alive || !check_phase("stopcont", &failures, jobs))
+	{
+		report_death("stopcont");
+		return 1;
+	}
+
+	// everything killed through smash, stopped jobs included
+	for (size_t i = 0; i < jobs.size(); i++)
+	{
+		char line[64];
+		snprintf(line, sizeof(line), "kill -%d %d", SIGKILL, jobs[i].id);
+		if (smashRunLine(smash, line) == -1)
+		{
+			report_death("kill");
+			return 1;
+		}
+	}
+	if (!check_phase("kill", &failures, jobs))
+	{
+		report_death("kill");
+		return 1;
+	}
+	if (!jobs.empty())
+		failures++;
+
+	smashStop(smash);
+	return failures ? 1 : 0;
+}
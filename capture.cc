@@ -0,0 +1,248 @@
+/* ####################################################################################
+ *                                  CAPTURE.CC
+ *  Keeps the tail of every background job's output in memory, drained by the event loop.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <map>
+#include "capture.h"
+#include "eventloop.h"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+size_t capture_limit = 0;
+
+extern volatile sig_atomic_t smash_interrupted;
+
+static map<int, Capture*> captures;	// by job id, so oldest first
+static int follow_id = -1;			// job whose new output is also echoed to stdout
+static int closed_count = 0;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void capture_handler(int fd, unsigned int events, void* ctx);
+static void capture_close(Capture* c);
+
+
+/**
+ * capture_close function
+ * the job closed its output. The ring is kept for `output`, and the oldest finished
+ * captures are dropped once there are more than CAPTURE_KEEP of them.
+ * @param c
+ */
+static void capture_close(Capture* c)
+{
+	evDel(c->fd);
+	close(c->fd);
+	c->fd = -1;
+	closed_count++;
+
+	for (map<int, Capture*>::iterator it = captures.begin(); it != captures.end() && closed_count > CAPTURE_KEEP; )
+	{
+		if (it->second->fd == -1)
+		{
+			delete it->second;
+			captures.erase(it++);
+			closed_count--;
+		}
+		else
+			++it;
+	}
+}
+/****************************************************************************************/
+/**
+ * capture_handler function
+ * drains the job's pipe into its ring
+ * @param fd
+ * @param events
+ * @param ctx the Capture
+ */
+static void capture_handler(int fd, unsigned int events, void* ctx)
+{
+	static char buf[CAPTURE_READ_SIZE];
+	Capture* c = (Capture*)ctx;
+
+	ssize_t n = read(fd, buf, sizeof(buf));
+	if (n > 0)
+	{
+		c->ring.append(buf, n);
+		if (c->job_id == follow_id)
+			writeAll(STDOUT_FILENO, buf, n);
+	}
+	else if (n == 0 || (errno != EINTR && errno != EAGAIN))
+	{
+		capture_close(c);
+	}
+}
+
+
+/* ####################################################################################
+ *                               CLASS METHODS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * OutputRing::append
+ * @param data
+ * @param len
+ */
+void OutputRing::append(const char* data, size_t len)
+{
+	total += len;
+	// only the last cap bytes can survive
+	if (len > cap)
+	{
+		data += len - cap;
+		len = cap;
+	}
+	if (buf.size() < cap)
+	{
+		size_t n = len < cap - buf.size() ? len : cap - buf.size();
+		if (buf.size() + n > buf.capacity())
+		{
+			size_t want = buf.capacity() * 2;
+			if (want < buf.size() + n)
+				want = buf.size() + n;
+			buf.reserve(want < cap ? want : cap);
+		}
+		buf.insert(buf.end(), data, data + n);
+		data += n;
+		len -= n;
+		head = 0;
+	}
+	while (len > 0)
+	{
+		size_t n = len < cap - head ? len : cap - head;
+		memcpy(&buf[head], data, n);
+		head = (head + n) % cap;
+		data += n;
+		len -= n;
+	}
+}
+/****************************************************************************************/
+/**
+ * OutputRing::writeTo
+ * writes the held bytes, oldest first
+ * @param fd
+ */
+void OutputRing::writeTo(int fd) const
+{
+	if (buf.empty())
+		return;
+	writeAll(fd, &buf[head], buf.size() - head);
+	writeAll(fd, &buf[0], head);
+}
+/****************************************************************************************/
+/**
+ * OutputRing::copyTo
+ * appends the held bytes to out, oldest first
+ * @param out
+ */
+void OutputRing::copyTo(string& out) const
+{
+	if (buf.empty())
+		return;
+	out.append(&buf[head], buf.size() - head);
+	out.append(&buf[0], head);
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * captureAttach function
+ * starts draining fd (the read end of the job's stdout/stderr pipe) into a new ring
+ * @param job_id
+ * @param pid
+ * @param name
+ * @param fd
+ * @return false if fd could not be watched (it is closed in that case)
+ */
+bool captureAttach(int job_id, pid_t pid, const string& name, int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	Capture* c = new Capture(job_id, pid, name, fd);
+	if (!evAdd(fd, EPOLLIN, capture_handler, c))
+	{
+		close(fd);
+		delete c;
+		return false;
+	}
+	captures[job_id] = c;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * captureFind function
+ * @param job_id
+ * @return the capture of job_id, or NULL
+ */
+Capture* captureFind(int job_id)
+{
+	map<int, Capture*>::iterator it = captures.find(job_id);
+	if (it == captures.end())
+		return NULL;
+	return it->second;
+}
+/****************************************************************************************/
+/**
+ * captureList function
+ * prints the memory held by every capture and the total
+ */
+void captureList()
+{
+	size_t total_held = 0;
+	for (map<int, Capture*>::iterator it = captures.begin(); it != captures.end(); ++it)
+	{
+		Capture* c = it->second;
+		cout << "[" << c->job_id << "] " << c->name << " : " << c->pid << " "
+			 << c->ring.held() << "/" << c->ring.cap << " bytes"
+			 << " (total " << c->ring.total << ", dropped " << c->ring.dropped() << ")"
+			 << (c->fd == -1 ? " done" : " running") << endl;
+		total_held += c->ring.buf.capacity();
+	}
+	cout << "capture memory: " << total_held << " bytes in " << captures.size() << " buffers" << endl;
+}
+/****************************************************************************************/
+/**
+ * captureFollow function
+ * prints the captured tail of job_id, then keeps printing new output
+ * until the job closes its output or CTRL+C is pressed
+ * @param job_id
+ */
+void captureFollow(int job_id)
+{
+	Capture* c = captureFind(job_id);
+	if (c == NULL)
+		return;
+	cout.flush();
+	c->ring.writeTo(STDOUT_FILENO);
+
+	follow_id = job_id;
+	smash_interrupted = 0;
+	while (!smash_interrupted)
+	{
+		c = captureFind(job_id);
+		if (c == NULL || c->fd == -1)
+			break;
+		evRunOnce(-1);
+	}
+	follow_id = -1;
+}
@@ -0,0 +1,95 @@
+#ifndef _CAPTURE_H
+#define _CAPTURE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define CAPTURE_DEFAULT_KB 64
+#define CAPTURE_KEEP 64			// finished captures that are kept for `output`
+#define CAPTURE_READ_SIZE 65536
+
+
+/* ####################################################################################
+ *                                 GLOBALS
+#####################################################################################*/
+
+extern size_t capture_limit;	// per job cap in bytes, 0 = bg jobs write to the terminal
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * Bounded byte ring. It grows up to cap and then overwrites the oldest bytes,
+ * so it always holds the last cap bytes that were written to it.
+ */
+class OutputRing
+{
+	public:
+		size_t cap;
+		size_t total;		// bytes ever appended
+		vector<char> buf;
+		size_t head;		// oldest byte once buf is full
+
+		OutputRing(size_t limit)
+		{
+			cap = limit;
+			total = 0;
+			head = 0;
+		}
+
+		//methods:
+		void append(const char* data, size_t len);
+		size_t held() const
+		{
+			return buf.size();
+		}
+		size_t dropped() const
+		{
+			return total - buf.size();
+		}
+		void writeTo(int fd) const;
+		void copyTo(string& out) const;
+};
+
+/**
+ * captured stdout/stderr of one background job
+ */
+class Capture
+{
+	public:
+		int job_id;
+		pid_t pid;
+		string name;
+		int fd;				// read end of the job's pipe, -1 once the job closed it
+		OutputRing ring;
+
+		Capture(int id, pid_t my_pid, const string& command, int read_fd)
+			: job_id(id), pid(my_pid), name(command), fd(read_fd), ring(capture_limit)
+		{
+		}
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool captureAttach(int job_id, pid_t pid, const string& name, int fd);
+Capture* captureFind(int job_id);
+void captureList();
+void captureFollow(int job_id);
+
+
+#endif
@@ -0,0 +1,441 @@
+/* ####################################################################################
+ *                                  CMDCACHE.CC
+ *  Memoizes external commands: exit status and stdout are stored in a content
+ *  addressed directory and replayed when the command line and its inputs are unchanged.
+ *
+ *  <dir>/key/<key>     "status <n>\nsize <bytes>\nsecs <run time>\nobject <hash>\n"
+ *  <dir>/obj/<hash>    the captured stdout, named by the hash of its content
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include "cmdcache.h"
+#include "eventloop.h"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+#define FNV_OFFSET 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define CACHE_IO_SIZE 65536
+
+static unsigned long cache_hits = 0;
+static unsigned long cache_misses = 0;
+static unsigned long long cache_bytes_saved = 0;
+static double cache_secs_saved = 0;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static uint64_t fnv_update(uint64_t h, const void* data, size_t len);
+static string hash_to_hex(uint64_t h);
+static bool hash_file_content(const char* path, uint64_t* h);
+static string cache_dir();
+static bool make_dirs(const string& path);
+static bool write_file(const string& path, const char* data, size_t len);
+static bool read_fd_fully(int fd, string& out);
+static void collect_handler(int fd, unsigned int events, void* ctx);
+
+
+/**
+ * fnv_update function
+ * FNV-1a, 64 bit
+ * @param h current hash
+ * @param data
+ * @param len
+ * @return the updated hash
+ */
+static uint64_t fnv_update(uint64_t h, const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= p[i];
+		h *= FNV_PRIME;
+	}
+	return h;
+}
+/****************************************************************************************/
+/**
+ * hash_to_hex function
+ * @param h
+ * @return 16 lowercase hex digits
+ */
+static string hash_to_hex(uint64_t h)
+{
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)h);
+	return hex;
+}
+/****************************************************************************************/
+/**
+ * hash_file_content function
+ * @param path
+ * @param h updated with the content of path
+ * @return false if path can not be read
+ */
+static bool hash_file_content(const char* path, uint64_t* h)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+	char buf[CACHE_IO_SIZE];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		*h = fnv_update(*h, buf, n);
+	close(fd);
+	return n == 0;
+}
+/****************************************************************************************/
+/**
+ * cache_dir function
+ * @return $SMASH_CACHE_DIR, else $HOME/.cache/smash, else .smash_cache
+ */
+static string cache_dir()
+{
+	const char* dir = getenv(CACHE_DIR_ENV);
+	if (dir != NULL && dir[0] != '\0')
+		return dir;
+	const char* home = getenv("HOME");
+	if (home != NULL && home[0] != '\0')
+		return string(home) + "/" + CACHE_DEFAULT_DIR;
+	return ".smash_cache";
+}
+/****************************************************************************************/
+/**
+ * make_dirs function
+ * mkdir -p
+ * @param path
+ * @return true if path exists as a directory afterwards
+ */
+static bool make_dirs(const string& path)
+{
+	for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1))
+	{
+		string part = path.substr(0, pos);
+		if (mkdir(part.c_str(), 0755) == -1 && errno != EEXIST)
+			return false;
+		if (pos == string::npos)
+			break;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * write_file function
+ * writes to a temporary file and renames it, so readers never see a partial entry
+ * @param path
+ * @param data
+ * @param len
+ * @return true on success
+ */
+static bool write_file(const string& path, const char* data, size_t len)
+{
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".tmp.%d", (int)getpid());
+	string tmp = path + suffix;
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return false;
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			close(fd);
+			unlink(tmp.c_str());
+			return false;
+		}
+		data += n;
+		len -= n;
+	}
+	close(fd);
+	if (rename(tmp.c_str(), path.c_str()) == -1)
+	{
+		unlink(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * read_fd_fully function
+ * @param fd
+ * @param out appended with everything left in fd
+ * @return false on a read error
+ */
+static bool read_fd_fully(int fd, string& out)
+{
+	char buf[CACHE_IO_SIZE];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) != 0)
+	{
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		out.append(buf, n);
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * collect_handler function
+ * appends the command's output to the collector and tees it to the terminal
+ * @param fd
+ * @param events
+ * @param ctx the CacheCollector
+ */
+static void collect_handler(int fd, unsigned int events, void* ctx)
+{
+	CacheCollector* c = (CacheCollector*)ctx;
+	char buf[CACHE_IO_SIZE];
+	ssize_t n = read(fd, buf, sizeof(buf));
+	if (n > 0)
+	{
+		writeAll(STDOUT_FILENO, buf, n);
+		if (!c->detached)
+			c->data.append(buf, n);
+	}
+	else if (n == 0 || (errno != EINTR && errno != EAGAIN))
+	{
+		evDel(fd);
+		if (c->detached)
+		{
+			close(fd);
+			delete c;
+		}
+	}
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * cacheKey function
+ * hashes argv, the working directory, the selected environment variables and the inputs
+ * @param args NULL terminated argv of the command
+ * @param req
+ * @param cwd
+ * @param key receives the hex key
+ * @return false if an input can not be stat'ed or read
+ */
+bool cacheKey(char* args[], const CacheRequest& req, const string& cwd, string& key)
+{
+	uint64_t h = FNV_OFFSET;
+	for (int i = 0; args[i] != NULL; i++)
+		h = fnv_update(h, args[i], strlen(args[i]) + 1);
+	h = fnv_update(h, cwd.c_str(), cwd.length() + 1);
+
+	for (size_t i = 0; i < req.env.size(); i++)
+	{
+		const char* val = getenv(req.env[i].c_str());
+		h = fnv_update(h, req.env[i].c_str(), req.env[i].length() + 1);
+		if (val != NULL)
+			h = fnv_update(h, val, strlen(val) + 1);
+		else
+			h = fnv_update(h, "", 0);	// unset differs from empty
+	}
+
+	for (size_t i = 0; i < req.inputs.size(); i++)
+	{
+		const char* path = req.inputs[i].c_str();
+		h = fnv_update(h, path, strlen(path) + 1);
+		if (req.content)
+		{
+			if (!hash_file_content(path, &h))
+			{
+				perror(path);
+				return false;
+			}
+			continue;
+		}
+		struct stat st;
+		if (stat(path, &st) == -1)
+		{
+			perror(path);
+			return false;
+		}
+		uint64_t fields[5] = { (uint64_t)st.st_dev, (uint64_t)st.st_ino, (uint64_t)st.st_size,
+							   (uint64_t)st.st_mtim.tv_sec, (uint64_t)st.st_mtim.tv_nsec };
+		h = fnv_update(h, fields, sizeof(fields));
+	}
+	key = hash_to_hex(h);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * cacheReplay function
+ * on a hit, writes the cached stdout to our stdout
+ * @param key
+ * @param exit_status receives the cached exit status on a hit
+ * @return true on a hit
+ */
+bool cacheReplay(const string& key, int* exit_status)
+{
+	string dir = cache_dir();
+	int fd = open((dir + "/key/" + key).c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		cache_misses++;
+		return false;
+	}
+	string entry;
+	bool ok = read_fd_fully(fd, entry);
+	close(fd);
+
+	int status;
+	unsigned long long size;
+	double secs;
+	char object[17];
+	if (!ok || sscanf(entry.c_str(), "status %d\nsize %llu\nsecs %lf\nobject %16s", &status, &size, &secs, object) != 4)
+	{
+		cache_misses++;
+		return false;
+	}
+	string out;
+	fd = open((dir + "/obj/" + object).c_str(), O_RDONLY | O_CLOEXEC);
+	// an object that was cut short or changed is a miss
+	if (fd == -1 || !read_fd_fully(fd, out) || out.size() != size
+		|| hash_to_hex(fnv_update(FNV_OFFSET, out.data(), out.size())) != object)
+	{
+		if (fd != -1)
+			close(fd);
+		cache_misses++;
+		return false;
+	}
+	close(fd);
+
+	cout.flush();
+	writeAll(STDOUT_FILENO, out.data(), out.size());
+	*exit_status = status;
+	cache_hits++;
+	cache_bytes_saved += size;
+	cache_secs_saved += secs;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * cacheStore function
+ * @param key
+ * @param exit_status
+ * @param out the command's stdout
+ * @param run_secs how long the command ran, reported as saved time on later hits
+ * @return true if the entry was written
+ */
+bool cacheStore(const string& key, int exit_status, const string& out, double run_secs)
+{
+	string dir = cache_dir();
+	if (!make_dirs(dir + "/key") || !make_dirs(dir + "/obj"))
+	{
+		perror("cache");
+		return false;
+	}
+	uint64_t hash = fnv_update(FNV_OFFSET, out.data(), out.size());
+	string object = hash_to_hex(hash);
+	string obj_path = dir + "/obj/" + object;
+	struct stat st;
+	uint64_t stored = FNV_OFFSET;
+	// identical outputs are stored once: an object is reused only if its content has the hash
+	if (stat(obj_path.c_str(), &st) == -1 || (size_t)st.st_size != out.size()
+		|| !hash_file_content(obj_path.c_str(), &stored) || stored != hash)
+	{
+		if (!write_file(obj_path, out.data(), out.size()))
+		{
+			perror("cache");
+			return false;
+		}
+	}
+	char entry[128];
+	int len = snprintf(entry, sizeof(entry), "status %d\nsize %llu\nsecs %.6f\nobject %s\n",
+					   exit_status, (unsigned long long)out.size(), run_secs, object.c_str());
+	if (!write_file(dir + "/key/" + key, entry, len))
+	{
+		perror("cache");
+		return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * cacheCollectStart function
+ * starts collecting fd (the read end of the command's stdout) in the event loop
+ * @param fd
+ * @return the collector, or NULL if fd can not be watched
+ */
+CacheCollector* cacheCollectStart(int fd)
+{
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	CacheCollector* c = new CacheCollector(fd);
+	if (!evAdd(fd, EPOLLIN, collect_handler, c))
+	{
+		delete c;
+		return NULL;
+	}
+	return c;
+}
+/****************************************************************************************/
+/**
+ * cacheCollectFinish function
+ * the command is done: takes what is left in the pipe and closes it. The caller deletes c.
+ * @param c
+ */
+void cacheCollectFinish(CacheCollector* c)
+{
+	char buf[CACHE_IO_SIZE];
+	ssize_t n;
+	// nonblocking - a grandchild that still holds the pipe must not hang smash
+	while ((n = read(c->fd, buf, sizeof(buf))) > 0 || (n == -1 && errno == EINTR))
+	{
+		if (n > 0)
+		{
+			writeAll(STDOUT_FILENO, buf, n);
+			c->data.append(buf, n);
+		}
+	}
+	evDel(c->fd);
+	close(c->fd);
+	c->fd = -1;
+}
+/****************************************************************************************/
+/**
+ * cacheCollectDetach function
+ * the command was stopped and will not be cached: its output keeps going to the terminal
+ * and the collector frees itself when the command closes the pipe
+ * @param c
+ */
+void cacheCollectDetach(CacheCollector* c)
+{
+	c->detached = true;
+	c->data.clear();
+}
+/****************************************************************************************/
+/**
+ * cachePrintStats function
+ */
+void cachePrintStats()
+{
+	cout << "cache dir: " << cache_dir() << endl;
+	cout << "hits " << cache_hits << " misses " << cache_misses
+		 << " bytes saved " << cache_bytes_saved << " secs saved " << cache_secs_saved << endl;
+}
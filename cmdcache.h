@@ -0,0 +1,73 @@
+#ifndef _CMDCACHE_H
+#define _CMDCACHE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define CACHE_DIR_ENV "SMASH_CACHE_DIR"
+#define CACHE_DEFAULT_DIR ".cache/smash"	// relative to $HOME
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * what a cached command depends on, besides its argv and the working directory
+ */
+class CacheRequest
+{
+	public:
+		vector<string> inputs;	// files, by (dev, ino, size, mtime) or by content
+		vector<string> env;		// names of environment variables
+		bool content;			// hash the inputs' content instead of their stat
+
+		CacheRequest()
+		{
+			content = false;
+		}
+};
+
+/**
+ * collects a command's stdout while smash waits for it, and tees it to the terminal
+ */
+class CacheCollector
+{
+	public:
+		int fd;
+		string data;
+		bool detached;		// nobody waits for data anymore, only tee until EOF
+
+		CacheCollector(int read_fd)
+		{
+			fd = read_fd;
+			detached = false;
+		}
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool cacheKey(char* args[], const CacheRequest& req, const string& cwd, string& key);
+bool cacheReplay(const string& key, int* exit_status);
+bool cacheStore(const string& key, int exit_status, const string& out, double run_secs);
+CacheCollector* cacheCollectStart(int fd);
+void cacheCollectFinish(CacheCollector* c);
+void cacheCollectDetach(CacheCollector* c);
+void cachePrintStats();
+
+
+#endif
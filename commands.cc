@@ -12,8 +12,28 @@
 
 #include "signals.h"
 #include "commands.h"
-
-
+#include "capture.h"
+#include "cmdcache.h"
+#include "eventloop.h"
+#include "fastcmd.h"
+#include "jobsjson.h"
+#include "jobstate.h"
+#include "metrics.h"
+#include "onchange.h"
+#include "parser.h"
+#include "procstat.h"
+#include "script.h"
+#include "trace.h"
+#include "vars.h"
+#include "watch.h"
+#include "zygote.h"
+
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <algorithm>
 #include <string>
 
 /* ####################################################################################
@@ -49,14 +69,35 @@ typedef enum RETURN_VAL
 /* ####################################################################################
 *                                 HELPING FUNCTIONS
 #####################################################################################*/
-static bool BgCommand(string cmd);
 static bool is_string_number(const std::string& s);
+static bool job_matches(const Job& j, const char* spec);
+static const char* select_jobs(char* specs[], int num_specs, vector<size_t>& selected);
+static bool wait_interval(double interval);
+static void format_bytes(char* buf, size_t size, unsigned long long bytes);
+static void jobs_top(double interval);
 static bool error_handler(ERROR err ,char* cmdString);
-static void extractArgs(const char* delimiters, char* lineSize, char *args[MAX_NUM_OF_ARG], int *num_args);
-static void execute_command(char* args[MAX_NUM_OF_ARG], MODE exec_mode, bool is_complicated);
+static pid_t execute_command(char* args[MAX_NUM_OF_ARG], MODE exec_mode, bool is_complicated, int out_fd = -1,
+							 CmdList* list = NULL, char* cmdString = NULL);
+static int BgCmd(CmdList& list, char* cmdString);
+static int prepare_item(CmdList& list, CmdItem& item);
+static int run_item(CmdList& list, CmdItem& item, char* cmdString);
+static int run_list(CmdList& list, char* cmdString);
+static int run_subshell(CmdList& list, char* cmdString);
+static int run_line(CmdList& list, char* lineSize, char* cmdString, LineReader more);
+static int run_parsed(CmdList& list, char* cmdString, bool history, unsigned long long start_ns,
+					  unsigned long long trace_ns);
+static bool read_here_docs(CmdList& list, LineReader more);
+static bool here_open(CmdItem& item, int* saved_stdin);
+static void here_close(int saved_stdin);
+static bool define_function(const char* name, const char* body, bool open, LineReader more);
+static void install_function(const char* name, ShellFunction* f);
+static ShellFunction* find_function(const char* name);
+static void free_function(ShellFunction* f);
+static int call_function(ShellFunction* f, char* args[], int num_arg, char* cmdString);
+static void expand_alias(CmdList& list, CmdItem& item, int pos);
 static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR Bg(char *args[MAX_NUM_OF_ARG], int num_arg);
-static ERROR Jobs(int num_arg);
+static ERROR Jobs(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR Kill(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR ShowPid(int num_arg);
 static ERROR Quit(char *args[MAX_NUM_OF_ARG], int num_arg);
@@ -64,6 +105,17 @@ static ERROR Pwd(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR Cd(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR History(char *args[MAX_NUM_OF_ARG], int num_arg);
 static ERROR Mv(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Output(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Cache(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Wait(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Watch(char *args[MAX_NUM_OF_ARG], int num_arg, MODE exec_mode);
+static ERROR OnChangeCmd(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Export(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Unset(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Alias(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Unalias(char *args[MAX_NUM_OF_ARG], int num_arg);
+static ERROR Return(char *args[MAX_NUM_OF_ARG], int num_arg, int prev_status);
+static ERROR Source(char *args[MAX_NUM_OF_ARG], int num_arg);
 
 
 /* ####################################################################################
@@ -75,6 +127,17 @@ static ERROR Mv(char *args[MAX_NUM_OF_ARG], int num_arg);
 
 extern smashManager sm;
 extern pid_t pid_running_in_fg;
+extern volatile sig_atomic_t smash_interrupted;
+
+// true in a fork of smash that runs a background list: its commands stay in its process group
+static bool in_subshell = false;
+
+static int func_depth = 0;					// function calls in progress
+static int source_depth = 0;				// scripts in progress
+static bool returning = false;				// "return" ran: the function's list or the script stops
+static vector<ShellFunction*> retired;		// redefined while running, freed after the calls
+
+static char input_line[EV_STDIN_BUF_SIZE];	// read by a LineReader, copied before the next read
 
 
 
@@ -88,6 +151,11 @@ extern pid_t pid_running_in_fg;
 #define PRINT_ERROR(cmdString) cout << "smash error: > \"" << cmdString << "\"" << endl
 #define PRINT_PATH_NOT_FOUND_ERROR(path) cout << "smash error: > \"" << path << "\" - path not found" << endl
 #define PRINT_KILL_INVALID_JOB(job_id) cout << "kill " << job_id << " - job does not exist" << endl
+#define PRINT_NO_CAPTURE(job_id) cout << "output " << job_id << " - no captured output" << endl
+#define PRINT_WAIT_INVALID_JOB(job_id) cout << "wait " << job_id << " - job does not exist" << endl
+#define PRINT_WAIT_DONE(job_id, name, status) cout << "[" << job_id << "] " << name << " : done, status " << status << endl
+#define PRINT_WATCH_NOT_FOUND(cmd) cout << "watch " << cmd << " - command not found" << endl
+#define PRINT_ONCHANGE_INVALID(id) cout << "onchange " << id << " - does not exist" << endl
 
 
 
@@ -126,21 +194,6 @@ static bool error_handler(ERROR err ,char* cmdString)
 }
 
 
-/**
- * BgCommand method
- * @param cmd
- * @return true if command with name cmd (string) is running in bg
- */
-static bool BgCommand(string cmd)
-{
-	if (cmd.length() == 0)
-		return false;
-	if (cmd.at(cmd.length()-1) == '&')
-	{
-		return true;
-	}
-	return false;
-}
 
 
 
@@ -149,51 +202,154 @@ static bool BgCommand(string cmd)
  * @param args
  * @param exec_mode
  * @param is_complicated
+ * @param out_fd if not -1, becomes the child's stdout
+ * @param list if not NULL, the child runs this list (see run_subshell) instead of exec'ing args
+ * @param cmdString the line of list
+ * @return the child's pid, or -1 if fork failed
  * 				    This function creates a child process and executes the external command in it.
 					In the father process, the command is pushed to the job vector.
 					When the child process is done, the job is cleaned from the job vector by sig_waitpid.
+					If capture is enabled, a bg job's stdout and stderr go to a pipe drained into its ring.
+					With --zygote the child is launched by the spawn helper instead of a fork of smash,
+					and smash forks it itself if the helper could not.
  */
-static void execute_command(char* args[MAX_NUM_OF_ARG], MODE exec_mode, bool is_complicated)
+static pid_t execute_command(char* args[MAX_NUM_OF_ARG], MODE exec_mode, bool is_complicated, int out_fd,
+							 CmdList* list, char* cmdString)
 {
-	pid_t pID;
-	switch(pID = fork())
+	int cap_pipe[2] = {-1, -1};
+	if (exec_mode == BG_EXEC_MODE && capture_limit > 0 && pipe2(cap_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		cap_pipe[0] = cap_pipe[1] = -1;
+	}
+
+	unsigned long long spawn_ns = metricsStart();
+	unsigned long long trace_ns = traceBegin();
+	char** envp = varEnvp();
+	pid_t pID = -1;
+	if (zygoteActive() && list == NULL)
+	{
+		// the helper sets up the child like case 0 below, and never returns 0
+		int child_out = (out_fd != -1) ? out_fd : (cap_pipe[1] != -1) ? cap_pipe[1] : STDOUT_FILENO;
+		int child_err = (cap_pipe[1] != -1) ? cap_pipe[1] : STDERR_FILENO;
+		pID = zygoteSpawn(args, envp, varEnvGeneration(), STDIN_FILENO, child_out, child_err);
+	}
+	// without the helper, or when it could not launch the command (E2BIG, a bad request, gone)
+	if (pID == -1)
+	{
+		cout.flush();	// a child that runs a list flushes cout itself
+		pID = fork();
+	}
+	if (pID > 0)
+	{
+		metricsCount(CNT_SPAWNS);
+		metricsRecord(HIST_SPAWN, spawn_ns);
+		traceSpan("spawn", trace_ns, args[0]);
+		traceAsync('b', "job", pID, args[0]);
+	}
+	switch(pID)
 	{
 		case -1:
 		{
+			metricsCount(CNT_SPAWN_FAILURES);
 			perror("Error: fork");
-			return;
+			if (cap_pipe[0] != -1)
+			{
+				close(cap_pipe[0]);
+				close(cap_pipe[1]);
+			}
+			return -1;
 		}
 		case 0 :
 		{
 			// Child Process
-			setpgrp();
+			if (!in_subshell)
+				setpgrp();
+			unblockSignals();
+			if (cap_pipe[1] != -1)
+			{
+				dup2(cap_pipe[1], STDOUT_FILENO);
+				dup2(cap_pipe[1], STDERR_FILENO);
+			}
+			if (out_fd != -1)
+			{
+				dup2(out_fd, STDOUT_FILENO);
+			}
+			if (list != NULL)
+			{
+				_exit(run_subshell(*list, cmdString));
+			}
 			// Execute an external command
-			if (execvp(args[0], args))
+			if (execvpe(args[0], args, envp))
 			{
 				perror("external cmd");
 			}
-			exit(1);
+			// not exit(): smash's atexit handlers and cout buffer belong to the parent
+			_exit(1);
 		}
 
 		default:
 		{
+			// the child does the same; whichever runs first, the group exists before it is signalled
+			if (!in_subshell)
+				setpgid(pID, pID);
 			int name_index = 0;
 			if (is_complicated)
 				name_index = 3;
-			sm.jobs.push_back(Job(pID, args[name_index], false));
+			// a list job is named by its line, without the "&"
+			Job& job = sm.addJob(pID, (list != NULL) ? cmdString : args[name_index], false);
+			if (list != NULL)
+				job.name.erase(job.name.find_last_not_of(" \t&") + 1);
 			vector<Job>::iterator j = sm.jobs.end();
 			j--;
+			if (cap_pipe[1] != -1)
+			{
+				close(cap_pipe[1]);
+				captureAttach(j->id, pID, j->name, cap_pipe[0]);
+			}
 			// wait if running in fg mode
 			if (exec_mode == FG_EXEC_MODE)
 			{
 				pid_running_in_fg = pID;
 				sig_waitpid(j, WUNTRACED);
 			}
+			return pID;
 		}
 
 	}
 }
 
+/**
+ * a job the wait builtin waits for
+ */
+struct WaitTarget
+{
+	int id;
+	pid_t pid;
+	string name;
+	int fd;			// pidfd, -1 if the kernel has none (then it is polled)
+	bool ready;		// queued in wait_ready_list
+};
+
+static vector<WaitTarget*> wait_ready_list;
+
+/**
+ * wait_pidfd_handler function
+ * a pidfd becomes readable once its process is done
+ * @param fd
+ * @param events
+ * @param ctx the WaitTarget
+ */
+static void wait_pidfd_handler(int fd, unsigned int events, void* ctx)
+{
+	WaitTarget* t = (WaitTarget*)ctx;
+	if (!t->ready)
+	{
+		t->ready = true;
+		wait_ready_list.push_back(t);
+	}
+}
+
 /**
  * Pwd function
  * @param args
@@ -238,15 +394,15 @@ static ERROR Cd(char *args[MAX_NUM_OF_ARG], int num_arg)
 		return INVALID_PARAM;
 	}
 
-	string path = args[1];
-	string next_path;
-	if (!strcmp(path.c_str(), "-"))
+	// no string copies: cd runs on the allocation free path (see bench/bench_alloc.cc)
+	const char* path = args[1];
+	if (!strcmp(path, "-"))
 	{
-		path = sm.lwd;
+		path = sm.lwd.c_str();
 		comma = 1;
 	}
 
-	if(chdir(path.c_str()))
+	if(chdir(path))
 	{
 		PRINT_PATH_NOT_FOUND_ERROR(path);
 		return INVALID_PATH;
@@ -294,6 +450,11 @@ static ERROR History(char *args[MAX_NUM_OF_ARG], int num_arg)
 
 /**
  * Jobs: displays the current job vector, which contains the running in the background and suspended processes
+ * "jobs --json" prints one JSON snapshot that also holds the recently finished jobs (see jobsjson.cc),
+ * "jobs --ndjson [SECS]" prints one JSON object per line, again every SECS seconds until CTRL+C if given
+ * "jobs --top [SECS]" shows the CPU%, memory, I/O and threads of every job's process group, refreshed
+ * every SECS seconds (default JOBS_TOP_DEFAULT_SECS) until CTRL+C, see jobs_top
+ * @param args
  * @param num_arg
  * @return
  *  *  *  NONE- if success
@@ -304,11 +465,42 @@ static ERROR History(char *args[MAX_NUM_OF_ARG], int num_arg)
 	MV_FAILED - mv command did not succeeed
 	WAITPID_FAILED- waitpid command did not succeed
  */
-static ERROR Jobs(int num_arg)
+static ERROR Jobs(char *args[MAX_NUM_OF_ARG], int num_arg)
 {
-	if (num_arg != 1)
+	jobStateRefresh();
+	if (num_arg > 1 && !strcmp(args[1], "--top"))
 	{
-		return INVALID_PARAM;
+		double interval = (num_arg == 3) ? atof(args[2]) : JOBS_TOP_DEFAULT_SECS;
+		if (num_arg > 3 || interval <= 0)
+		{
+			return INVALID_PARAM;
+		}
+		// a single table when it does not go to a terminal, unless the interval is given
+		jobs_top((num_arg == 3 || isatty(STDOUT_FILENO)) ? interval : 0);
+		return NONE;
+	}
+	if (num_arg > 1)
+	{
+		bool ndjson = !strcmp(args[1], "--ndjson");
+		if ((!ndjson && strcmp(args[1], "--json")) || num_arg > 3 || (num_arg == 3 && !ndjson))
+		{
+			return INVALID_PARAM;
+		}
+		double interval = (num_arg == 3) ? atof(args[2]) : 0;
+		if (num_arg == 3 && interval <= 0)
+		{
+			return INVALID_PARAM;
+		}
+
+		static string out;	// reused, so polling does not reallocate
+		smash_interrupted = 0;
+		do
+		{
+			jobsToJson(out, ndjson);
+			cout.flush();
+			writeAll(STDOUT_FILENO, out.data(), out.size());
+		} while (interval > 0 && wait_interval(interval));
+		return NONE;
 	}
 
 	for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
@@ -320,30 +512,37 @@ static ERROR Jobs(int num_arg)
 
 /**
  * Kill function
+ * kill -SIGNUM JOB... sends the signal to the process group of every selected job
+ * (JOB is N, %N, %all, %stopped, %running or a glob on the job name)
  * @param args
  * @param num_arg
  * @return It handles the kill command (send signal to a different process).
  */
 static ERROR Kill(char *args[MAX_NUM_OF_ARG], int num_arg)
 {
-	if (num_arg != 3)
+	if (num_arg < 3 || args[1][0] != '-')
 	{
 		return INVALID_PARAM;
 	}
-	int job_id = atoi(args[2]);
-	vector<Job>::iterator job = sm.getJobById(job_id);
-	if (job== sm.jobs.end())
+	vector<size_t> selected;
+	const char* missing = select_jobs(args + 2, num_arg - 2, selected);
+	if (missing != NULL)
 	{
-		PRINT_KILL_INVALID_JOB(job_id);
+		PRINT_KILL_INVALID_JOB(missing);
 		return INVALID_JOB;
 	}
 	int signum = atoi(args[1]+1);
-	if (!sig_kill(job->pid, signum))
+	ERROR result = NONE;
+	for (size_t i = 0; i < selected.size(); i++)
 	{
-		PRINT_KILL_FAILED(job_id);
-		return KILL_FAILED;
+		const Job& job = sm.jobs[selected[i]];
+		if (!sig_kill(job.pgid, signum))
+		{
+			PRINT_KILL_FAILED(job.id);
+			result = KILL_FAILED;
+		}
 	}
-	return NONE;
+	return result;
 }
 
 /**
@@ -370,7 +569,8 @@ static ERROR ShowPid(int num_arg)
 
 /*  Fg
  *  It handles the fg command (move a job running in the background or suspended to the foreground).
-	If no arguments are given, the fg command moves the newest job to the foreground
+	If no arguments are given, the fg command moves the newest job to the foreground.
+	The argument is a job selector (see job_matches); if it selects several jobs, the last one is used
  *  @param args
  *  @param num_arg
  *  @return
@@ -384,14 +584,12 @@ static ERROR ShowPid(int num_arg)
  */
 static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg)
 {
+	jobStateRefresh();
 	if ((num_arg != 1) && (num_arg != 2))
 	{
 		return INVALID_PARAM;
 	}
 
-	if (num_arg == 2 && (!is_string_number(args[1])))
-		return INVALID_PARAM;
-
 	if (sm.jobs.empty())
 		return NONE;
 
@@ -400,14 +598,14 @@ static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg)
 		job_to_fg = sm.findLatestJob();
 	else
 	{
-
-		int id_to_fg = atoi(args[1]);
-		job_to_fg = sm.getJobById(id_to_fg);
-		if (job_to_fg == sm.jobs.end())
+		vector<size_t> selected;
+		select_jobs(args + 1, 1, selected);
+		if (selected.empty())
 		{
-			PRINT_FG_INVALID_JOB(id_to_fg);
+			PRINT_FG_INVALID_JOB(args[1]);
 			return INVALID_JOB;
 		}
+		job_to_fg = sm.jobs.begin() + selected.back();
 	}
 	cout << job_to_fg->name << endl;
 
@@ -415,7 +613,8 @@ static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg)
 	if (job_to_fg->is_delayed)
 	{
 		job_to_fg->is_delayed = false;
-		if (!sig_kill(job_to_fg->pid, SIGCONT))
+		traceAsync('e', "stopped", job_to_fg->pid);
+		if (!sig_kill(job_to_fg->pgid, SIGCONT))
 		{
 			return KILL_FAILED;
 		}
@@ -427,6 +626,8 @@ static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg)
 
 /**
  * Bg func: It handles the bg command (move a job running in the foreground to the background).
+ * "bg JOB..." continues the selected jobs (see job_matches), "bg --all" every stopped job, in one pass.
+ * When several jobs are selected, the ones already running are left alone.
  * @param args
  * @param num_arg
  * @return
@@ -440,234 +641,1178 @@ static ERROR Fg(char *args[MAX_NUM_OF_ARG], int num_arg)
  */
 static ERROR Bg(char *args[MAX_NUM_OF_ARG], int num_arg)
 {
-	if ((num_arg != 1) && (num_arg != 2))
-	{
-		return INVALID_PARAM;
-	}
-
-	if (num_arg == 2 && (!is_string_number(args[1])))
-		return INVALID_PARAM;
-
-	vector<Job>::iterator job_to_bg;
+	jobStateRefresh();
 	if (num_arg == 1)
 	{
-		job_to_bg = sm.get_latest_delayed_job();
+		vector<Job>::iterator job_to_bg = sm.get_latest_delayed_job();
 		if (job_to_bg == sm.jobs.end())
 			return NONE;
-	}
-	else
-	{
-		int id_to_bg = atoi(args[1]);
-		job_to_bg = sm.getJobById(id_to_bg);
-		if (job_to_bg == sm.jobs.end())
+		cout << job_to_bg->name << endl;
+		if (!sig_kill(job_to_bg->pgid, SIGCONT))
 		{
-			PRINT_FG_INVALID_JOB(id_to_bg);
-			return INVALID_JOB;
+			return KILL_FAILED;
 		}
+		return NONE;
 	}
-	cout << job_to_bg->name << endl;
-	if (!sig_kill(job_to_bg->pid, SIGCONT))
+
+	char all_stopped[] = "%stopped";
+	char* all_args[] = { all_stopped };
+	char** specs = args + 1;
+	if (!strcmp(args[1], "--all"))
 	{
-		return KILL_FAILED;
+		if (num_arg != 2)
+			return INVALID_PARAM;
+		specs = all_args;
 	}
-
-	return NONE;
-}
-
-/**
- * Mv renames a file from its old name to a new name, given as arguments
- * @param args
- * @param num_arg
- * @return
- * NONE- if success
-	INVALID_PARAM- if param is NULL or illegal according to the question
-	INVALID_PATH- if current path is invalid
-	INVALID_JOB- if job is invalid
-	KILL_FAILED- kill command did not succeed
-	MV_FAILED - mv command did not succeeed
-	WAITPID_FAILED- waitpid command did not succeed
- */
-static ERROR Mv(char *args[MAX_NUM_OF_ARG], int num_arg){
-	if (num_arg != 3){
-		return INVALID_PARAM;
+	vector<size_t> selected;
+	const char* missing = select_jobs(specs, num_arg - 1, selected);
+	if (missing != NULL)
+	{
+		PRINT_FG_INVALID_JOB(missing);
+		return INVALID_JOB;
 	}
-	string oldFileName = args[1];
-	string newFileName = args[2];
-	if(rename(oldFileName.c_str(),newFileName.c_str()) == -1){
-		perror("mv");
-		return MV_FAILED;
+	ERROR result = NONE;
+	for (size_t i = 0; i < selected.size(); i++)
+	{
+		const Job& job = sm.jobs[selected[i]];
+		if (selected.size() > 1 && !job.is_delayed)
+			continue;
+		cout << job.name << endl;
+		if (!sig_kill(job.pgid, SIGCONT))
+			result = KILL_FAILED;
 	}
-	cout << oldFileName << " has been renamed to " << newFileName << endl;
-	return NONE;
-
+	return result;
 }
 
 /**
- * 		Quit func:
-		It handles the quit and quit kill commands
-		If quit is called, the command exits smash (calling the smashManager destructor to erase the job vector memory).
-		If quit kill is called, the command sends SIGTERM to all processes running in the background, waits 5 seconds,
-		and if they don't respond it sends SIGKILL.
+ * Wait func: It handles the wait command (block until background jobs are done).
+ * "wait [%id...]" waits for the given jobs (all jobs if none is given), "wait -n" for the first of them,
+ * "--timeout SECS" gives up after SECS. Every job gets a pidfd in the event loop, so a wakeup costs one
+ * epoll_wait and one wait4 for the job that is done, however many jobs are waited for.
+ * The status of the last job reaped is kept in sm.last_status (124 on timeout, 130 on CTRL+C).
  * @param args
  * @param num_arg
  * @return
  * NONE- if success
 	INVALID_PARAM- if param is NULL or illegal according to the question
-	INVALID_PATH- if current path is invalid
 	INVALID_JOB- if job is invalid
-	KILL_FAILED- kill command did not succeed
-	MV_FAILED - mv command did not succeeed
-	WAITPID_FAILED- waitpid command did not succeed
  */
-static ERROR Quit(char *args[MAX_NUM_OF_ARG], int num_arg)
+static ERROR Wait(char *args[MAX_NUM_OF_ARG], int num_arg)
 {
-	if ((num_arg != 1) && (num_arg != 2))
+	bool any = false;
+	double timeout = -1;
+	int i = 1;
+	for (; i < num_arg && args[i][0] == '-'; i++)
 	{
-		return INVALID_PARAM;
+		if (!strcmp(args[i], "-n"))
+			any = true;
+		else if (!strcmp(args[i], "--timeout") && i + 1 < num_arg && (timeout = atof(args[i+1])) > 0)
+			i++;
+		else
+			return INVALID_PARAM;
 	}
 
-
-	if (num_arg == 1)
+	vector<WaitTarget> targets;
+	targets.reserve(i < num_arg ? num_arg - i : sm.jobs.size());	// handlers keep pointers into it
+	if (i == num_arg)
 	{
-		exit(0);
+		for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+		{
+			WaitTarget t = { j->id, j->pid, j->name, -1, false };
+			targets.push_back(t);
+		}
 	}
-	// illegal command
-	if (strcmp(args[1], "kill"))
+	for (; i < num_arg; i++)
 	{
-		return INVALID_PARAM;
+		const char* id_str = (args[i][0] == '%') ? args[i] + 1 : args[i];
+		if (!is_string_number(id_str))
+			return INVALID_PARAM;
+		vector<Job>::iterator j = sm.getJobById(atoi(id_str));
+		if (j == sm.jobs.end())
+		{
+			PRINT_WAIT_INVALID_JOB(id_str);
+			return INVALID_JOB;
+		}
+		WaitTarget t = { j->id, j->pid, j->name, -1, false };
+		targets.push_back(t);
 	}
-	signal(SIGCHLD, SIG_DFL);
+	if (targets.empty())
+		return NONE;
 
-	vector<Job>::iterator j;
-	for(j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+	vector<WaitTarget*> polled;
+	wait_ready_list.clear();
+	for (vector<WaitTarget>::iterator t = targets.begin(); t != targets.end(); ++t)
 	{
-		cout << "Sending SIGTERM... ";
-		if (kill(j->pid, SIGTERM))
+		sm.getJobBbPID(t->pid)->is_waited = true;
+		t->fd = syscall(SYS_pidfd_open, t->pid, 0);
+		if (t->fd != -1 && !evAdd(t->fd, EPOLLIN, wait_pidfd_handler, &*t))
 		{
-			perror("kill failed");
-			return KILL_FAILED;
+			close(t->fd);
+			t->fd = -1;
 		}
+		if (t->fd == -1)
+			polled.push_back(&*t);
+	}
 
-		sleep(5);
-		int stat;
-		pid_t returned_pid = waitpid(j->pid, &stat, WNOHANG | WUNTRACED);
-		if (returned_pid == -1)
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long long deadline_ms = now.tv_sec * 1000LL + now.tv_nsec / 1000000 + (long long)(timeout * 1000);
+	size_t left = targets.size();
+	bool timed_out = false;
+	smash_interrupted = 0;
+	while (left > 0 && !(any && left < targets.size()) && !smash_interrupted)
+	{
+		// pidfd jobs that are done, then the ones without a pidfd
+		vector<WaitTarget*> check;
+		check.swap(wait_ready_list);
+		check.insert(check.end(), polled.begin(), polled.end());
+		for (size_t k = 0; k < check.size() && !(any && left < targets.size()); k++)
 		{
-			perror("waitpid");
-			return WAITPID_FAILED;
+			WaitTarget* t = check[k];
+			int status;
+			t->ready = false;
+			if (t->pid == -1 || !sig_reap(t->pid, &status))
+				continue;
+			if (status == JOB_STATUS_UNKNOWN)
+			{
+				PRINT_WAIT_DONE(t->id, t->name, "unknown");
+			}
+			else
+			{
+				PRINT_WAIT_DONE(t->id, t->name, status);
+				sm.last_status = status;
+			}
+			if (t->fd != -1)
+			{
+				evDel(t->fd);
+				close(t->fd);
+				t->fd = -1;
+			}
+			else
+				polled.erase(find(polled.begin(), polled.end(), t));
+			t->pid = -1;
+			left--;
 		}
-		else if (returned_pid == 0)
-		{
-			cout << "(5 seconds passed) ";
+		if (left == 0 || (any && left < targets.size()))
+			break;
 
-			cout << "Sending SIGKILL... ";
-			if (kill(j->pid, SIGKILL))
+		int wait_ms = -1;
+		if (timeout > 0)
+		{
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			long long left_ms = deadline_ms - (now.tv_sec * 1000LL + now.tv_nsec / 1000000);
+			if (left_ms <= 0)
 			{
-				perror("kill failed");
-				return KILL_FAILED;
+				timed_out = true;
+				break;
 			}
+			wait_ms = (int)left_ms;
+		}
+		// with no pidfds, SIGCHLD wakes us up
+		evRunOnce(wait_ms);
+	}
 
+	// the jobs still running go back to the SIGCHLD handler
+	for (vector<WaitTarget>::iterator t = targets.begin(); t != targets.end(); ++t)
+	{
+		if (t->fd != -1)
+		{
+			evDel(t->fd);
+			close(t->fd);
 		}
-		cout << "Done." << endl;
-		j = sm.jobs.erase(j);
-		j--;
+		vector<Job>::iterator j = (t->pid != -1) ? sm.getJobBbPID(t->pid) : sm.jobs.end();
+		if (j != sm.jobs.end())
+			j->is_waited = false;
 	}
-	exit(0);
+	wait_ready_list.clear();
+	sig_reap_jobs();
 
-}
-/**
- * is_string_number method:
- * determines if a string is a number or not
- * @param s
- * @return
- */
-static bool is_string_number(const std::string& s)
-{
-	string::const_iterator it = s.begin();
-	while (it != s.end() && std::isdigit(*it))
+	if (timed_out)
 	{
-		++it;
+		cout << "wait: timed out, " << left << " jobs still running" << endl;
+		sm.last_status = 124;
 	}
-	return !s.empty() && it == s.end();
+	else if (smash_interrupted)
+	{
+		sm.last_status = 130;
+	}
+	return NONE;
 }
-/* ####################################################################################
-*                                 HEADER FUNCTIONS
-#####################################################################################*/
 
 /**
- * interprets and executes built-in commands
- * @param lineSize
- * @param cmdString
+ * Watch func: "watch [-n SECS] cmd [args...]" reruns cmd every SECS (default WATCH_DEFAULT_SECS) seconds,
+ * and prints its output when it changed (see watch.cc). SECS must be at least WATCH_MIN_SECS.
+ * The watch runs as a job, a fork of smash, in the foreground or with "&" in the background.
+ * @param args
+ * @param num_arg
+ * @param exec_mode
  * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_PATH- if cmd is not found
  */
-int ExeCmd(char* lineSize, char* cmdString)
+static ERROR Watch(char *args[MAX_NUM_OF_ARG], int num_arg, MODE exec_mode)
 {
-
-	char* args[MAX_NUM_OF_ARG];
-	string dels = " \t\n";
-	const char* delimiters = dels.c_str();
-	int num_arg;
-	bool is_history = false;
-	ERROR result = NONE;
-	char* cmd_str = strtok(lineSize, delimiters);
-		if (cmd_str == NULL)
-			return FAILURE;
-	args[0] = cmd_str;
-	num_arg = 1;
-	for (int i=1; i<MAX_NUM_OF_ARG; i++)
+	double secs = WATCH_DEFAULT_SECS;
+	int i = 1;
+	if (i + 1 < num_arg && !strcmp(args[i], "-n"))
 	{
-		args[i] = strtok(NULL, delimiters);
-		if (args[i] != NULL)
-		{
-			num_arg++;
-		}
-
+		secs = atof(args[i+1]);
+		if (!(secs >= WATCH_MIN_SECS))
+			return INVALID_PARAM;
+		i += 2;
 	}
+	if (i == num_arg)
+		return INVALID_PARAM;
 
-	/*************************************************/
-	/*						pwd						 */
-	/*************************************************/
-	if (!strcmp(cmd_str, "pwd"))
+	// resolved once, every tick execs the file directly
+	string path;
+	if (!watchResolve(args[i], path))
 	{
-		result = Pwd(args, num_arg);
+		PRINT_WATCH_NOT_FOUND(args[i]);
+		return INVALID_PATH;
 	}
 
-	/*************************************************/
-	/*						cd						 */
-	/*************************************************/
-	else if (!strcmp(cmd_str, "cd") )
+	cout.flush();
+	pid_t pID = fork();
+	if (pID == -1)
 	{
-		result = Cd(args, num_arg);
+		perror("Error: fork");
+		return NONE;
 	}
-	/*************************************************/
-	/*						history					 */
-	/*************************************************/
-	else if (!strcmp(cmd_str, "history")) //history commands will not be listed
+	if (pID == 0)
 	{
-		result = History(args, num_arg);
-		is_history = true;
+		if (!in_subshell)
+			setpgrp();
+		unblockSignals();
+		// the event loop, signalfd and control socket stay with smash
+		syscall(SYS_close_range, 3, ~0U, 0);
+		watchRun(path.c_str(), args + i, secs);
 	}
-	/*************************************************/
-	/*						jobs					 */
-	/*************************************************/
-	else if (!strcmp(cmd_str, "jobs"))
+	if (!in_subshell)
+		setpgid(pID, pID);
+	traceAsync('b', "job", pID, args[0]);
+	sm.addJob(pID, args[0], false);
+	if (exec_mode == FG_EXEC_MODE)
 	{
-		result = Jobs(num_arg);
+		pid_running_in_fg = pID;
+		sig_waitpid(sm.jobs.end() - 1, WUNTRACED);
 	}
-	/*************************************************/
-	/*						kill					 */
-	/*************************************************/
-	else if (!strcmp(cmd_str, "kill"))
+	return NONE;
+}
+
+/**
+ * OnChangeCmd func: handles the onchange command (see onchange.cc)
+ *   onchange [-r] [-d MS] PATH... -- cmd [args...]   runs "cmd &" after PATH changed and was quiet for MS ms
+ *   onchange                                          lists the registrations
+ *   onchange -c ID                                    removes one
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_PATH- if no PATH could be watched
+	INVALID_JOB- if there is no registration ID
+ */
+static ERROR OnChangeCmd(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 1)
 	{
-		result = Kill(args, num_arg);
+		onchangePrint();
+		return NONE;
+	}
+	if (!strcmp(args[1], "-c"))
+	{
+		if (num_arg != 3 || !is_string_number(args[2]))
+			return INVALID_PARAM;
+		if (!onchangeRemove(atoi(args[2])))
+		{
+			PRINT_ONCHANGE_INVALID(args[2]);
+			return INVALID_JOB;
+		}
+		return NONE;
 	}
 
-	/*************************************************/
-	/*						showpid					 */
-	/*************************************************/
-	else if (!strcmp(cmd_str, "showpid"))
+	bool recursive = false;
+	int debounce_ms = ONCHANGE_DEFAULT_MS;
+	int i = 1;
+	for (; i < num_arg && args[i][0] == '-' && strcmp(args[i], "--"); i++)
 	{
-		result = ShowPid(num_arg);
+		if (!strcmp(args[i], "-r"))
+			recursive = true;
+		else if (!strcmp(args[i], "-d") && i + 1 < num_arg && is_string_number(args[i+1]))
+			debounce_ms = atoi(args[++i]);
+		else
+			return INVALID_PARAM;
+	}
+	vector<string> paths;
+	for (; i < num_arg && strcmp(args[i], "--"); i++)
+		paths.push_back(args[i]);
+	if (paths.empty() || i + 1 >= num_arg)
+		return INVALID_PARAM;
+	string line = args[++i];
+	for (i++; i < num_arg; i++)
+		line = line + " " + args[i];
+
+	int id = onchangeAdd(paths, recursive, debounce_ms, line);
+	if (id == -1)
+		return INVALID_PATH;
+	cout << "[" << id << "] " << line << endl;
+	return NONE;
+}
+
+/**
+ * Export func: marks variables for the environment of the commands smash runs (see vars.cc)
+ *   export                       lists them
+ *   export NAME[=value]...       exports NAME, setting it first if a value is given
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if a NAME is not a valid name
+ */
+static ERROR Export(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 1)
+	{
+		varPrintExported();
+		return NONE;
+	}
+	ERROR result = NONE;
+	for (int i = 1; i < num_arg; i++)
+	{
+		if (!varExport(args[i]))
+			result = INVALID_PARAM;
+	}
+	return result;
+}
+
+/**
+ * Unset func: removes shell variables, and them from the environment if they were exported
+ *   unset NAME...                removes variables
+ *   unset -f NAME...             removes functions
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if a NAME is not a valid name
+ */
+static ERROR Unset(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	ERROR result = NONE;
+	bool functions = (num_arg > 1 && !strcmp(args[1], "-f"));
+	for (int i = functions ? 2 : 1; i < num_arg; i++)
+	{
+		if (functions)
+		{
+			map<string, ShellFunction*>::iterator f = sm.functions.find(args[i]);
+			if (f != sm.functions.end())
+			{
+				free_function(f->second);
+				sm.functions.erase(f);
+			}
+		}
+		else if (!varUnset(args[i]))
+			result = INVALID_PARAM;
+	}
+	return result;
+}
+
+/**
+ * Alias func: names a command and its first arguments. smash has no quoting, so the
+ * words are expanded and split when the alias is defined, and kept that way.
+ *   alias                        lists the aliases
+ *   alias NAME                   shows one
+ *   alias NAME=WORDS...          defines NAME as WORDS
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if NAME is not an alias, or not a valid name
+ */
+static ERROR Alias(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 1)
+	{
+		for (map<string, ShellAlias*>::iterator a = sm.aliases.begin(); a != sm.aliases.end(); ++a)
+			cout << "alias " << a->first << "=" << a->second->value << endl;
+		return NONE;
+	}
+	char* eq = strchr(args[1], '=');
+	if (eq == NULL)
+	{
+		map<string, ShellAlias*>::iterator a = sm.aliases.find(args[1]);
+		if (num_arg != 2 || a == sm.aliases.end())
+			return INVALID_PARAM;
+		cout << "alias " << a->first << "=" << a->second->value << endl;
+		return NONE;
+	}
+	string name(args[1], eq - args[1]);
+	if (name.empty() || name.find('/') != string::npos)
+		return INVALID_PARAM;
+
+	ShellAlias* alias = new ShellAlias();
+	for (int i = 1; i < num_arg; i++)
+	{
+		const char* word = (i == 1) ? eq + 1 : args[i];
+		if (*word == '\0')
+			continue;
+		if (!alias->value.empty())
+			alias->value += ' ';
+		alias->value += word;
+		alias->words.insert(alias->words.end(), word, word + strlen(word) + 1);
+	}
+	for (size_t pos = 0; pos < alias->words.size(); pos += strlen(&alias->words[pos]) + 1)
+		alias->argv.push_back(&alias->words[pos]);
+	ShellAlias*& slot = sm.aliases[name];
+	delete slot;
+	slot = alias;
+	return NONE;
+}
+
+/**
+ * Unalias func: removes aliases
+ *   unalias NAME...              removes them
+ *   unalias -a                   removes all of them
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if a NAME is not an alias
+ */
+static ERROR Unalias(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 1)
+		return INVALID_PARAM;
+	if (num_arg == 2 && !strcmp(args[1], "-a"))
+	{
+		for (map<string, ShellAlias*>::iterator a = sm.aliases.begin(); a != sm.aliases.end(); ++a)
+			delete a->second;
+		sm.aliases.clear();
+		return NONE;
+	}
+	ERROR result = NONE;
+	for (int i = 1; i < num_arg; i++)
+	{
+		map<string, ShellAlias*>::iterator a = sm.aliases.find(args[i]);
+		if (a == sm.aliases.end())
+		{
+			result = INVALID_PARAM;
+			continue;
+		}
+		delete a->second;
+		sm.aliases.erase(a);
+	}
+	return result;
+}
+
+/**
+ * Return func: ends the function or sourced script that runs it
+ *   return [N]                   with status N, else with the status of the last command
+ * @param args
+ * @param num_arg
+ * @param prev_status the status of the last command
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if no function or script is running, or N is not a number
+ */
+static ERROR Return(char *args[MAX_NUM_OF_ARG], int num_arg, int prev_status)
+{
+	if ((func_depth == 0 && source_depth == 0) || num_arg > 2 || (num_arg == 2 && !is_string_number(args[1])))
+		return INVALID_PARAM;
+	sm.last_status = (num_arg == 2) ? (atoi(args[1]) & 0xff) : prev_status;
+	returning = true;
+	return NONE;
+}
+
+/**
+ * Source func: runs a script in smash (see script.cc)
+ *   source FILE [ARGS...]        with ARGS as $1... if given
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if the script ran, its status is the status of its last command
+	INVALID_PARAM- if FILE is missing
+ */
+static ERROR Source(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 1)
+		return INVALID_PARAM;
+	RunScript(args[1], (num_arg > 2) ? args + 1 : NULL, num_arg - 1);
+	return NONE;
+}
+
+/**
+ * Mv renames a file from its old name to a new name, given as arguments
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_PATH- if current path is invalid
+	INVALID_JOB- if job is invalid
+	KILL_FAILED- kill command did not succeed
+	MV_FAILED - mv command did not succeeed
+	WAITPID_FAILED- waitpid command did not succeed
+ */
+static ERROR Mv(char *args[MAX_NUM_OF_ARG], int num_arg){
+	if (num_arg != 3){
+		return INVALID_PARAM;
+	}
+	string oldFileName = args[1];
+	string newFileName = args[2];
+	if(rename(oldFileName.c_str(),newFileName.c_str()) == -1){
+		perror("mv");
+		return MV_FAILED;
+	}
+	cout << oldFileName << " has been renamed to " << newFileName << endl;
+	return NONE;
+
+}
+
+/**
+ * Output func: It handles the output command (show the captured output of background jobs).
+ * "output" lists the captures and the memory they hold, "output %id" prints the captured tail of a job,
+ * and "output %id -f" keeps printing the job's new output until it is done or CTRL+C is pressed.
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_JOB- if there is no capture for the job
+ */
+static ERROR Output(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if ((num_arg < 1) || (num_arg > 3))
+	{
+		return INVALID_PARAM;
+	}
+	// collect what is already waiting in the pipes
+	evRunOnce(0);
+	if (num_arg == 1)
+	{
+		captureList();
+		return NONE;
+	}
+
+	const char* id_str = (args[1][0] == '%') ? args[1] + 1 : args[1];
+	if (!is_string_number(id_str))
+		return INVALID_PARAM;
+	bool follow = false;
+	if (num_arg == 3)
+	{
+		if (strcmp(args[2], "-f"))
+			return INVALID_PARAM;
+		follow = true;
+	}
+
+	int job_id = atoi(id_str);
+	Capture* c = captureFind(job_id);
+	if (c == NULL)
+	{
+		PRINT_NO_CAPTURE(job_id);
+		return INVALID_JOB;
+	}
+	if (follow)
+	{
+		captureFollow(job_id);
+	}
+	else
+	{
+		cout.flush();
+		c->ring.writeTo(STDOUT_FILENO);
+	}
+	return NONE;
+}
+
+/**
+ * Cache func: It handles the cache command (memoize an external command).
+ * cache [--inputs f1,f2] [--env V1,V2] [--content] command [args]
+ * The key is argv, the working directory, the listed environment variables, and the inputs'
+ * (dev, ino, size, mtime), or their content with --content. A hit replays the stored stdout
+ * and exit status without running the command. "cache --stats" shows hit/miss counters.
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_PATH- if an input file can not be read
+ */
+static ERROR Cache(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if (num_arg == 2 && !strcmp(args[1], "--stats"))
+	{
+		cachePrintStats();
+		return NONE;
+	}
+
+	CacheRequest req;
+	int i;
+	for (i = 1; i < num_arg && !strncmp(args[i], "--", 2); i++)
+	{
+		if (!strcmp(args[i], "--content"))
+		{
+			req.content = true;
+			continue;
+		}
+		if (i + 1 == num_arg)
+			return INVALID_PARAM;
+		vector<string>* list;
+		if (!strcmp(args[i], "--inputs"))
+			list = &req.inputs;
+		else if (!strcmp(args[i], "--env"))
+			list = &req.env;
+		else
+			return INVALID_PARAM;
+		char* save;
+		for (char* item = strtok_r(args[++i], ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+			list->push_back(item);
+	}
+	if (i == num_arg)
+		return INVALID_PARAM;
+
+	char** cmd = args + i;
+	string key;
+	if (!cacheKey(cmd, req, sm.cwd, key))
+		return INVALID_PATH;
+	if (cacheReplay(key, &sm.last_status))
+		return NONE;
+
+	int out_pipe[2];
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		execute_command(cmd, FG_EXEC_MODE, false);
+		return NONE;
+	}
+	CacheCollector* collector = cacheCollectStart(out_pipe[0]);
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	pid_t pid = execute_command(cmd, FG_EXEC_MODE, false, out_pipe[1]);
+	gettimeofday(&end, NULL);
+	close(out_pipe[1]);
+	if (collector == NULL)
+	{
+		close(out_pipe[0]);
+		return NONE;
+	}
+
+	if (pid != -1 && sm.getJobBbPID(pid) != sm.jobs.end())
+	{
+		// stopped with CTRL+Z - the output is incomplete, so it is not cached
+		cacheCollectDetach(collector);
+		return NONE;
+	}
+	cacheCollectFinish(collector);
+	if (pid != -1)
+	{
+		double secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		cacheStore(key, sm.last_status, collector->data, secs);
+	}
+	delete collector;
+	return NONE;
+}
+
+/**
+ * 		Quit func:
+		It handles the quit and quit kill commands
+		If quit is called, the command exits smash (calling the smashManager destructor to erase the job vector memory).
+		If quit kill is called, the command sends SIGTERM to all processes running in the background, waits 5 seconds,
+		and if they don't respond it sends SIGKILL.
+ * @param args
+ * @param num_arg
+ * @return
+ * NONE- if success
+	INVALID_PARAM- if param is NULL or illegal according to the question
+	INVALID_PATH- if current path is invalid
+	INVALID_JOB- if job is invalid
+	KILL_FAILED- kill command did not succeed
+	MV_FAILED - mv command did not succeeed
+	WAITPID_FAILED- waitpid command did not succeed
+ */
+static ERROR Quit(char *args[MAX_NUM_OF_ARG], int num_arg)
+{
+	if ((num_arg != 1) && (num_arg != 2))
+	{
+		return INVALID_PARAM;
+	}
+
+
+	if (num_arg == 1)
+	{
+		exit(0);
+	}
+	// illegal command
+	if (strcmp(args[1], "kill"))
+	{
+		return INVALID_PARAM;
+	}
+	signal(SIGCHLD, SIG_DFL);
+
+	vector<Job>::iterator j;
+	for(j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+	{
+		cout << "Sending SIGTERM... ";
+		if (killpg(j->pgid, SIGTERM))
+		{
+			perror("kill failed");
+			return KILL_FAILED;
+		}
+
+		sleep(5);
+		int stat;
+		pid_t returned_pid = waitpid(j->pid, &stat, WNOHANG | WUNTRACED);
+		if (returned_pid == -1)
+		{
+			perror("waitpid");
+			return WAITPID_FAILED;
+		}
+		else if (returned_pid == 0)
+		{
+			cout << "(5 seconds passed) ";
+
+			cout << "Sending SIGKILL... ";
+			if (killpg(j->pgid, SIGKILL))
+			{
+				perror("kill failed");
+				return KILL_FAILED;
+			}
+
+		}
+		cout << "Done." << endl;
+		j = sm.removeJob(j);
+		j--;
+	}
+	exit(0);
+
+}
+/**
+ * is_string_number method:
+ * determines if a string is a number or not
+ * @param s
+ * @return
+ */
+static bool is_string_number(const std::string& s)
+{
+	string::const_iterator it = s.begin();
+	while (it != s.end() && std::isdigit(*it))
+	{
+		++it;
+	}
+	return !s.empty() && it == s.end();
+}
+/**
+ * job_matches function
+ * @param j
+ * @param spec a job selector: N or %N (job id), %all, %stopped, %running, or a glob on the job name
+ * @return true if spec selects j
+ */
+static bool job_matches(const Job& j, const char* spec)
+{
+	if (spec[0] == '%')
+		spec++;
+	if (is_string_number(spec))
+		return j.id == atoi(spec);
+	if (!strcmp(spec, "all"))
+		return true;
+	if (!strcmp(spec, "stopped"))
+		return j.is_delayed;
+	if (!strcmp(spec, "running"))
+		return !j.is_delayed;
+	return fnmatch(spec, j.name.c_str(), 0) == 0;
+}
+/**
+ * select_jobs function
+ * one pass over the job table, a job is selected once even if several specs match it
+ * @param specs job selectors (see job_matches)
+ * @param num_specs
+ * @param selected receives the positions in sm.jobs of the selected jobs, in table order
+ * @return the first job id spec (N or %N) that matches no job, NULL if there is none.
+ * Selectors that match nothing are not an error.
+ */
+static const char* select_jobs(char* specs[], int num_specs, vector<size_t>& selected)
+{
+	vector<bool> matched(num_specs, false);
+	selected.clear();
+	for (size_t i = 0; i < sm.jobs.size(); i++)
+	{
+		bool any = false;
+		for (int k = 0; k < num_specs; k++)
+		{
+			if (job_matches(sm.jobs[i], specs[k]))
+				any = matched[k] = true;
+		}
+		if (any)
+			selected.push_back(i);
+	}
+	for (int k = 0; k < num_specs; k++)
+	{
+		const char* id_str = (specs[k][0] == '%') ? specs[k] + 1 : specs[k];
+		if (!matched[k] && is_string_number(id_str))
+			return id_str;
+	}
+	return NULL;
+}
+/**
+ * wait_interval function
+ * runs the event loop for interval seconds, so jobs keep being reaped and captures drained
+ * @param interval
+ * @return false if CTRL+C cut it short
+ */
+static bool wait_interval(double interval)
+{
+	struct timeval until, now;
+	gettimeofday(&until, NULL);
+	long long deadline_us = until.tv_sec * 1000000LL + until.tv_usec + (long long)(interval * 1e6);
+	while (!smash_interrupted)
+	{
+		gettimeofday(&now, NULL);
+		long long left_us = deadline_us - (now.tv_sec * 1000000LL + now.tv_usec);
+		if (left_us <= 0)
+			return true;
+		evRunOnce((int)((left_us + 999) / 1000));
+	}
+	return false;
+}
+/**
+ * format_bytes function
+ * @param buf receives bytes with a K, M, G or T suffix above 1024
+ * @param size of buf
+ * @param bytes
+ */
+static void format_bytes(char* buf, size_t size, unsigned long long bytes)
+{
+	static const char units[] = "KMGT";
+	if (bytes < 1024)
+	{
+		snprintf(buf, size, "%llu", bytes);
+		return;
+	}
+	double v = bytes / 1024.0;
+	int u = 0;
+	for (; v >= 1024 && u < 3; u++)
+		v /= 1024;
+	snprintf(buf, size, "%.1f%c", v, units[u]);
+}
+/**
+ * jobs_top function
+ * the table of jobs --top: one pass over the job table samples each process group (see
+ * procSampleGroup), then the whole table is written at once. CPU% is over the time since the
+ * previous table, over the life of the job for the first one; 100 is one CPU.
+ * @param interval seconds between tables, 0 for a single one
+ */
+static void jobs_top(double interval)
+{
+	struct TopPrev
+	{
+		int id;
+		unsigned long long cpu_us;
+	};
+	static vector<TopPrev> prev, cur;	// by job id, as the job table
+	static string out;
+	bool tty = isatty(STDOUT_FILENO);
+	unsigned long long prev_ns = 0;
+	prev.clear();
+	smash_interrupted = 0;
+	do
+	{
+		unsigned long long start_ns = metricsNow();
+		struct timespec now;
+		clock_gettime(CLOCK_REALTIME, &now);
+		out.clear();
+		if (tty && interval > 0)
+			out += "\033[H\033[2J";
+		char line[512], rss[16], rd[16], wr[16];
+		snprintf(line, sizeof(line), "%-5s %-8s %-2s %6s %8s %8s %8s %4s %5s  %s\n", "[ID]", "PID", "S", "CPU%",
+				 "RSS", "READ", "WRITE", "THR", "PROCS", "COMMAND");
+		out += line;
+		cur.clear();
+		size_t p = 0;
+		for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+		{
+			char id[16];
+			snprintf(id, sizeof(id), "[%d]", j->id);
+			ProcUsage u;
+			if (!procSampleGroup(j->pid, j->pgid, &u))
+			{
+				snprintf(line, sizeof(line), "%-5s %-8d %-2s %6s %8s %8s %8s %4s %5s  %s\n", id, (int)j->pid, "-",
+						 "-", "-", "-", "-", "-", "-", j->name.c_str());
+				out += line;
+				continue;
+			}
+			double cpu;
+			while (p < prev.size() && prev[p].id < j->id)
+				p++;
+			if (p < prev.size() && prev[p].id == j->id && prev_ns != 0)
+			{
+				unsigned long long used = (u.cpu_us > prev[p].cpu_us) ? u.cpu_us - prev[p].cpu_us : 0;
+				cpu = used * 1000.0 / (start_ns - prev_ns) * 100;
+			}
+			else
+			{
+				double life_us = (now.tv_sec - j->start.tv_sec) * 1e6 + (now.tv_nsec - j->start.tv_nsec) / 1e3;
+				cpu = (life_us > 0) ? u.cpu_us / life_us * 100 : 0;
+			}
+			TopPrev tp = { j->id, u.cpu_us };
+			cur.push_back(tp);
+			format_bytes(rss, sizeof(rss), u.rss_kb * 1024ULL);
+			format_bytes(rd, sizeof(rd), u.read_bytes);
+			format_bytes(wr, sizeof(wr), u.write_bytes);
+			snprintf(line, sizeof(line), "%-5s %-8d %-2c %6.1f %8s %8s %8s %4ld %5d  %s\n", id, (int)j->pid,
+					 u.state, cpu, rss, rd, wr, u.threads, u.procs, j->name.c_str());
+			out += line;
+		}
+		procSampleSweep();
+		prev.swap(cur);
+		prev_ns = start_ns;
+		snprintf(line, sizeof(line), "%zu jobs sampled in %.2f ms%s\n", sm.jobs.size(),
+				 (metricsNow() - start_ns) / 1e6, (interval > 0) ? ", CTRL+C to stop" : "");
+		out += line;
+		cout.flush();
+		writeAll(STDOUT_FILENO, out.data(), out.size());
+	} while (interval > 0 && wait_interval(interval));
+}
+/* ####################################################################################
+*                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+/**
+ * runs a command line: parsed once, then run as a list (see parser.cc) in the foreground,
+ * or as one background job if it ends with "&"
+ * @param lineSize changed in place
+ * @param cmdString the line as typed, for history and error messages
+ * @param more reads the lines after it, for the bodies of here-documents. NULL if there are none.
+ * @return SUCCESS, or FAILURE if the line is blank, invalid, or its last command failed
+ */
+int RunCmd(char* lineSize, char* cmdString, LineReader more)
+{
+	// one list per nesting level, reused: reading a here-document runs the event loop,
+	// and an onchange command may run meanwhile
+	static vector<CmdList*> lists;
+	static size_t depth = 0;
+	if (lists.size() <= depth)
+		lists.push_back(new CmdList());
+	CmdList& list = *lists[depth];
+	depth++;
+	int result = run_line(list, lineSize, cmdString, more);
+	depth--;
+	return result;
+}
+/**
+ * runs a command line for $(...): its stdout - builtins included, they run in smash as
+ * usual - goes to a memfd meanwhile, and is read back from it. Like in a subshell, a cd
+ * does not outlive it; variables it sets do.
+ * @param line
+ * @param out receives the output, without its trailing newlines
+ * @return SUCCESS, or FAILURE if the line is invalid or its last command failed
+ */
+int CaptureCmd(const char* line, string& out)
+{
+	static vector<CmdList*> lists;		// one per nesting level, reused
+	static size_t depth = 0;
+	out.clear();
+	if (depth >= MAX_SUBST_DEPTH || strlen(line) >= MAX_LINE_SIZE)
+	{
+		PRINT_ERROR(line);
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	if (lists.size() <= depth)
+		lists.push_back(new CmdList());
+	CmdList& list = *lists[depth];
+	char lineSize[MAX_LINE_SIZE];
+	char cmdString[MAX_LINE_SIZE];
+	strcpy(lineSize, line);
+	strcpy(cmdString, line);
+	if (!parseLine(lineSize, list))
+	{
+		PRINT_ERROR(cmdString);
+		sm.last_status = 2;
+		return FAILURE;
+	}
+
+	cout.flush();
+	int mem_fd = memfd_create("smash-subst", MFD_CLOEXEC);
+	int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (mem_fd == -1 || saved_stdout == -1)
+	{
+		perror("memfd_create");
+		if (mem_fd != -1)
+			close(mem_fd);
+		if (saved_stdout != -1)
+			close(saved_stdout);
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	dup2(mem_fd, STDOUT_FILENO);
+	string cwd = sm.cwd;
+	string lwd = sm.lwd;
+	depth++;
+	int result = SUCCESS;
+	if (list.num_items > 0)
+		result = list.background ? BgCmd(list, cmdString) : run_list(list, cmdString);
+	depth--;
+	returning = false;	// a "return" in $(...) ends only it
+	cout.flush();
+	dup2(saved_stdout, STDOUT_FILENO);
+	close(saved_stdout);
+	if (sm.cwd != cwd && chdir(cwd.c_str()) == 0)
+	{
+		sm.cwd = cwd;
+		sm.lwd = lwd;
+	}
+
+	off_t size = lseek(mem_fd, 0, SEEK_END);
+	if (size > 0)
+	{
+		out.resize(size);
+		ssize_t n = pread(mem_fd, &out[0], size, 0);
+		out.resize((n > 0) ? n : 0);
+	}
+	close(mem_fd);
+	size_t keep = out.find_last_not_of('\n');
+	out.resize((keep == string::npos) ? 0 : keep + 1);
+	return result;
+}
+/**
+ * runs a script file in smash, statement by statement, until its end, a "return" or CTRL+C.
+ * It is compiled the first time, later runs of the same file reuse that (see script.cc).
+ * @param path
+ * @param args its arguments, args[0] for $0; NULL keeps those of the caller
+ * @param num_arg
+ * @return SUCCESS, or FAILURE if it could not be read, or its last statement failed
+ */
+int RunScript(const char* path, char* args[], int num_arg)
+{
+	static vector<CmdList*> lists;		// one per nesting level, reused
+	if (source_depth >= MAX_SOURCE_DEPTH)
+	{
+		cout << "smash error: > \"" << path << "\" - too many nested scripts" << endl;
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	ScriptRun run;
+	if (!scriptOpen(path, run))
+	{
+		perror(path);
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	if (lists.size() <= (size_t)source_depth)
+		lists.push_back(new CmdList());
+	CmdList& list = *lists[source_depth];
+
+	source_depth++;
+	if (args != NULL)
+		varPushArgs(args, num_arg);
+	int result = SUCCESS;
+	sm.last_status = 0;
+	STMT_KIND kind;
+	char* cmdString;
+	char* name;
+	ShellFunction* func;
+	while (!returning && sm.last_status != 128 + SIGINT)
+	{
+		unsigned long long start_ns = metricsStart();
+		unsigned long long trace_ns = traceBegin();
+		if (!scriptNext(run, list, &kind, &cmdString, &name, &func))
+			break;
+		if (kind == STMT_LIST)
+		{
+			result = run_parsed(list, cmdString, false, start_ns, trace_ns);
+		}
+		else if (kind == STMT_FUNCTION)
+		{
+			install_function(name, copyFunction(func));
+			sm.last_status = 0;
+			result = SUCCESS;
+		}
+		else
+		{
+			PRINT_ERROR(cmdString);
+			sm.last_status = 2;
+			result = FAILURE;
+		}
+	}
+	returning = false;
+	if (args != NULL)
+		varPopArgs();
+	source_depth--;
+	scriptClose(run);
+	return result;
+}
+/**
+ * interprets and executes one simple command in the foreground, built-in or external.
+ * A shell function is looked up first, then the built-in commands, then the PATH.
+ * Its exit status is kept in sm.last_status: 1 if a built-in command failed.
+ * @param args ends with NULL
+ * @param num_arg
+ * @param cmdString the line, for error messages
+ * @return SUCCESS, or FAILURE if a built-in command failed
+ */
+int ExeCmd(char* args[MAX_NUM_OF_ARG], int num_arg, char* cmdString)
+{
+	unsigned long long start_ns = metricsStart();
+	unsigned long long builtin_ns = traceBegin();
+	bool is_builtin = true;
+	ERROR result = NONE;
+	FastCmd fast;
+	ShellFunction* func;
+	char* cmd_str = args[0];
+	int prev_status = sm.last_status;
+	sm.last_status = 0;
+
+	/*************************************************/
+	/*				shell functions					 */
+	/*************************************************/
+	if ((func = find_function(cmd_str)) != NULL)	// before the built-in commands, which they may replace
+	{
+		call_function(func, args, num_arg, cmdString);
+		is_builtin = false;
+	}
+	/*************************************************/
+	/*						pwd						 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "pwd"))
+	{
+		result = Pwd(args, num_arg);
+	}
+
+	/*************************************************/
+	/*						cd						 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "cd") )
+	{
+		result = Cd(args, num_arg);
+	}
+	/*************************************************/
+	/*						history					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "history"))
+	{
+		result = History(args, num_arg);
+	}
+	/*************************************************/
+	/*						jobs					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "jobs"))
+	{
+		result = Jobs(args, num_arg);
+	}
+	/*************************************************/
+	/*						kill					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "kill"))
+	{
+		result = Kill(args, num_arg);
+	}
+
+	/*************************************************/
+	/*						showpid					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "showpid"))
+	{
+		result = ShowPid(num_arg);
 	}
 	/*************************************************/
 	/*						fg						 */
@@ -699,16 +1844,143 @@ int ExeCmd(char* lineSize, char* cmdString)
 		result = Mv(args, num_arg);
 	}
 	/*************************************************/
+	/*						output					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "output"))
+	{
+		result = Output(args, num_arg);
+	}
+	/*************************************************/
+	/*						cache					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "cache"))
+	{
+		result = Cache(args, num_arg);
+	}
+	/*************************************************/
+	/*						wait					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "wait"))
+	{
+		result = Wait(args, num_arg);
+	}
+	/*************************************************/
+	/*						watch					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "watch"))
+	{
+		result = Watch(args, num_arg, FG_EXEC_MODE);
+	}
+	/*************************************************/
+	/*						onchange				 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "onchange"))
+	{
+		result = OnChangeCmd(args, num_arg);
+	}
+	/*************************************************/
+	/*						export					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "export"))
+	{
+		result = Export(args, num_arg);
+	}
+	/*************************************************/
+	/*						unset					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "unset"))
+	{
+		result = Unset(args, num_arg);
+	}
+	/*************************************************/
+	/*						alias					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "alias"))
+	{
+		result = Alias(args, num_arg);
+	}
+	/*************************************************/
+	/*						unalias					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "unalias"))
+	{
+		result = Unalias(args, num_arg);
+	}
+	/*************************************************/
+	/*						return					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "return"))
+	{
+		result = Return(args, num_arg, prev_status);
+	}
+	/*************************************************/
+	/*						source					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "source") || !strcmp(cmd_str, "."))
+	{
+		result = Source(args, num_arg);
+	}
+	/*************************************************/
+	/*						stats					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "stats"))
+	{
+		if (num_arg != 1)
+			result = INVALID_PARAM;
+		else
+			metricsPrint();
+	}
+	/*************************************************/
+	/*						trace					 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "trace"))
+	{
+		if (num_arg == 1)
+			tracePrint();
+		else if (num_arg == 2 && !strcmp(args[1], "flush"))
+			traceFlush();
+		else
+			result = INVALID_PARAM;
+	}
+	/*************************************************/
+	/*						external				 */
+	/*************************************************/
+	else if (!strcmp(cmd_str, "external"))	// the binary, even if smash has it built in
+	{
+		if (num_arg == 1)
+			result = INVALID_PARAM;
+		else
+		{
+			ExeExternal(args + 1, cmdString);
+			is_builtin = false;
+		}
+	}
+	/*************************************************/
+	/*			echo, printf, test, true...			 */
+	/*************************************************/
+	else if ((fast = fastLookup(cmd_str)) != NULL)
+	{
+		sm.last_status = fast(args, num_arg);
+	}
+	/*************************************************/
 	else // external command
 	{
 		ExeExternal(args, cmdString);
 		result = NONE;
+		is_builtin = false;
+	}
+	if (is_builtin)
+	{
+		metricsCount(CNT_BUILTINS);
+		metricsRecord(HIST_BUILTIN, start_ns);
+		traceSpan("builtin", builtin_ns, cmd_str);
 	}
-	if (!is_history) // do not add history command to history vector
-		sm.addToHistory(cmdString);
 
 	if (!error_handler(result, cmdString))
+	{
+		sm.last_status = 1;
 		return FAILURE;
+	}
 
 	return SUCCESS;
 }
@@ -717,57 +1989,406 @@ int ExeCmd(char* lineSize, char* cmdString)
  * @param args
  * @param cmdString
  */
-void ExeExternal(char *args[MAX_NUM_OF_ARG], string cmdString)
+void ExeExternal(char *args[MAX_NUM_OF_ARG], const char* cmdString)
 {
-	execute_command(args, FG_EXEC_MODE, false);
+	if (execute_command(args, FG_EXEC_MODE, false) == -1)
+		sm.last_status = 1;
 }
 
 /**
- * if command is in background, insert the command to jobs
- * @param lineSize
+ * runs a list that ends with "&" as one background job.
+ * A single command is the job itself, a longer list or a function is run by a fork of smash (see run_subshell).
+ * @param list
  * @param cmdString
- * @return
+ * @return SUCCESS, or FAILURE if the job could not be started
  */
-int BgCmd(char* lineSize, char* cmdString)
+static int BgCmd(CmdList& list, char* cmdString)
 {
-	string cmd = lineSize;
-
-	if (BgCommand(cmd))
+	if (list.num_items > 1 || find_function(list.items[0].args[0]) != NULL)
 	{
-		lineSize[cmd.length()-1] = '\0';
-		string dels = " \t\n";
-		const char* delimiters = dels.c_str();
-		char *args[MAX_NUM_OF_ARG];
-		int num_arg;
-		extractArgs(delimiters, lineSize, args, &num_arg);
-		execute_command(args, BG_EXEC_MODE, false);
-		sm.addToHistory(cmdString);
+		if (execute_command(list.items[0].args, BG_EXEC_MODE, false, -1, &list, cmdString) == -1)
+			return FAILURE;
+		sm.last_status = 0;
 		return SUCCESS;
+	}
 
+	CmdItem& item = list.items[0];
+	int num_assign = prepare_item(list, item);
+	char** args = item.argv + num_assign;
+	int saved_stdin;
+	if (!here_open(item, &saved_stdin))
+	{
+		sm.last_status = 1;
+		return FAILURE;
 	}
-	return FAILURE;
+	size_t mark = varTempMark();
+	for (int i = 0; i < num_assign; i++)
+		varAssign(item.argv[i], true);
+	ERROR result = NONE;
+	pid_t pID = 0;
+	if (args[0] == NULL)
+		;	// "NAME=value &" would set it in the job only
+	else if (!strcmp(args[0], "watch"))
+		result = Watch(args, item.argc - num_assign, BG_EXEC_MODE);
+	else
+		pID = execute_command(args, BG_EXEC_MODE, false);
+	varTempRestore(mark);
+	here_close(saved_stdin);
+	if (pID == -1)
+		return FAILURE;
+	sm.last_status = 0;
+	return error_handler(result, cmdString) ? SUCCESS : FAILURE;
 }
-
 /**
- * Extracts the arguments and number of arguments from the command string given delimiters to separate
- * @param delimiters
- * @param lineSize
- * @param args
- * @param num_args
+ * expands the variables, globs and alias of a command that is about to run
+ * @param list
+ * @param item
+ * @return how many of its first words are NAME=value assignments
  */
-static void extractArgs(const char* delimiters, char* lineSize, char *args[MAX_NUM_OF_ARG], int *num_args)
+static int prepare_item(CmdList& list, CmdItem& item)
 {
-	char *cmd = strtok(lineSize, delimiters);
-	args[0] = cmd;
-	int i;
-	for (i = 1; i < MAX_NUM_OF_ARG; ++i)
+	if (item.expand)
+		expandItem(list, item);
+	int num_assign = varAssignments(item.argv, item.argc);
+	if (!sm.aliases.empty() && num_assign < item.argc)
+		expand_alias(list, item, num_assign);
+	return num_assign;
+}
+/**
+ * runs one command of a foreground list. NAME=value words before it are set for it only,
+ * alone they set shell variables.
+ * @param list
+ * @param item
+ * @param cmdString
+ * @return the result of ExeCmd
+ */
+static int run_item(CmdList& list, CmdItem& item, char* cmdString)
+{
+	int num_assign = prepare_item(list, item);
+	if (num_assign == item.argc)
 	{
-		args[i] = strtok(NULL, delimiters);
-
-		if (args[i] == NULL)
+		for (int i = 0; i < num_assign; i++)
+			varAssign(item.argv[i]);
+		sm.last_status = 0;
+		return SUCCESS;
+	}
+	int saved_stdin;
+	if (!here_open(item, &saved_stdin))
+	{
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	size_t mark = varTempMark();
+	for (int i = 0; i < num_assign; i++)
+		varAssign(item.argv[i], true);
+	int result = ExeCmd(item.argv + num_assign, item.argc - num_assign, cmdString);
+	varTempRestore(mark);
+	here_close(saved_stdin);
+	return result;
+}
+/**
+ * runs the commands of a list in the foreground, each one depending on the status of the previous one
+ * @param list
+ * @param cmdString
+ * @return the result of the last command that ran
+ */
+static int run_list(CmdList& list, char* cmdString)
+{
+	int result = SUCCESS;
+	for (size_t i = 0; i < list.num_items; i++)
+	{
+		CmdItem& item = list.items[i];
+		if ((item.op == OP_AND && sm.last_status != 0) || (item.op == OP_OR && sm.last_status == 0))
+			continue;
+		result = run_item(list, item, cmdString);
+		// CTRL+C ends the whole list, "return" the function's
+		if (sm.last_status == 128 + SIGINT || returning)
 			break;
 	}
-	*num_args = i;
+	return result;
 }
+/**
+ * runs a background list, in a fork of smash that is its job
+ * @param list
+ * @param cmdString
+ * @return the exit status of the list
+ */
+static int run_subshell(CmdList& list, char* cmdString)
+{
+	// the jobs, event loop, zygote and control socket of smash are not ours
+	sm.jobs.clear();
+	sm.done_jobs.clear();
+	pid_running_in_fg = -1;
+	in_subshell = true;
+	zygoteDetach();
+	syscall(SYS_close_range, 3, ~0U, 0);
+	if (evInit() == -1 || setSubshellSignals() == -1)
+		return 1;
+	run_list(list, cmdString);
+	cout.flush();
+	return sm.last_status;
+}
+/**
+ * parses and runs a command line for RunCmd
+ * @param list receives the parsed line
+ * @param lineSize
+ * @param cmdString
+ * @param more
+ * @return the result of RunCmd
+ */
+static int run_line(CmdList& list, char* lineSize, char* cmdString, LineReader more)
+{
+	unsigned long long start_ns = metricsStart();
+	unsigned long long trace_ns = traceBegin();
+	char* name;
+	char* body;
+	bool open;
+	if (parseFunction(lineSize, &name, &body, &open))
+	{
+		bool defined = define_function(name, body, open, more);
+		if (!defined)
+			PRINT_ERROR(cmdString);
+		sm.addToHistory(cmdString);
+		sm.last_status = defined ? 0 : 2;
+		return defined ? SUCCESS : FAILURE;
+	}
+	if (!parseLine(lineSize, list) || !read_here_docs(list, more))
+	{
+		PRINT_ERROR(cmdString);
+		sm.addToHistory(cmdString);
+		sm.last_status = 2;
+		return FAILURE;
+	}
+	if (list.num_items == 0)
+		return FAILURE;
+	traceSpan("parse", trace_ns);
+	return run_parsed(list, cmdString, true, start_ns, trace_ns);
+}
+/**
+ * runs a parsed command line, typed or from a script
+ * @param list
+ * @param cmdString
+ * @param history if true, the line is added to the history
+ * @param start_ns from metricsStart, when the line came in
+ * @param trace_ns from traceBegin
+ * @return the result of RunCmd
+ */
+static int run_parsed(CmdList& list, char* cmdString, bool history, unsigned long long start_ns,
+					  unsigned long long trace_ns)
+{
+	// history command lines are not listed
+	bool is_history = (list.num_items == 1 && !strcmp(list.items[0].args[0], "history"));
+	int result = list.background ? BgCmd(list, cmdString) : run_list(list, cmdString);
+	if (history && !is_history)
+		sm.addToHistory(cmdString);
+	metricsCount(CNT_COMMANDS);
+	metricsRecord(HIST_COMMAND, start_ns);
+	traceSpan("command", trace_ns, cmdString);
+	return result;
+}
+/**
+ * reads the body of each here-document of a list: the lines up to its delimiter
+ * @param list
+ * @param more
+ * @return false if there is no line reader or the input ended before a delimiter
+ */
+static bool read_here_docs(CmdList& list, LineReader more)
+{
+	char* line = input_line;
+	for (size_t i = 0; i < list.num_items; i++)
+	{
+		CmdItem& item = list.items[i];
+		if (item.here_kind != HERE_DOC)
+			continue;
+		item.here.clear();
+		while (1)
+		{
+			if (more == NULL || !more(line, sizeof(input_line)))
+				return false;
+			if (!strcmp(line, item.here_word))
+				break;
+			item.here += line;
+			item.here += '\n';
+		}
+	}
+	return true;
+}
+/**
+ * makes the here-document or here-string of a command its stdin - and the stdin of the
+ * child it spawns. The expanded text is written once into a sealed memfd, which the child
+ * reads like a file: no pipe to keep fed, and nothing left on disk.
+ * @param item
+ * @param saved_stdin receives smash's stdin for here_close, -1 if the command has none
+ * @return false if the memfd could not be set up
+ */
+static bool here_open(CmdItem& item, int* saved_stdin)
+{
+	*saved_stdin = -1;
+	if (item.here_kind == HERE_NONE)
+		return true;
+	string text;	// not static: a $(...) in it may run a here-string of its own
+	if (item.here_kind == HERE_STRING)
+	{
+		expandText(item.here_word, text);
+		text += '\n';
+	}
+	else
+	{
+		expandText(item.here.c_str(), text);
+	}
 
-
+	int fd = memfd_create("smash-here", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1)
+	{
+		perror("memfd_create");
+		return false;
+	}
+	writeAll(fd, text.data(), text.size());
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+	lseek(fd, 0, SEEK_SET);
+	*saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+	if (*saved_stdin == -1)
+	{
+		perror("fcntl");
+		close(fd);
+		return false;
+	}
+	dup2(fd, STDIN_FILENO);
+	close(fd);
+	return true;
+}
+/**
+ * gives smash its stdin back after here_open
+ * @param saved_stdin
+ */
+static void here_close(int saved_stdin)
+{
+	if (saved_stdin == -1)
+		return;
+	dup2(saved_stdin, STDIN_FILENO);
+	close(saved_stdin);
+}
+/**
+ * defines a function (see parseFunction): its body is parsed here, once for all its calls
+ * @param name
+ * @param body
+ * @param open if true, the body goes on over the next lines, up to a "}"
+ * @param more reads them
+ * @return false if the body is not closed or not a valid list (see parseFunctionBody)
+ */
+static bool define_function(const char* name, const char* body, bool open, LineReader more)
+{
+	string text = body;
+	while (open)
+	{
+		if (more == NULL || !more(input_line, sizeof(input_line)))
+			return false;
+		open = !parseBodyEnd(input_line);
+		parseBodyLine(text, input_line);
+	}
+	ShellFunction* f = parseFunctionBody(text);
+	if (f == NULL)
+		return false;
+	install_function(name, f);
+	return true;
+}
+/**
+ * makes f the function called name, in place of the one it had
+ * @param name
+ * @param f
+ */
+static void install_function(const char* name, ShellFunction* f)
+{
+	ShellFunction*& slot = sm.functions[name];
+	if (slot != NULL)
+		free_function(slot);
+	slot = f;
+}
+/**
+ * @param name
+ * @return the function called name, NULL if there is none
+ */
+static ShellFunction* find_function(const char* name)
+{
+	if (sm.functions.empty())
+		return NULL;
+	static string key;	// reused, so that a lookup does not allocate
+	key.assign(name);
+	map<string, ShellFunction*>::iterator f = sm.functions.find(key);
+	return (f != sm.functions.end()) ? f->second : NULL;
+}
+/**
+ * frees a function that was removed or redefined, once no call of it is running
+ * @param f
+ */
+static void free_function(ShellFunction* f)
+{
+	if (f->running > 0)
+		retired.push_back(f);
+	else
+		delete f;
+}
+/**
+ * runs a function in smash: its parsed body, with args as $0, $1...
+ * Each call level runs a copy of the body's items, so a function may call itself.
+ * @param f
+ * @param args
+ * @param num_arg
+ * @param cmdString
+ * @return the result of its last command
+ */
+static int call_function(ShellFunction* f, char* args[], int num_arg, char* cmdString)
+{
+	static vector<CmdList*> frames;		// one per call level, reused
+	if (func_depth >= MAX_FUNC_DEPTH)
+	{
+		PRINT_ERROR(cmdString);
+		sm.last_status = 1;
+		return FAILURE;
+	}
+	if (frames.size() <= (size_t)func_depth)
+		frames.push_back(new CmdList());
+	CmdList& frame = *frames[func_depth];
+	frame.items.assign(f->body.items.begin(), f->body.items.begin() + f->body.num_items);
+	frame.num_items = f->body.num_items;
+	frame.background = false;
+	for (size_t i = 0; i < frame.num_items; i++)
+		frame.items[i].argv = frame.items[i].args;
+
+	f->running++;
+	func_depth++;
+	varPushArgs(args, num_arg);
+	int result = run_list(frame, cmdString);
+	varPopArgs();
+	func_depth--;
+	f->running--;
+	returning = false;
+	if (func_depth == 0)
+	{
+		for (size_t i = 0; i < retired.size(); i++)
+			delete retired[i];
+		retired.clear();
+	}
+	return result;
+}
+/**
+ * replaces the command name of an item by its alias, if it has one.
+ * The alias is not looked up again in its own words.
+ * @param list
+ * @param item
+ * @param pos the command name, after the NAME=value words
+ */
+static void expand_alias(CmdList& list, CmdItem& item, int pos)
+{
+	static string key;	// reused, so that a lookup does not allocate
+	key.assign(item.argv[pos]);
+	map<string, ShellAlias*>::iterator a = sm.aliases.find(key);
+	if (a == sm.aliases.end())
+		return;
+	if (list.argv.empty() || item.argv != &list.argv[0])
+		list.argv.assign(item.argv, item.argv + item.argc + 1);
+	vector<char*>::iterator at = list.argv.erase(list.argv.begin() + pos);
+	list.argv.insert(at, a->second->argv.begin(), a->second->argv.end());
+	item.argv = &list.argv[0];
+	item.argc = list.argv.size() - 1;
+}
@@ -10,12 +10,16 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <algorithm>
 #include <iostream>
+#include <map>
 #include <string>
 #include <vector>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
+#include "onchange.h"
 
 
 using namespace std;
@@ -28,12 +32,31 @@ using namespace std;
 
 
 #define MAX_SIZE 80
+#define MAX_LINE_SIZE 1024		// a command line, lists included
 #define MAX_NUM_OF_ARG 20
+#define MAX_SUBST_DEPTH 16		// $(...) nested in $(...)
+#define MAX_FUNC_DEPTH 256		// shell functions calling each other
+#define MAX_SOURCE_DEPTH 64		// scripts sourcing each other
 #define HISTORY_SIZE 50
+#define DONE_JOBS_SIZE 50		// finished jobs kept for jobs --json
+#define JOBS_TOP_DEFAULT_SECS 2.0	// refresh period of jobs --top
+#define JOBS_RESERVE 256		// job table slots allocated up front
+#define JOB_STATUS_UNKNOWN -2	// Job::status of an adopted job that is gone
 
 
 
 
+/* ####################################################################################
+*                                  TYPES
+#####################################################################################*/
+
+// reads the next input line into line, without its newline; false at the end of the input
+typedef bool (*LineReader)(char* line, int size);
+
+class ShellFunction;	// see parser.h
+class ShellAlias;
+
+
 /* ####################################################################################
 *                                 GLOBALS
 #####################################################################################*/
@@ -48,9 +71,11 @@ extern int Job_Num;
 
 
 
-int BgCmd(char* lineSize, char* cmdString);
-int ExeCmd(char* lineSize, char* cmdString);
-void ExeExternal(char *args[MAX_NUM_OF_ARG], string cmdString);
+int RunCmd(char* lineSize, char* cmdString, LineReader more = NULL);
+int CaptureCmd(const char* line, string& out);
+int RunScript(const char* path, char* args[], int num_arg);
+int ExeCmd(char* args[MAX_NUM_OF_ARG], int num_arg, char* cmdString);
+void ExeExternal(char *args[MAX_NUM_OF_ARG], const char* cmdString);
 
 
 
@@ -65,21 +90,38 @@ class Job
 	public:
         string name;
         pid_t pid;
+        pid_t pgid;
 		int id;
 		struct timeval time;
 		struct timeval suspension_time;
 		bool is_delayed;
+		bool is_waited;				// reaped by the wait builtin, not by the SIGCHLD handler
+		struct timespec start;		// CLOCK_REALTIME, for ns precision
+		struct timespec end;		// set once the job is done
+		int status;					// exit status once the job is done, -1 before
+		struct rusage usage;		// set once the job is done
+		unsigned long long starttime;	// /proc starttime, 0 until the state file needs it
+		int pidfd;					// adopted from a previous smash (see jobstate.cc), -1 for children
 
 
 		//constructor
-		Job(int my_pid, string command, bool suspended)
+		Job(int my_pid, const char* command, bool suspended)
         {
             id = Job_Num;
             Job_Num ++;
             pid = my_pid;
-            name = command;
+            pgid = my_pid;	// children call setpgrp()
+            name.assign(command);
             gettimeofday(&time, NULL);
+            clock_gettime(CLOCK_REALTIME, &start);
             is_delayed = suspended;
+            is_waited = false;
+            status = -1;
+            memset(&usage, 0, sizeof(usage));
+            starttime = 0;
+            pidfd = -1;
+            end.tv_sec = 0;
+            end.tv_nsec = 0;
         }
 
 		// defaults dtor is enough
@@ -109,17 +151,31 @@ public:
 	int id;
     vector<string> history;
 	vector<Job> jobs;
+	vector<Job> done_jobs;	// the last DONE_JOBS_SIZE finished jobs, oldest first
+	vector<string> spare_names;	// buffers of the names of removed jobs, for new ones
 	string lwd;
 	string cwd;
+	int last_status;	// exit status of the last foreground command
+	map<string, ShellFunction*> functions;	// parsed once, when defined
+	map<string, ShellAlias*> aliases;
 
 	//constructor
     smashManager()
     {
 		id = getpid();
+		last_status = 0;
 		jobs.clear();
+		done_jobs.clear();
 		history.clear();
+		// the steady state of the command path does not allocate (see bench/bench_alloc.cc)
+		jobs.reserve(JOBS_RESERVE);
+		done_jobs.reserve(DONE_JOBS_SIZE);
+		spare_names.reserve(JOBS_RESERVE);
+		history.reserve(HISTORY_SIZE);
 		char workDir[MAX_SIZE];
 		getcwd(workDir,MAX_SIZE);
+		cwd.reserve(MAX_SIZE);
+		lwd.reserve(MAX_SIZE);
 		cwd = workDir;
 		lwd = cwd;
 	}
@@ -128,16 +184,73 @@ public:
 
 	//******************* METHODS************************/
 
-	void addToHistory(string cmd)
+	void addToHistory(const char* cmd)
     {
+		// once full, the oldest line's buffer takes the new one; each holds a whole line
 		if(history.size() == HISTORY_SIZE)
-			history.erase(history.begin());
-		history.push_back(cmd);
+		{
+			rotate(history.begin(), history.begin() + 1, history.end());
+		}
+		else
+		{
+			history.push_back(string());
+			history.back().reserve(MAX_LINE_SIZE);
+		}
+		history.back().assign(cmd);
+	}
+	/*****************************************************/
+	void addToDone(Job& job)
+	{
+		if(done_jobs.size() < DONE_JOBS_SIZE)
+		{
+			done_jobs.push_back(job);
+			return;
+		}
+		// the oldest is overwritten in place. The caller removes job right after, so its name
+		// buffer moves along and job takes the oldest's, for removeJob to keep.
+		rotate(done_jobs.begin(), done_jobs.begin() + 1, done_jobs.end());
+		Job& slot = done_jobs.back();
+		string name, spare;
+		name.swap(job.name);
+		spare.swap(slot.name);
+		slot = job;
+		slot.name.swap(name);
+		job.name.swap(spare);
+	}
+	/*****************************************************/
+	Job& addJob(pid_t pid, const char* name, bool suspended)
+	{
+		// constructed in place, named in the buffer of a removed job
+		jobs.emplace_back(pid, "", suspended);
+		Job& job = jobs.back();
+		if (!spare_names.empty())
+		{
+			job.name.swap(spare_names.back());
+			spare_names.pop_back();
+		}
+		// a name is at most a line, so the buffer never has to grow again
+		if (job.name.capacity() < MAX_LINE_SIZE)
+			job.name.reserve(MAX_LINE_SIZE);
+		job.name.assign(name);
+		return job;
+	}
+	/*****************************************************/
+	vector<Job>::iterator removeJob(vector<Job>::iterator j)
+	{
+		if (spare_names.size() < JOBS_RESERVE)
+		{
+			spare_names.push_back(string());
+			spare_names.back().swap(j->name);
+		}
+		pid_t pid = j->pid;
+		vector<Job>::iterator next = jobs.erase(j);
+		onchangeJobDone(pid);	// an onchange run may wait for this job to leave the table
+		return next;
 	}
 	/*****************************************************/
-    void setCWD(string path)
+    void setCWD(const char* path)
     {
-        cwd = path;
+        cwd.assign(path);
     }
     /*****************************************************/
     void setLWD()
@@ -187,7 +300,7 @@ public:
 	vector<Job>::iterator get_latest_delayed_job()
 	{
 		vector<Job>::iterator job = jobs.begin();
-        time_t max_delay;
+        time_t max_delay = 0;
 
 		for (vector<Job>::iterator j = jobs.begin(); j != jobs.end(); ++j)
 		{
@@ -196,7 +309,7 @@ public:
 
 			if ((j->suspension_time.tv_sec) > max_delay)
 			{
-				max_delay = j->time.tv_sec;
+				max_delay = j->suspension_time.tv_sec;
 				job = j;
 			}
 		}
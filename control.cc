@@ -0,0 +1,462 @@
+/* ####################################################################################
+ *                                  CONTROL.CC
+ *  smash --listen PATH: a unix stream socket through which local clients submit
+ *  commands and query jobs. Any number of clients may be connected. Requests are read
+ *  by the event loop and served one at a time when smash is idle at the prompt, through
+ *  the same RunCmd path as typed commands.
+ *
+ *  requests:   run <command line>      runs it, the body is its stdout
+ *              bg <command line>       starts it as a background job, the body is the job id
+ *              jobs                    the jobs listing
+ *              kill <signum> <job id>  sends a signal to a job
+ *              output <job id>         the captured output of a job (smash --capture)
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "commands.h"
+#include "capture.h"
+#include "control.h"
+#include "eventloop.h"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern smashManager sm;
+
+static int listen_fd = -1;
+static string listen_path;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void accept_handler(int fd, unsigned int events, void* ctx);
+static void client_handler(int fd, unsigned int events, void* ctx);
+static void client_serve(void* ctx);
+static void client_update(ControlClient* c);
+static void client_close(ControlClient* c);
+static void client_flush(ControlClient* c);
+static bool frame_ready(const string& in);
+static void handle_request(const string& req, int* status, string& body);
+static void run_line(const string& line, bool capture_stdout, int* status, string& body);
+static void control_cleanup();
+
+
+/**
+ * control_cleanup function
+ * removes the socket file when smash exits
+ */
+static void control_cleanup()
+{
+	if (listen_fd != -1)
+		unlink(listen_path.c_str());
+}
+/****************************************************************************************/
+/**
+ * frame_ready function
+ * @param in
+ * @return true if in starts with a complete frame
+ */
+static bool frame_ready(const string& in)
+{
+	if (in.size() < 4)
+		return false;
+	uint32_t len;
+	memcpy(&len, in.data(), 4);
+	return in.size() >= 4 + (size_t)ntohl(len);
+}
+/****************************************************************************************/
+/**
+ * run_line function
+ * runs a command line like main() does
+ * @param line
+ * @param capture_stdout if true, smash's stdout is a memfd meanwhile and its content is the body
+ * @param status the exit status of the command, 1 if smash rejected it
+ * @param body
+ */
+static void run_line(const string& line, bool capture_stdout, int* status, string& body)
+{
+	char lineSize[MAX_LINE_SIZE];
+	char cmdString[MAX_LINE_SIZE];
+	if (line.length() >= MAX_LINE_SIZE)
+	{
+		*status = 1;
+		body = "command too long\n";
+		return;
+	}
+	strcpy(lineSize, line.c_str());
+	strcpy(cmdString, lineSize);
+
+	int mem_fd = -1;
+	int saved_stdout = -1;
+	if (capture_stdout)
+	{
+		cout.flush();
+		mem_fd = memfd_create("smash-control", MFD_CLOEXEC);
+		saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+		if (mem_fd != -1 && saved_stdout != -1)
+			dup2(mem_fd, STDOUT_FILENO);
+	}
+
+	sm.last_status = 0;
+	RunCmd(lineSize, cmdString);
+	*status = sm.last_status;
+
+	if (mem_fd != -1 && saved_stdout != -1)
+	{
+		cout.flush();
+		dup2(saved_stdout, STDOUT_FILENO);
+		off_t size = lseek(mem_fd, 0, SEEK_END);
+		if (size > 0)
+		{
+			body.resize(size);
+			ssize_t n = pread(mem_fd, &body[0], size, 0);
+			body.resize(n > 0 ? n : 0);
+		}
+	}
+	if (mem_fd != -1)
+		close(mem_fd);
+	if (saved_stdout != -1)
+		close(saved_stdout);
+}
+/****************************************************************************************/
+/**
+ * handle_request function
+ * @param req the payload of a request frame
+ * @param status
+ * @param body
+ */
+static void handle_request(const string& req, int* status, string& body)
+{
+	size_t sp = req.find(' ');
+	string verb = req.substr(0, sp);
+	string rest = (sp == string::npos) ? "" : req.substr(sp + 1);
+
+	if (verb == "run" && !rest.empty())
+	{
+		run_line(rest, true, status, body);
+	}
+	else if (verb == "bg" && !rest.empty())
+	{
+		// not captured: the job keeps smash's stdout (or its capture pipe)
+		size_t before = sm.jobs.size();
+		run_line(rest + "&", false, status, body);
+		if (sm.jobs.size() > before)
+		{
+			char id[16];
+			snprintf(id, sizeof(id), "%d\n", sm.jobs.back().id);
+			body = id;
+		}
+	}
+	else if (verb == "jobs" && rest.empty())
+	{
+		run_line("jobs", true, status, body);
+	}
+	else if (verb == "kill")
+	{
+		int signum, job_id;
+		if (sscanf(rest.c_str(), "%d %d", &signum, &job_id) != 2)
+		{
+			*status = 2;
+			body = "usage: kill <signum> <job id>\n";
+			return;
+		}
+		char line[MAX_SIZE];
+		snprintf(line, sizeof(line), "kill -%d %d", signum, job_id);
+		run_line(line, true, status, body);
+	}
+	else if (verb == "output")
+	{
+		Capture* c = captureFind(atoi(rest.c_str()));
+		if (c == NULL)
+		{
+			*status = 1;
+			body = "no captured output\n";
+			return;
+		}
+		evRunOnce(0);
+		*status = 0;
+		c->ring.copyTo(body);
+	}
+	else
+	{
+		*status = 2;
+		body = "unknown request\n";
+	}
+}
+/****************************************************************************************/
+/**
+ * client_flush function
+ * sends as much of the pending responses as the socket takes
+ * @param c
+ */
+static void client_flush(ControlClient* c)
+{
+	while (!c->out.empty())
+	{
+		ssize_t n = send(c->fd, c->out.data(), c->out.size(), MSG_NOSIGNAL);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+			{
+				c->out.clear();
+				c->eof = true;
+			}
+			return;
+		}
+		c->out.erase(0, n);
+	}
+}
+/****************************************************************************************/
+/**
+ * client_update function
+ * watches for input unless the client waits to be served, and for output while responses are pending.
+ * A client that hung up is closed once it has nothing left to serve or send.
+ * @param c
+ */
+static void client_update(ControlClient* c)
+{
+	if (c->hup || (c->eof && !c->busy && c->out.empty()))
+	{
+		client_close(c);
+		return;
+	}
+	unsigned int events = 0;
+	if (!c->busy && !c->eof)
+		events |= EPOLLIN;
+	if (!c->out.empty())
+		events |= EPOLLOUT;
+	evMod(c->fd, events);
+}
+/****************************************************************************************/
+/**
+ * client_close function
+ * @param c
+ */
+static void client_close(ControlClient* c)
+{
+	evDel(c->fd);
+	close(c->fd);
+	delete c;
+}
+/****************************************************************************************/
+/**
+ * client_serve function
+ * deferred until smash is idle: serves every complete request of the client
+ * @param ctx the ControlClient
+ */
+static void client_serve(void* ctx)
+{
+	ControlClient* c = (ControlClient*)ctx;
+	while (frame_ready(c->in))
+	{
+		uint32_t len;
+		memcpy(&len, c->in.data(), 4);
+		len = ntohl(len);
+		string req = c->in.substr(4, len);
+		c->in.erase(0, 4 + len);
+
+		int status = 0;
+		string body;
+		handle_request(req, &status, body);
+
+		char head[16];
+		int head_len = snprintf(head, sizeof(head), "%d\n", status);
+		uint32_t out_len = htonl(head_len + body.size());
+		c->out.append((const char*)&out_len, 4);
+		c->out.append(head, head_len);
+		c->out.append(body);
+	}
+	c->busy = false;
+	if (!c->hup)
+		client_flush(c);
+	client_update(c);
+}
+/****************************************************************************************/
+/**
+ * client_handler function
+ * @param fd
+ * @param events
+ * @param ctx the ControlClient
+ */
+static void client_handler(int fd, unsigned int events, void* ctx)
+{
+	ControlClient* c = (ControlClient*)ctx;
+	if (c->busy)
+	{
+		// hangups can not be masked - stop watching until the queued requests are served
+		if (events & (EPOLLHUP | EPOLLERR))
+		{
+			evDel(fd);
+			c->hup = true;
+		}
+		return;
+	}
+	if (events & EPOLLOUT)
+		client_flush(c);
+
+	if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+	{
+		char buf[CONTROL_READ_SIZE];
+		while (1)
+		{
+			ssize_t n = read(fd, buf, sizeof(buf));
+			if (n > 0)
+			{
+				c->in.append(buf, n);
+				continue;
+			}
+			if (n == 0 || (errno != EINTR && errno != EAGAIN))
+				c->eof = true;
+			if (n == -1 && errno == EINTR)
+				continue;
+			break;
+		}
+		if (c->in.size() >= 4)
+		{
+			uint32_t len;
+			memcpy(&len, c->in.data(), 4);
+			if (ntohl(len) > CONTROL_MAX_FRAME)
+			{
+				client_close(c);
+				return;
+			}
+		}
+		if (frame_ready(c->in))
+		{
+			c->busy = true;
+			evDefer(client_serve, c);
+		}
+	}
+	client_update(c);
+}
+/****************************************************************************************/
+/**
+ * accept_handler function
+ * @param fd
+ * @param events
+ * @param ctx
+ */
+static void accept_handler(int fd, unsigned int events, void* ctx)
+{
+	while (1)
+	{
+		int client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (client_fd == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				perror("accept");
+			return;
+		}
+		ControlClient* c = new ControlClient(client_fd);
+		if (!evAdd(client_fd, EPOLLIN, client_handler, c))
+		{
+			close(client_fd);
+			delete c;
+		}
+	}
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * controlListen function
+ * the socket is created under umask 077, so only the user running smash can connect:
+ * a client runs commands as that user.
+ * @param path of the socket. A stale socket left there (connect refused) is replaced;
+ * a socket that is listened on, or any other file, is kept and smash does not listen.
+ * @return 0 on success, -1 on failure
+ */
+int controlListen(const char* path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		cout << "smash error: > \"" << path << "\" - socket path too long" << endl;
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+	{
+		perror("socket");
+		return -1;
+	}
+	struct stat st;
+	if (lstat(path, &st) == 0)
+	{
+		if (!S_ISSOCK(st.st_mode))
+		{
+			cout << "smash error: > \"" << path << "\" - exists and is not a socket" << endl;
+			close(fd);
+			return -1;
+		}
+		// a socket nobody listens on refuses the connection, it is left over from a crash
+		int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		int connected = (probe != -1) ? connect(probe, (struct sockaddr*)&addr, sizeof(addr)) : -1;
+		int probe_errno = errno;
+		if (probe != -1)
+			close(probe);
+		if (connected == 0 || probe_errno != ECONNREFUSED)
+		{
+			cout << "smash error: > \"" << path << "\" - socket in use" << endl;
+			close(fd);
+			return -1;
+		}
+		unlink(path);
+	}
+	mode_t old_mask = umask(077);
+	int bound = bind(fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(old_mask);
+	if (bound == -1 || listen(fd, CONTROL_BACKLOG) == -1)
+	{
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+	if (!evAdd(fd, EPOLLIN, accept_handler, NULL))
+	{
+		close(fd);
+		return -1;
+	}
+	listen_fd = fd;
+	listen_path = path;
+	atexit(control_cleanup);
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * controlActive function
+ * @return true if smash listens on a control socket
+ */
+bool controlActive()
+{
+	return listen_fd != -1;
+}
@@ -0,0 +1,58 @@
+#ifndef _CONTROL_H
+#define _CONTROL_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stdint.h>
+#include <string>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define CONTROL_MAX_FRAME 65536
+#define CONTROL_BACKLOG 128
+#define CONTROL_READ_SIZE 65536
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * one connected client of the control socket.
+ * Frames are a 4 byte big endian length followed by the payload, in both directions.
+ * A request is "<verb> <args>", a response is "<status>\n<body>".
+ */
+class ControlClient
+{
+	public:
+		int fd;
+		string in;		// received bytes that were not served yet
+		string out;		// responses that were not sent yet
+		bool busy;		// queued to be served when smash is idle
+		bool eof;		// the client will send no more requests
+		bool hup;		// the client is gone, its fd is no longer watched
+
+		ControlClient(int client_fd)
+		{
+			fd = client_fd;
+			busy = false;
+			eof = false;
+			hup = false;
+		}
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  controlListen(const char* path);
+bool controlActive();
+
+
+#endif
@@ -0,0 +1,360 @@
+/* ####################################################################################
+ *                                  EVENTLOOP.CC
+ *  A small epoll based loop. smash waits here for user input, so that background
+ *  sources (captured job output, signals) are served while the prompt is idle.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+#include "eventloop.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+struct EvEntry
+{
+	EventHandler handler;
+	void* ctx;
+};
+
+static int epfd = -1;
+static int wake_pipe[2] = {-1, -1};
+static vector<EvEntry> handlers;	// indexed by fd
+
+struct IdleEntry
+{
+	IdleHandler handler;
+	void* ctx;
+};
+
+static vector<IdleEntry> deferred;
+
+// stdin line buffer, unread input is in_buf[in_start, in_start+in_len)
+static char in_buf[EV_STDIN_BUF_SIZE];
+static size_t in_start = 0;
+static size_t in_len = 0;
+static bool in_eof = false;
+static bool in_pollable = false;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void wake_handler(int fd, unsigned int events, void* ctx);
+static void stdin_handler(int fd, unsigned int events, void* ctx);
+static void read_stdin();
+
+
+/**
+ * wake_handler function
+ * drains the wakeup pipe. The byte itself carries no information, it only breaks epoll_wait.
+ * @param fd
+ * @param events
+ * @param ctx
+ */
+static void wake_handler(int fd, unsigned int events, void* ctx)
+{
+	char buf[256];
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+}
+/****************************************************************************************/
+/**
+ * read_stdin function
+ * appends whatever is available on stdin to the line buffer, and marks EOF
+ */
+static void read_stdin()
+{
+	if (in_len == sizeof(in_buf))
+		return;
+	if (in_start + in_len == sizeof(in_buf))
+	{
+		memmove(in_buf, in_buf + in_start, in_len);
+		in_start = 0;
+	}
+	ssize_t n = read(STDIN_FILENO, in_buf + in_start + in_len, sizeof(in_buf) - in_start - in_len);
+	if (n > 0)
+	{
+		in_len += n;
+	}
+	else if (n == 0)
+	{
+		in_eof = true;
+	}
+	else if (errno != EINTR && errno != EAGAIN)
+	{
+		perror("read");
+		in_eof = true;
+	}
+}
+/****************************************************************************************/
+/**
+ * stdin_handler function
+ * @param fd
+ * @param events
+ * @param ctx
+ */
+static void stdin_handler(int fd, unsigned int events, void* ctx)
+{
+	read_stdin();
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * evInit function
+ * creates the epoll instance and the wakeup pipe, and checks whether stdin can be polled.
+ * A fork of smash that closed the inherited fds calls it again to start with no sources
+ * @return 0 on success, -1 on failure
+ */
+int evInit()
+{
+	handlers.clear();
+	deferred.clear();
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (epfd == -1)
+	{
+		perror("epoll_create1");
+		return -1;
+	}
+	if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+	{
+		perror("pipe2");
+		return -1;
+	}
+	if (!evAdd(wake_pipe[0], EPOLLIN, wake_handler, NULL))
+		return -1;
+
+	// regular files can not be polled (EPERM) - they are always readable anyway
+	in_pollable = evAdd(STDIN_FILENO, EPOLLIN, stdin_handler, NULL);
+	evDel(STDIN_FILENO);
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * evAdd function
+ * @param fd
+ * @param events EPOLL* flags
+ * @param handler
+ * @param ctx passed back to handler
+ * @return true if fd is now watched
+ */
+bool evAdd(int fd, unsigned int events, EventHandler handler, void* ctx)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+	{
+		if (errno != EPERM)
+			perror("epoll_ctl");
+		return false;
+	}
+	if ((size_t)fd >= handlers.size())
+	{
+		EvEntry empty = {NULL, NULL};
+		handlers.resize(fd + 1, empty);
+	}
+	handlers[fd].handler = handler;
+	handlers[fd].ctx = ctx;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * evMod function
+ * @param fd an fd added with evAdd
+ * @param events the new EPOLL* flags, 0 pauses fd without forgetting its handler
+ * @return true on success
+ */
+bool evMod(int fd, unsigned int events)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) == -1)
+	{
+		perror("epoll_ctl");
+		return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * evDel function
+ * stops watching fd. It is safe to call from inside a handler, and must be called before fd is closed.
+ * @param fd
+ */
+void evDel(int fd)
+{
+	if (fd < 0 || (size_t)fd >= handlers.size() || handlers[fd].handler == NULL)
+		return;
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	handlers[fd].handler = NULL;
+	handlers[fd].ctx = NULL;
+}
+/****************************************************************************************/
+/**
+ * evRunOnce function
+ * waits for at most timeout_ms (-1 = forever) and dispatches every ready fd
+ * @param timeout_ms
+ * @return number of dispatched events, 0 on timeout or signal
+ */
+int evRunOnce(int timeout_ms)
+{
+	struct epoll_event events[EV_MAX_EVENTS];
+	int n = epoll_wait(epfd, events, EV_MAX_EVENTS, timeout_ms);
+	if (n == -1)
+	{
+		if (errno != EINTR)
+			perror("epoll_wait");
+		return 0;
+	}
+	for (int i = 0; i < n; i++)
+	{
+		int fd = events[i].data.fd;
+		// an earlier handler of this round may have removed fd
+		if ((size_t)fd >= handlers.size() || handlers[fd].handler == NULL)
+			continue;
+		handlers[fd].handler(fd, events[i].events, handlers[fd].ctx);
+	}
+	return n;
+}
+/****************************************************************************************/
+/**
+ * evRunIdle function
+ * like evRunOnce, for callers at the top level (the prompt): deferred work runs first.
+ * Nested waits (a foreground job, output -f) use evRunOnce, so that work never runs inside a command.
+ * @param timeout_ms
+ * @return number of dispatched events
+ */
+int evRunIdle(int timeout_ms)
+{
+	while (!deferred.empty())
+	{
+		vector<IdleEntry> now;
+		now.swap(deferred);
+		for (size_t i = 0; i < now.size(); i++)
+			now[i].handler(now[i].ctx);
+	}
+	return evRunOnce(timeout_ms);
+}
+/****************************************************************************************/
+/**
+ * evDefer function
+ * queues handler to run the next time smash is idle at the top level
+ * @param handler
+ * @param ctx
+ */
+void evDefer(IdleHandler handler, void* ctx)
+{
+	IdleEntry e = { handler, ctx };
+	deferred.push_back(e);
+	evWakeup();
+}
+/****************************************************************************************/
+/**
+ * evWakeup function
+ * makes the current (or next) evRunOnce return. async-signal-safe.
+ */
+void evWakeup()
+{
+	int saved_errno = errno;
+	if (wake_pipe[1] != -1)
+		(void)write(wake_pipe[1], "", 1);
+	errno = saved_errno;
+}
+/****************************************************************************************/
+/**
+ * evReadLine function
+ * runs the loop until a full line is available on stdin.
+ * stdin is watched only while we are here, so a foreground child keeps the terminal input to itself.
+ * Lines longer than size-1 are truncated, the newline is not stored.
+ * @param line
+ * @param size
+ * @return false on EOF (and no more buffered input)
+ */
+bool evReadLine(char* line, int size)
+{
+	while (1)
+	{
+		char* start = in_buf + in_start;
+		char* nl = (char*)memchr(start, '\n', in_len);
+		if (nl != NULL || in_len == sizeof(in_buf) || (in_eof && in_len > 0))
+		{
+			// buffered input never waits; still serve signals and fds that are ready
+			evDel(STDIN_FILENO);
+			evRunOnce(0);
+			size_t line_len = nl ? (size_t)(nl - start) : in_len;
+			size_t copy_len = line_len < (size_t)(size - 1) ? line_len : (size_t)(size - 1);
+			memcpy(line, start, copy_len);
+			line[copy_len] = '\0';
+
+			size_t consumed = nl ? line_len + 1 : line_len;
+			in_start += consumed;
+			in_len -= consumed;
+			if (in_len == 0)
+				in_start = 0;
+			evDel(STDIN_FILENO);
+			return true;
+		}
+		if (in_eof)
+		{
+			evDel(STDIN_FILENO);
+			return false;
+		}
+
+		if (in_pollable)
+		{
+			if ((size_t)STDIN_FILENO >= handlers.size() || handlers[STDIN_FILENO].handler == NULL)
+				evAdd(STDIN_FILENO, EPOLLIN, stdin_handler, NULL);
+			evRunIdle(-1);
+		}
+		else
+		{
+			if (!deferred.empty())
+				evRunIdle(0);
+			read_stdin();
+		}
+	}
+}
+/****************************************************************************************/
+/**
+ * writeAll function
+ * write() until all of data is written, or an error other than EINTR
+ * @param fd
+ * @param data
+ * @param len
+ */
+void writeAll(int fd, const char* data, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, data, len);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			return;
+		}
+		data += n;
+		len -= n;
+	}
+}
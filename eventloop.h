@@ -0,0 +1,51 @@
+#ifndef _EVENTLOOP_H
+#define _EVENTLOOP_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/epoll.h>
+#include <stddef.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define EV_MAX_EVENTS 64
+#define EV_STDIN_BUF_SIZE 65536
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+/**
+ * callback invoked by the event loop when fd is ready.
+ * events holds the EPOLL* flags that were reported for fd.
+ */
+typedef void (*EventHandler)(int fd, unsigned int events, void* ctx);
+
+/**
+ * work deferred until smash is idle at the prompt (see evDefer)
+ */
+typedef void (*IdleHandler)(void* ctx);
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  evInit();
+bool evAdd(int fd, unsigned int events, EventHandler handler, void* ctx);
+bool evMod(int fd, unsigned int events);
+void evDel(int fd);
+int  evRunOnce(int timeout_ms);
+int  evRunIdle(int timeout_ms);
+void evDefer(IdleHandler handler, void* ctx);
+void evWakeup();
+bool evReadLine(char* line, int size);
+void writeAll(int fd, const char* data, size_t len);
+
+
+#endif
@@ -0,0 +1,822 @@
+/* ####################################################################################
+ *                                  FASTCMD.CC
+ *  echo, printf, test/[, true, false and sleep run inside smash instead of being
+ *  forked and exec'd: scripts call them in tight loops, and for them fork+exec+wait
+ *  is the whole cost. They follow coreutils for the common flags, write to smash's
+ *  stdout (so --listen and cache capture them) and set sm.last_status.
+ *
+ *  ExeCmd looks a foreground command up here before running it as an external one.
+ *  "external cmd ..." or a path ("/bin/echo") runs the real binary, and "cmd &" is
+ *  always a job.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+#include "eventloop.h"
+#include "fastcmd.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct FastBuiltin
+{
+	const char* name;
+	FastCmd run;
+};
+
+/**
+ * recursive descent over the arguments of test
+ */
+struct TestParser
+{
+	char** a;
+	int n;
+	int i;
+	bool err;
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern volatile sig_atomic_t smash_interrupted;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static int fast_true(char* args[], int num_arg);
+static int fast_false(char* args[], int num_arg);
+static int fast_echo(char* args[], int num_arg);
+static int fast_printf(char* args[], int num_arg);
+static int fast_test(char* args[], int num_arg);
+static int fast_bracket(char* args[], int num_arg);
+static int fast_sleep(char* args[], int num_arg);
+
+static const char* append_escape(string& out, const char* s, bool zero_octal, bool* stop);
+static bool printf_number(const char* arg, bool is_signed, long long* sval, unsigned long long* uval);
+static bool printf_once(string& out, const char* fmt, char* args[], int num_arg, int* next, bool* stop, bool* bad);
+static bool test_integer(const char* s, long long* v);
+static bool test_unary(const char* op, const char* arg, bool* result);
+static bool test_binary(const char* l, const char* op, const char* r, bool* result, bool* err);
+static bool test_or(TestParser& p);
+static bool test_and(TestParser& p);
+static bool test_not(TestParser& p);
+static bool test_primary(TestParser& p);
+static int test_args(char** a, int n);
+
+static const FastBuiltin fast_builtins[] =
+{
+	{ "true", fast_true },
+	{ "false", fast_false },
+	{ "echo", fast_echo },
+	{ "printf", fast_printf },
+	{ "test", fast_test },
+	{ "[", fast_bracket },
+	{ "sleep", fast_sleep },
+};
+
+
+/**
+ * fast_true function
+ * @return 0
+ */
+static int fast_true(char* args[], int num_arg)
+{
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * fast_false function
+ * @return 1
+ */
+static int fast_false(char* args[], int num_arg)
+{
+	return 1;
+}
+/****************************************************************************************/
+/**
+ * append_escape function
+ * appends the backslash escape that starts at s (just after the backslash)
+ * @param out
+ * @param s
+ * @param zero_octal true for echo and %b, where \0NNN is an octal byte
+ * @param stop set by \c: no more output
+ * @return where the escape ends
+ */
+static const char* append_escape(string& out, const char* s, bool zero_octal, bool* stop)
+{
+	char c = *s++;
+	switch (c)
+	{
+		case 'a': out += '\a'; break;
+		case 'b': out += '\b'; break;
+		case 'e': out += '\033'; break;
+		case 'f': out += '\f'; break;
+		case 'n': out += '\n'; break;
+		case 'r': out += '\r'; break;
+		case 't': out += '\t'; break;
+		case 'v': out += '\v'; break;
+		case '\\': out += '\\'; break;
+		case 'c': *stop = true; break;
+		case 'x':
+		{
+			int v = 0, digits = 0;
+			while (digits < 2 && isxdigit((unsigned char)*s))
+			{
+				v = v * 16 + (isdigit((unsigned char)*s) ? *s - '0' : (tolower(*s) - 'a' + 10));
+				s++;
+				digits++;
+			}
+			if (digits == 0)
+				out += "\\x";
+			else
+				out += (char)v;
+			break;
+		}
+		case '\0':
+			out += '\\';
+			s--;
+			break;
+		default:
+			if (c >= '0' && c <= '7')
+			{
+				int v = c - '0';
+				int digits = 1;
+				if (zero_octal && c == '0')
+				{
+					v = 0;
+					digits = 0;
+				}
+				while (digits < 3 && *s >= '0' && *s <= '7')
+				{
+					v = v * 8 + (*s++ - '0');
+					digits++;
+				}
+				out += (char)v;
+			}
+			else
+			{
+				out += '\\';
+				out += c;
+			}
+	}
+	return s;
+}
+/****************************************************************************************/
+/**
+ * fast_echo function
+ * echo [-neE] [STRING]...
+ * @param args
+ * @param num_arg
+ * @return 0
+ */
+static int fast_echo(char* args[], int num_arg)
+{
+	bool newline = true;
+	bool escapes = false;
+	int i = 1;
+	// like coreutils, an argument is options only if all of it is
+	for (; i < num_arg && args[i][0] == '-' && args[i][1] != '\0'; i++)
+	{
+		if (strspn(args[i] + 1, "neE") != strlen(args[i] + 1))
+			break;
+		for (const char* f = args[i] + 1; *f; f++)
+		{
+			if (*f == 'n')
+				newline = false;
+			else
+				escapes = (*f == 'e');
+		}
+	}
+
+	string out;
+	bool stop = false;
+	for (int first = i; i < num_arg && !stop; i++)
+	{
+		if (i > first)
+			out += ' ';
+		if (!escapes)
+		{
+			out += args[i];
+			continue;
+		}
+		for (const char* s = args[i]; *s && !stop; )
+		{
+			if (*s == '\\')
+				s = append_escape(out, s + 1, true, &stop);
+			else
+				out += *s++;
+		}
+	}
+	if (newline && !stop)
+		out += '\n';
+	cout.write(out.data(), out.size());
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * printf_number function
+ * converts a printf argument, 'c or "c gives the code of c
+ * @param arg
+ * @param is_signed
+ * @param sval set if is_signed
+ * @param uval set if not
+ * @return false if arg is not entirely a number (the value is what could be read)
+ */
+static bool printf_number(const char* arg, bool is_signed, long long* sval, unsigned long long* uval)
+{
+	if (arg[0] == '\'' || arg[0] == '"')
+	{
+		*sval = (unsigned char)arg[1];
+		*uval = (unsigned char)arg[1];
+		return true;
+	}
+	char* end;
+	errno = 0;
+	if (is_signed)
+		*sval = strtoll(arg, &end, 0);
+	else if (arg[strspn(arg, " \t")] == '-')
+		*uval = (unsigned long long)strtoll(arg, &end, 0);
+	else
+		*uval = strtoull(arg, &end, 0);
+	if (end == arg || *end != '\0' || errno == ERANGE)
+	{
+		cerr << "printf: '" << arg << "': " << (errno == ERANGE ? "Numerical result out of range"
+			 : (end == arg ? "expected a numeric value" : "value not completely converted")) << endl;
+		return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * printf_once function
+ * formats fmt once
+ * @param out
+ * @param fmt
+ * @param args
+ * @param num_arg
+ * @param next the next argument to consume
+ * @param stop set by \c in fmt or in a %b argument
+ * @param bad set if a conversion failed (the exit status is 1)
+ * @return false if fmt is invalid
+ */
+static bool printf_once(string& out, const char* fmt, char* args[], int num_arg, int* next, bool* stop, bool* bad)
+{
+	for (const char* f = fmt; *f && !*stop; )
+	{
+		if (*f == '\\')
+		{
+			f = append_escape(out, f + 1, false, stop);
+			continue;
+		}
+		if (*f != '%')
+		{
+			out += *f++;
+			continue;
+		}
+		if (f[1] == '%')
+		{
+			out += '%';
+			f += 2;
+			continue;
+		}
+
+		// %[flags][width][.precision][length]conversion
+		string spec = "%";
+		f++;
+		while (*f && strchr("-+ #0'", *f))
+			spec += *f++;
+		for (int part = 0; part < 2; part++)
+		{
+			if (part == 1)
+			{
+				if (*f != '.')
+					break;
+				spec += *f++;
+			}
+			if (*f == '*')
+			{
+				long long v = 0;
+				unsigned long long u;
+				if (*next < num_arg && !printf_number(args[(*next)++], true, &v, &u))
+					*bad = true;
+				spec += to_string(v);
+				f++;
+			}
+			while (isdigit((unsigned char)*f))
+				spec += *f++;
+		}
+		while (*f && strchr("hlLqjzt", *f))
+			f++;
+		char conv = *f;
+		if (conv == '\0')
+		{
+			cerr << "printf: %" << spec.substr(1) << ": invalid conversion specification" << endl;
+			return false;
+		}
+		f++;
+		const char* arg = (*next < num_arg) ? args[(*next)++] : NULL;
+
+		char buf[512];
+		long long sval = 0;
+		unsigned long long uval = 0;
+		switch (conv)
+		{
+			case 's':
+			case 'b':
+			{
+				string text;
+				if (conv == 'b' && arg != NULL)
+				{
+					for (const char* s = arg; *s && !*stop; )
+					{
+						if (*s == '\\')
+							s = append_escape(text, s + 1, true, stop);
+						else
+							text += *s++;
+					}
+				}
+				else if (arg != NULL)
+				{
+					text = arg;
+				}
+				spec += 's';
+				int len = snprintf(NULL, 0, spec.c_str(), text.c_str());
+				size_t at = out.size();
+				out.resize(at + len + 1);
+				snprintf(&out[at], len + 1, spec.c_str(), text.c_str());
+				out.resize(at + len);
+				continue;
+			}
+			case 'c':
+				spec += 'c';
+				snprintf(buf, sizeof(buf), spec.c_str(), (arg != NULL && arg[0]) ? arg[0] : '\0');
+				out.append(buf, (arg != NULL && arg[0]) ? strlen(buf) : strlen(buf) + 1);
+				continue;
+			case 'd':
+			case 'i':
+				if (arg != NULL && !printf_number(arg, true, &sval, &uval))
+					*bad = true;
+				spec += "ll";
+				spec += conv;
+				snprintf(buf, sizeof(buf), spec.c_str(), sval);
+				break;
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				if (arg != NULL && !printf_number(arg, false, &sval, &uval))
+					*bad = true;
+				spec += "ll";
+				spec += conv;
+				snprintf(buf, sizeof(buf), spec.c_str(), uval);
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+			{
+				double d = 0;
+				if (arg != NULL)
+				{
+					char* end;
+					d = strtod(arg, &end);
+					if (end == arg || *end != '\0')
+					{
+						cerr << "printf: '" << arg << "': expected a numeric value" << endl;
+						*bad = true;
+					}
+				}
+				spec += conv;
+				snprintf(buf, sizeof(buf), spec.c_str(), d);
+				break;
+			}
+			default:
+				cerr << "printf: %" << spec.substr(1) << conv << ": invalid conversion specification" << endl;
+				return false;
+		}
+		out += buf;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * fast_printf function
+ * printf FORMAT [ARGUMENT]...: the format is reused until the arguments are consumed
+ * @param args
+ * @param num_arg
+ * @return 0, 1 if an argument was not a number or the format is invalid
+ */
+static int fast_printf(char* args[], int num_arg)
+{
+	if (num_arg < 2)
+	{
+		cerr << "printf: missing operand" << endl;
+		return 1;
+	}
+	string out;
+	bool stop = false;
+	bool bad = false;
+	int next = 2;
+	while (1)
+	{
+		int before = next;
+		if (!printf_once(out, args[1], args, num_arg, &next, &stop, &bad))
+		{
+			bad = true;
+			break;
+		}
+		if (stop || next >= num_arg || next == before)
+			break;
+	}
+	cout.write(out.data(), out.size());
+	return bad ? 1 : 0;
+}
+/****************************************************************************************/
+/**
+ * test_integer function
+ * @param s
+ * @param v
+ * @return false (and an error message) if s is not an integer
+ */
+static bool test_integer(const char* s, long long* v)
+{
+	char* end;
+	errno = 0;
+	*v = strtoll(s, &end, 10);
+	while (*end == ' ' || *end == '\t')
+		end++;
+	if (end == s || *end != '\0' || errno == ERANGE)
+	{
+		cerr << "test: " << s << ": integer expression expected" << endl;
+		return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * test_unary function
+ * @param op
+ * @param arg
+ * @param result
+ * @return false if op is not a unary operator
+ */
+static bool test_unary(const char* op, const char* arg, bool* result)
+{
+	if (op[0] != '-' || op[1] == '\0' || op[2] != '\0')
+		return false;
+	struct stat st;
+	switch (op[1])
+	{
+		case 'n': *result = arg[0] != '\0'; return true;
+		case 'z': *result = arg[0] == '\0'; return true;
+		case 'r': *result = access(arg, R_OK) == 0; return true;
+		case 'w': *result = access(arg, W_OK) == 0; return true;
+		case 'x': *result = access(arg, X_OK) == 0; return true;
+		case 't': *result = isatty(atoi(arg)); return true;
+		case 'h':
+		case 'L': *result = lstat(arg, &st) == 0 && S_ISLNK(st.st_mode); return true;
+		case 'e': case 'f': case 'd': case 'b': case 'c': case 'p': case 'S':
+		case 's': case 'g': case 'u': case 'k': case 'O': case 'G':
+			break;
+		default:
+			return false;
+	}
+	if (stat(arg, &st) == -1)
+	{
+		*result = false;
+		return true;
+	}
+	switch (op[1])
+	{
+		case 'e': *result = true; break;
+		case 'f': *result = S_ISREG(st.st_mode); break;
+		case 'd': *result = S_ISDIR(st.st_mode); break;
+		case 'b': *result = S_ISBLK(st.st_mode); break;
+		case 'c': *result = S_ISCHR(st.st_mode); break;
+		case 'p': *result = S_ISFIFO(st.st_mode); break;
+		case 'S': *result = S_ISSOCK(st.st_mode); break;
+		case 's': *result = st.st_size > 0; break;
+		case 'g': *result = (st.st_mode & S_ISGID) != 0; break;
+		case 'u': *result = (st.st_mode & S_ISUID) != 0; break;
+		case 'k': *result = (st.st_mode & S_ISVTX) != 0; break;
+		case 'O': *result = st.st_uid == geteuid(); break;
+		case 'G': *result = st.st_gid == getegid(); break;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * test_binary function
+ * @param l
+ * @param op
+ * @param r
+ * @param result
+ * @param err set if an operand of an integer comparison is not an integer
+ * @return false if op is not a binary operator
+ */
+static bool test_binary(const char* l, const char* op, const char* r, bool* result, bool* err)
+{
+	if (!strcmp(op, "=") || !strcmp(op, "=="))
+		*result = !strcmp(l, r);
+	else if (!strcmp(op, "!="))
+		*result = strcmp(l, r) != 0;
+	else if (!strcmp(op, "<"))
+		*result = strcoll(l, r) < 0;
+	else if (!strcmp(op, ">"))
+		*result = strcoll(l, r) > 0;
+	else if (!strcmp(op, "-nt") || !strcmp(op, "-ot") || !strcmp(op, "-ef"))
+	{
+		struct stat ls, rs;
+		bool lok = stat(l, &ls) == 0, rok = stat(r, &rs) == 0;
+		if (op[1] == 'e')
+			*result = lok && rok && ls.st_dev == rs.st_dev && ls.st_ino == rs.st_ino;
+		else
+		{
+			// a file that exists is newer than one that does not
+			long long lt = lok ? ls.st_mtim.tv_sec * 1000000000LL + ls.st_mtim.tv_nsec : LLONG_MIN;
+			long long rt = rok ? rs.st_mtim.tv_sec * 1000000000LL + rs.st_mtim.tv_nsec : LLONG_MIN;
+			*result = (op[1] == 'n') ? (lok && lt > rt) : (rok && lt < rt);
+		}
+	}
+	else if (op[0] == '-' && strlen(op) == 3 && strstr("-eq-ne-lt-le-gt-ge", op) != NULL)
+	{
+		long long a, b;
+		if (!test_integer(l, &a) || !test_integer(r, &b))
+		{
+			*err = true;
+			*result = false;
+			return true;
+		}
+		switch (op[1] * 256 + op[2])
+		{
+			case 'e' * 256 + 'q': *result = a == b; break;
+			case 'n' * 256 + 'e': *result = a != b; break;
+			case 'l' * 256 + 't': *result = a < b; break;
+			case 'l' * 256 + 'e': *result = a <= b; break;
+			case 'g' * 256 + 't': *result = a > b; break;
+			default: *result = a >= b; break;
+		}
+	}
+	else
+		return false;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * test_or, test_and, test_not and test_primary functions
+ * expr := and ( -o and )*, and := not ( -a not )*, not := ! not | primary,
+ * primary := ( expr ) | unary-op arg | arg binary-op arg | arg
+ * @param p
+ * @return the value of the expression, p.err is set on a syntax error
+ */
+static bool test_or(TestParser& p)
+{
+	bool v = test_and(p);
+	while (!p.err && p.i < p.n && !strcmp(p.a[p.i], "-o"))
+	{
+		p.i++;
+		bool r = test_and(p);
+		v = v || r;
+	}
+	return v;
+}
+static bool test_and(TestParser& p)
+{
+	bool v = test_not(p);
+	while (!p.err && p.i < p.n && !strcmp(p.a[p.i], "-a"))
+	{
+		p.i++;
+		bool r = test_not(p);
+		v = v && r;
+	}
+	return v;
+}
+static bool test_not(TestParser& p)
+{
+	if (p.i < p.n && !strcmp(p.a[p.i], "!"))
+	{
+		p.i++;
+		return !test_not(p);
+	}
+	return test_primary(p);
+}
+static bool test_primary(TestParser& p)
+{
+	if (p.i >= p.n)
+	{
+		cerr << "test: argument expected" << endl;
+		p.err = true;
+		return false;
+	}
+	bool v;
+	if (p.i + 2 < p.n && test_binary(p.a[p.i], p.a[p.i+1], p.a[p.i+2], &v, &p.err))
+	{
+		p.i += 3;
+		return v;
+	}
+	if (!strcmp(p.a[p.i], "("))
+	{
+		p.i++;
+		v = test_or(p);
+		if (p.i >= p.n || strcmp(p.a[p.i], ")"))
+		{
+			if (!p.err)
+				cerr << "test: ')' expected" << endl;
+			p.err = true;
+			return false;
+		}
+		p.i++;
+		return v;
+	}
+	if (p.i + 1 < p.n && test_unary(p.a[p.i], p.a[p.i+1], &v))
+	{
+		p.i += 2;
+		return v;
+	}
+	return p.a[p.i++][0] != '\0';
+}
+/****************************************************************************************/
+/**
+ * test_args function
+ * evaluates the arguments of test, with the POSIX rules for up to 4 arguments
+ * @param a
+ * @param n
+ * @return 0 if true, 1 if false, 2 on error
+ */
+static int test_args(char** a, int n)
+{
+	bool v;
+	bool err = false;
+	switch (n)
+	{
+		case 0:
+			return 1;
+		case 1:
+			return a[0][0] ? 0 : 1;
+		case 2:
+			if (!strcmp(a[0], "!"))
+				return a[1][0] ? 1 : 0;
+			if (test_unary(a[0], a[1], &v))
+				return v ? 0 : 1;
+			cerr << "test: " << a[0] << ": unary operator expected" << endl;
+			return 2;
+		case 3:
+			if (test_binary(a[0], a[1], a[2], &v, &err))
+				return err ? 2 : (v ? 0 : 1);
+			if (!strcmp(a[0], "!"))
+			{
+				int r = test_args(a + 1, 2);
+				return (r == 2) ? 2 : !r;
+			}
+			if (!strcmp(a[0], "(") && !strcmp(a[2], ")"))
+				return a[1][0] ? 0 : 1;
+			break;
+		case 4:
+			if (!strcmp(a[0], "!"))
+			{
+				int r = test_args(a + 1, 3);
+				return (r == 2) ? 2 : !r;
+			}
+			if (!strcmp(a[0], "(") && !strcmp(a[3], ")"))
+				return test_args(a + 1, 2);
+			break;
+	}
+	TestParser p = { a, n, 0, false };
+	v = test_or(p);
+	if (!p.err && p.i < n)
+	{
+		cerr << "test: " << a[p.i] << ": unexpected argument" << endl;
+		p.err = true;
+	}
+	return p.err ? 2 : (v ? 0 : 1);
+}
+/****************************************************************************************/
+/**
+ * fast_test function
+ * test EXPRESSION
+ * @param args
+ * @param num_arg
+ * @return 0 if true, 1 if false, 2 on error
+ */
+static int fast_test(char* args[], int num_arg)
+{
+	return test_args(args + 1, num_arg - 1);
+}
+/****************************************************************************************/
+/**
+ * fast_bracket function
+ * [ EXPRESSION ]
+ * @param args
+ * @param num_arg
+ * @return like test
+ */
+static int fast_bracket(char* args[], int num_arg)
+{
+	if (strcmp(args[num_arg - 1], "]"))
+	{
+		cerr << "[: missing ']'" << endl;
+		return 2;
+	}
+	return test_args(args + 1, num_arg - 2);
+}
+/****************************************************************************************/
+/**
+ * fast_sleep function
+ * sleep NUMBER[smhd]...: waits in the event loop, so signals and other fds are still
+ * served, and CTRL+C ends it
+ * @param args
+ * @param num_arg
+ * @return 0, 1 on a bad interval, 130 if interrupted
+ */
+static int fast_sleep(char* args[], int num_arg)
+{
+	if (num_arg < 2)
+	{
+		cerr << "sleep: missing operand" << endl;
+		return 1;
+	}
+	double secs = 0;
+	for (int i = 1; i < num_arg; i++)
+	{
+		char* end;
+		double v = strtod(args[i], &end);
+		double unit = 1;
+		if (*end != '\0' && end[1] == '\0')
+		{
+			switch (*end)
+			{
+				case 's': unit = 1; end++; break;
+				case 'm': unit = 60; end++; break;
+				case 'h': unit = 3600; end++; break;
+				case 'd': unit = 86400; end++; break;
+			}
+		}
+		if (end == args[i] || *end != '\0' || v < 0)
+		{
+			cerr << "sleep: invalid time interval '" << args[i] << "'" << endl;
+			return 1;
+		}
+		secs += v * unit;
+	}
+
+	cout.flush();
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	long double deadline = now.tv_sec + now.tv_nsec / 1e9L + secs;
+	smash_interrupted = 0;
+	while (!smash_interrupted)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		long double left = deadline - (now.tv_sec + now.tv_nsec / 1e9L);
+		if (left <= 0)
+			return 0;
+		// round up, so the last round does not spin on a 0 ms timeout
+		evRunOnce(left > INT_MAX / 1000 ? INT_MAX : (int)(left * 1000) + 1);
+	}
+	return 130;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * fastLookup function
+ * @param name
+ * @return the in-process implementation of the utility name, NULL if it has none
+ */
+FastCmd fastLookup(const char* name)
+{
+	for (size_t i = 0; i < sizeof(fast_builtins) / sizeof(fast_builtins[0]); i++)
+	{
+		if (!strcmp(fast_builtins[i].name, name))
+			return fast_builtins[i].run;
+	}
+	return NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef _FASTCMD_H
+#define _FASTCMD_H
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+// runs a utility inside smash, returns its exit status
+typedef int (*FastCmd)(char* args[], int num_arg);
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+FastCmd fastLookup(const char* name);
+
+
+#endif
@@ -0,0 +1,217 @@
+/* ####################################################################################
+ *                                  JOBSJSON.CC
+ *  Serializes the job table (and the recently finished jobs) as JSON, in one pass
+ *  into one buffer, for jobs --json and jobs --ndjson.
+ *
+ *  per job: id, pid, pgid, command, state (running/stopped/done), proc_state (from
+ *  /proc, "" once gone), start_ns (epoch), elapsed_ns, exit_status (null while alive
+ *  and for adopted jobs), and rusage: utime_us, stime_us, maxrss_kb (rss_kb while
+ *  alive), minflt, majflt
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "commands.h"
+#include "jobsjson.h"
+#include "procstat.h"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern smashManager sm;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void append_num(string& out, long long v);
+static void append_str(string& out, const string& s);
+static void append_job(string& out, const Job& j, long long now_ns, long long snapshot_ns);
+static long long ts_to_ns(const struct timespec& ts);
+
+
+/**
+ * ts_to_ns function
+ * @param ts
+ * @return ts in nanoseconds
+ */
+static long long ts_to_ns(const struct timespec& ts)
+{
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+/****************************************************************************************/
+/**
+ * append_num function
+ * @param out
+ * @param v
+ */
+static void append_num(string& out, long long v)
+{
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	bool negative = v < 0;
+	unsigned long long u = negative ? -(unsigned long long)v : v;
+	do
+	{
+		*--p = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+	if (negative)
+		*--p = '-';
+	out.append(p, buf + sizeof(buf) - p);
+}
+/****************************************************************************************/
+/**
+ * append_str function
+ * appends s as a quoted JSON string
+ * @param out
+ * @param s
+ */
+static void append_str(string& out, const string& s)
+{
+	out += '"';
+	for (size_t i = 0; i < s.length(); i++)
+	{
+		unsigned char c = s[i];
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c < 0x20)
+		{
+			char esc[8];
+			snprintf(esc, sizeof(esc), "\\u%04x", c);
+			out += esc;
+		}
+		else
+			out += c;
+	}
+	out += '"';
+}
+/****************************************************************************************/
+/**
+ * append_job function
+ * @param out
+ * @param j
+ * @param now_ns CLOCK_REALTIME now
+ * @param snapshot_ns added as "snapshot_ns" (ndjson lines stand alone), 0 to leave it out
+ */
+static void append_job(string& out, const Job& j, long long now_ns, long long snapshot_ns)
+{
+	bool done = (j.status != -1);
+	ProcStat ps;
+	bool alive = !done && procReadStat(j.pid, &ps);
+
+	out += '{';
+	if (snapshot_ns)
+	{
+		out += "\"snapshot_ns\":";
+		append_num(out, snapshot_ns);
+		out += ',';
+	}
+	out += "\"id\":";
+	append_num(out, j.id);
+	out += ",\"pid\":";
+	append_num(out, j.pid);
+	out += ",\"pgid\":";
+	append_num(out, j.pgid);
+	out += ",\"command\":";
+	append_str(out, j.name);
+	out += ",\"state\":\"";
+	out += done ? "done" : (j.is_delayed ? "stopped" : "running");
+	out += "\",\"proc_state\":\"";
+	if (alive)
+		out += ps.state;
+	out += "\",\"start_ns\":";
+	append_num(out, ts_to_ns(j.start));
+	out += ",\"elapsed_ns\":";
+	append_num(out, (done ? ts_to_ns(j.end) : now_ns) - ts_to_ns(j.start));
+	out += ",\"exit_status\":";
+	if (done && j.status != JOB_STATUS_UNKNOWN)
+		append_num(out, j.status);
+	else
+		out += "null";
+
+	out += ",\"rusage\":{\"utime_us\":";
+	if (done)
+	{
+		append_num(out, j.usage.ru_utime.tv_sec * 1000000LL + j.usage.ru_utime.tv_usec);
+		out += ",\"stime_us\":";
+		append_num(out, j.usage.ru_stime.tv_sec * 1000000LL + j.usage.ru_stime.tv_usec);
+		out += ",\"maxrss_kb\":";
+		append_num(out, j.usage.ru_maxrss);
+		out += ",\"minflt\":";
+		append_num(out, j.usage.ru_minflt);
+		out += ",\"majflt\":";
+		append_num(out, j.usage.ru_majflt);
+	}
+	else if (alive)
+	{
+		append_num(out, ps.utime_us);
+		out += ",\"stime_us\":";
+		append_num(out, ps.stime_us);
+		out += ",\"rss_kb\":";
+		append_num(out, ps.rss_kb);
+		out += ",\"minflt\":";
+		append_num(out, ps.minflt);
+		out += ",\"majflt\":";
+		append_num(out, ps.majflt);
+	}
+	else
+	{
+		out += "null";
+	}
+	out += "}}";
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * jobsToJson function
+ * finished jobs first, then the job vector
+ * @param out replaced with {"time_ns":..,"jobs":[..]}, or with one line per job if ndjson
+ * @param ndjson
+ */
+void jobsToJson(string& out, bool ndjson)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	long long now_ns = ts_to_ns(now);
+
+	out.clear();
+	out.reserve((sm.jobs.size() + sm.done_jobs.size() + 1) * JOBS_JSON_BYTES_PER_JOB);
+	if (!ndjson)
+	{
+		out += "{\"time_ns\":";
+		append_num(out, now_ns);
+		out += ",\"jobs\":[";
+	}
+	bool first = true;
+	for (int pass = 0; pass < 2; pass++)
+	{
+		const vector<Job>& list = (pass == 0) ? sm.done_jobs : sm.jobs;
+		for (vector<Job>::const_iterator j = list.begin(); j != list.end(); ++j)
+		{
+			if (!ndjson && !first)
+				out += ',';
+			first = false;
+			append_job(out, *j, now_ns, ndjson ? now_ns : 0);
+			if (ndjson)
+				out += '\n';
+		}
+	}
+	if (!ndjson)
+		out += "]}\n";
+}
@@ -0,0 +1,26 @@
+#ifndef _JOBSJSON_H
+#define _JOBSJSON_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <string>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define JOBS_JSON_BYTES_PER_JOB 384	// initial reservation, the buffer is reused between calls
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+void jobsToJson(string& out, bool ndjson);
+
+
+#endif
@@ -0,0 +1,273 @@
+/* ####################################################################################
+ *                                  JOBSTATE.CC
+ *  smash --state FILE: journals the job table, and on startup re-adopts the jobs of a
+ *  previous smash that are still alive, so an upgrade or a crash does not orphan them.
+ *
+ *  The file is rewritten (temporary file + rename) whenever the table changed, checked
+ *  before every prompt and before waiting for a foreground job:
+ *      smash-jobs 1 <smash pid> <smash starttime>
+ *      <id> <pid> <pgid> <starttime> <start sec> <start nsec> <command>
+ *  starttime is field 22 of /proc/<pid>/stat, so a recycled pid is never adopted.
+ *
+ *  Adopted jobs are not children of this smash and can not be waited for: their exit
+ *  is seen on a pidfd (the exit status is lost, JOB_STATUS_UNKNOWN) and their stopped
+ *  state is read from /proc.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <string>
+#include "eventloop.h"
+#include "jobstate.h"
+#include "procstat.h"
+#include "trace.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern smashManager sm;
+
+static string state_path;
+static string saved;		// what the file holds now
+static pid_t self = 0;		// forked children must not write the file
+static unsigned long long self_start = 0;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void finish_adopted(vector<Job>::iterator j);
+static void adopted_exit_handler(int fd, unsigned int events, void* ctx);
+static bool adopt(const char* line);
+
+
+/**
+ * finish_adopted function
+ * moves an adopted job that is gone to sm.done_jobs
+ * @param j
+ */
+static void finish_adopted(vector<Job>::iterator j)
+{
+	evDel(j->pidfd);
+	close(j->pidfd);
+	j->pidfd = -1;
+	j->status = JOB_STATUS_UNKNOWN;
+	clock_gettime(CLOCK_REALTIME, &j->end);
+	traceAsync('e', "job", j->pid);
+	sm.addToDone(*j);
+	sm.removeJob(j);
+}
+/****************************************************************************************/
+/**
+ * adopted_exit_handler function
+ * the pidfd of an adopted job became readable: the process is gone
+ * @param fd
+ * @param events
+ * @param ctx the job's pid
+ */
+static void adopted_exit_handler(int fd, unsigned int events, void* ctx)
+{
+	vector<Job>::iterator j = sm.getJobBbPID((pid_t)(intptr_t)ctx);
+	if (j != sm.jobs.end() && j->pidfd == fd)
+		finish_adopted(j);
+	else
+		evDel(fd);
+}
+/****************************************************************************************/
+/**
+ * adopt function
+ * @param line one job line of the state file
+ * @return true if the job is alive and was added to the job vector
+ */
+static bool adopt(const char* line)
+{
+	int id, pid, pgid, name_at = 0;
+	unsigned long long starttime;
+	long start_sec, start_nsec;
+	if (sscanf(line, "%d %d %d %llu %ld %ld %n", &id, &pid, &pgid, &starttime, &start_sec, &start_nsec, &name_at) != 6
+		|| name_at == 0)
+		return false;
+
+	ProcStat st;
+	if (!procReadStat(pid, &st) || st.starttime != starttime || st.pgid != pgid || st.state == 'Z')
+		return false;
+	int fd = syscall(SYS_pidfd_open, pid, 0);
+	if (fd == -1)
+		return false;
+
+	string name = line + name_at;
+	if (!name.empty() && name[name.length() - 1] == '\n')
+		name.erase(name.length() - 1);
+	if (!evAdd(fd, EPOLLIN, adopted_exit_handler, (void*)(intptr_t)pid))
+	{
+		close(fd);
+		return false;
+	}
+	int next_id = Job_Num;	// the job keeps its id, it does not take a new one
+	Job& job = sm.addJob(pid, name.c_str(), st.state == 'T' || st.state == 't');
+	Job_Num = next_id;
+	job.id = id;
+	job.pgid = pgid;
+	job.starttime = starttime;
+	job.start.tv_sec = start_sec;
+	job.start.tv_nsec = start_nsec;
+	job.time.tv_sec = start_sec;
+	job.time.tv_usec = start_nsec / 1000;
+	job.pidfd = fd;
+	if (id >= Job_Num)
+		Job_Num = id + 1;
+	traceAsync('b', "job", pid, name.c_str());
+	cout << "[" << id << "] " << name << " : " << pid << " adopted" << endl;
+	return true;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * jobStateOpen function
+ * adopts the living jobs listed in path, then keeps path up to date (see jobStateSave)
+ * @param path
+ * @return the number of adopted jobs, -1 if path belongs to a smash that is still running
+ */
+int jobStateOpen(const char* path)
+{
+	int adopted = 0;
+	FILE* f = fopen(path, "r");
+	if (f != NULL)
+	{
+		char line[MAX_LINE_SIZE + 128];
+		int owner = 0;
+		unsigned long long owner_start = 0;
+		ProcStat owner_st;
+		if (fgets(line, sizeof(line), f) == NULL || strncmp(line, JOB_STATE_MAGIC, strlen(JOB_STATE_MAGIC))
+			|| sscanf(line + strlen(JOB_STATE_MAGIC), "%d %llu", &owner, &owner_start) != 2)
+		{
+			cout << "smash: " << path << " is not a job state file" << endl;
+			fclose(f);
+			return -1;
+		}
+		if (owner != getpid() && procReadStat(owner, &owner_st) && owner_st.starttime == owner_start)
+		{
+			cout << "smash: " << path << " is used by smash " << owner << endl;
+			fclose(f);
+			return -1;
+		}
+		while (fgets(line, sizeof(line), f) != NULL)
+		{
+			if (adopt(line))
+				adopted++;
+		}
+		fclose(f);
+	}
+	else if (errno != ENOENT)
+	{
+		perror(path);
+		return -1;
+	}
+	ProcStat st;
+	self = getpid();
+	self_start = procReadStat(self, &st) ? st.starttime : 0;
+	state_path = path;
+	jobStateSave();
+	atexit(jobStateSave);
+	return adopted;
+}
+/****************************************************************************************/
+/**
+ * jobStateSave function
+ * rewrites the state file if the job table changed since the last save
+ */
+void jobStateSave()
+{
+	if (state_path.empty() || getpid() != self)
+		return;
+
+	char buf[128];
+	string out;
+	out.reserve(saved.size() + 128);
+	snprintf(buf, sizeof(buf), JOB_STATE_MAGIC " %d %llu\n", (int)self, self_start);
+	out += buf;
+	for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+	{
+		if (j->starttime == 0)
+		{
+			ProcStat st;
+			if (!procReadStat(j->pid, &st))
+				continue;	// already gone, it is reaped soon
+			j->starttime = st.starttime;
+		}
+		snprintf(buf, sizeof(buf), "%d %d %d %llu %ld %ld ", j->id, (int)j->pid, (int)j->pgid, j->starttime,
+				 (long)j->start.tv_sec, (long)j->start.tv_nsec);
+		out += buf;
+		out += j->name;
+		out += '\n';
+	}
+	if (out == saved)
+		return;
+
+	string tmp = state_path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd == -1)
+	{
+		perror("state");
+		return;
+	}
+	writeAll(fd, out.data(), out.size());
+	close(fd);
+	if (rename(tmp.c_str(), state_path.c_str()) == -1)
+	{
+		perror("state");
+		return;
+	}
+	saved.swap(out);
+}
+/****************************************************************************************/
+/**
+ * jobStateRefresh function
+ * adopted jobs report no stop/continue to smash, so their state is read from /proc
+ */
+void jobStateRefresh()
+{
+	for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end(); ++j)
+	{
+		ProcStat st;
+		if (j->pidfd != -1 && procReadStat(j->pid, &st))
+			j->is_delayed = (st.state == 'T' || st.state == 't');
+	}
+}
+/****************************************************************************************/
+/**
+ * jobStateReap function
+ * the sig_reap of adopted jobs, without blocking
+ * @param j an adopted job, erased if it is gone
+ * @param exit_status set to JOB_STATUS_UNKNOWN if it is gone
+ * @return true if the job is gone
+ */
+bool jobStateReap(vector<Job>::iterator j, int* exit_status)
+{
+	struct pollfd pfd = { j->pidfd, POLLIN, 0 };
+	if (poll(&pfd, 1, 0) != 1)
+		return false;
+	finish_adopted(j);
+	*exit_status = JOB_STATUS_UNKNOWN;
+	return true;
+}
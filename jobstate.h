@@ -0,0 +1,27 @@
+#ifndef _JOBSTATE_H
+#define _JOBSTATE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include "commands.h"
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define JOB_STATE_MAGIC "smash-jobs 1"
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  jobStateOpen(const char* path);
+void jobStateSave();
+void jobStateRefresh();
+bool jobStateReap(vector<Job>::iterator j, int* exit_status);
+
+
+#endif
@@ -0,0 +1,263 @@
+/* ####################################################################################
+ *                                  METRICS.CC
+ *  Counters and log2 bucketed latency histograms of smash's own overhead.
+ *  Recording is a clock read and a few relaxed atomic adds, so it is cheap on the
+ *  spawn path. Signals are handled from the event loop (see signals.cc), so a record
+ *  is never interrupted by another. Shown by the stats builtin, and
+ *  optionally rewritten periodically as a Prometheus text file (--metrics-file) for
+ *  the node-exporter textfile collector.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include <iostream>
+#include <string>
+#include "allocs.h"
+#include "commands.h"
+#include "eventloop.h"
+#include "metrics.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+struct Histogram
+{
+	unsigned long long count;
+	unsigned long long sum_ns;
+	unsigned long long buckets[HIST_BUCKETS];
+};
+
+extern smashManager sm;
+
+static Histogram hists[NUM_HISTS];
+static unsigned long long counters[NUM_COUNTERS];
+static unsigned long long start_time_ns = metricsNow();
+
+static const char* hist_names[NUM_HISTS] = { "command", "builtin", "spawn", "wait", "reap" };
+static const char* hist_help[NUM_HISTS] = {
+	"Time from dispatching an input line until smash is ready for the next one",
+	"Time spent in builtin commands",
+	"Time to fork (or ask the zygote for) a child, until smash continues",
+	"Time spent waiting for foreground jobs",
+	"Time spent in the SIGCHLD handler",
+};
+static const char* counter_names[NUM_COUNTERS] = { "commands", "builtins", "spawns", "spawn_failures", "sigchld", "reaped",
+												 "glob_cache_hits", "glob_cache_misses",
+												 "script_cache_hits", "script_cache_misses" };
+
+static string metrics_path;
+static int metrics_timer = -1;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static unsigned long long hist_percentile_ns(const Histogram& h, double q);
+static void write_metrics_file();
+static void timer_handler(int fd, unsigned int events, void* ctx);
+
+
+/**
+ * hist_percentile_ns function
+ * @param h
+ * @param q 0..1
+ * @return the upper bound of the bucket holding the q quantile
+ */
+static unsigned long long hist_percentile_ns(const Histogram& h, double q)
+{
+	if (h.count == 0)
+		return 0;
+	unsigned long long rank = (unsigned long long)(q * h.count);
+	if (rank >= h.count)
+		rank = h.count - 1;
+	unsigned long long seen = 0;
+	for (int i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += h.buckets[i];
+		if (seen > rank)
+			return 2ULL << i;
+	}
+	return 2ULL << (HIST_BUCKETS - 1);
+}
+/****************************************************************************************/
+/**
+ * write_metrics_file function
+ * writes the Prometheus text format to a temporary file and renames it over metrics_path,
+ * so the collector never reads a partial file
+ */
+static void write_metrics_file()
+{
+	string out;
+	out.reserve(16384);
+	char line[256];
+
+	for (int c = 0; c < NUM_COUNTERS; c++)
+	{
+		snprintf(line, sizeof(line), "# TYPE smash_%s_total counter\nsmash_%s_total %llu\n",
+				 counter_names[c], counter_names[c], __atomic_load_n(&counters[c], __ATOMIC_RELAXED));
+		out += line;
+	}
+	snprintf(line, sizeof(line), "# TYPE smash_uptime_seconds gauge\nsmash_uptime_seconds %.3f\n",
+			 (metricsNow() - start_time_ns) / 1e9);
+	out += line;
+	snprintf(line, sizeof(line), "# TYPE smash_jobs gauge\nsmash_jobs %zu\n", sm.jobs.size());
+	out += line;
+
+	for (int h = 0; h < NUM_HISTS; h++)
+	{
+		const Histogram& hist = hists[h];
+		snprintf(line, sizeof(line), "# HELP smash_%s_seconds %s\n# TYPE smash_%s_seconds histogram\n",
+				 hist_names[h], hist_help[h], hist_names[h]);
+		out += line;
+		unsigned long long cumulative = 0;
+		for (int i = 0; i < HIST_BUCKETS - 1; i++)
+		{
+			cumulative += hist.buckets[i];
+			snprintf(line, sizeof(line), "smash_%s_seconds_bucket{le=\"%.9g\"} %llu\n",
+					 hist_names[h], (2ULL << i) / 1e9, cumulative);
+			out += line;
+		}
+		snprintf(line, sizeof(line), "smash_%s_seconds_bucket{le=\"+Inf\"} %llu\nsmash_%s_seconds_sum %.9f\nsmash_%s_seconds_count %llu\n",
+				 hist_names[h], hist.count, hist_names[h], hist.sum_ns / 1e9, hist_names[h], hist.count);
+		out += line;
+	}
+
+	string tmp = metrics_path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		perror("metrics");
+		return;
+	}
+	writeAll(fd, out.data(), out.size());
+	close(fd);
+	if (rename(tmp.c_str(), metrics_path.c_str()) == -1)
+		perror("metrics");
+}
+/****************************************************************************************/
+/**
+ * timer_handler function
+ * @param fd the timerfd
+ * @param events
+ * @param ctx
+ */
+static void timer_handler(int fd, unsigned int events, void* ctx)
+{
+	unsigned long long expirations;
+	if (read(fd, &expirations, sizeof(expirations)) == (ssize_t)sizeof(expirations))
+		write_metrics_file();
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+#ifndef SMASH_NO_METRICS
+/**
+ * metricsRecord function
+ * @param hist
+ * @param start_ns from metricsStart()
+ */
+void metricsRecord(METRIC_HIST hist, unsigned long long start_ns)
+{
+	unsigned long long ns = metricsNow() - start_ns;
+	int bucket = 63 - __builtin_clzll(ns | 1);
+	if (bucket >= HIST_BUCKETS)
+		bucket = HIST_BUCKETS - 1;
+	Histogram& h = hists[hist];
+	// relaxed atomics: no ordering is needed, every record is made on the main flow
+	__atomic_add_fetch(&h.count, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h.sum_ns, ns, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&h.buckets[bucket], 1, __ATOMIC_RELAXED);
+}
+/****************************************************************************************/
+/**
+ * metricsCount function
+ * @param counter
+ */
+void metricsCount(METRIC_COUNTER counter)
+{
+	__atomic_add_fetch(&counters[counter], 1, __ATOMIC_RELAXED);
+}
+#endif
+/****************************************************************************************/
+/**
+ * metricsPrint function
+ * prints the counters and a summary of every histogram (percentiles are bucket upper bounds)
+ */
+void metricsPrint()
+{
+#ifdef SMASH_COUNT_ALLOCS
+	// first, so printing is not counted
+	unsigned long long allocs = allocsCount();
+#endif
+	double uptime = (metricsNow() - start_time_ns) / 1e9;
+	unsigned long long commands = counters[CNT_COMMANDS];
+	cout << "uptime " << uptime << " secs, " << (uptime > 0 ? commands / uptime : 0) << " commands/sec" << endl;
+	for (int c = 0; c < NUM_COUNTERS; c++)
+	{
+		cout << counter_names[c] << " " << counters[c] << endl;
+	}
+#ifdef SMASH_COUNT_ALLOCS
+	cout << "heap_allocations " << allocs << endl;
+#endif
+	for (int h = 0; h < NUM_HISTS; h++)
+	{
+		const Histogram& hist = hists[h];
+		cout << hist_names[h] << " count " << hist.count;
+		if (hist.count > 0)
+		{
+			cout << " mean_us " << (hist.sum_ns / hist.count) / 1000.0
+				 << " p50_us<=" << hist_percentile_ns(hist, 0.5) / 1000.0
+				 << " p99_us<=" << hist_percentile_ns(hist, 0.99) / 1000.0;
+		}
+		cout << endl;
+	}
+}
+/****************************************************************************************/
+/**
+ * metricsFile function
+ * rewrites path every period_secs from the event loop, and once more when smash exits
+ * @param path
+ * @param period_secs
+ * @return 0 on success, -1 on failure
+ */
+int metricsFile(const char* path, int period_secs)
+{
+	metrics_timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (metrics_timer == -1)
+	{
+		perror("timerfd_create");
+		return -1;
+	}
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = period_secs;
+	its.it_interval.tv_sec = period_secs;
+	if (timerfd_settime(metrics_timer, 0, &its, NULL) == -1 || !evAdd(metrics_timer, EPOLLIN, timer_handler, NULL))
+	{
+		perror("timerfd_settime");
+		close(metrics_timer);
+		metrics_timer = -1;
+		return -1;
+	}
+	metrics_path = path;
+	write_metrics_file();
+	atexit(write_metrics_file);
+	return 0;
+}
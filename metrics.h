@@ -0,0 +1,86 @@
+#ifndef _METRICS_H
+#define _METRICS_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <time.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define HIST_BUCKETS 40				// bucket i counts [2^i, 2^(i+1)) ns, the last one everything above
+#define METRICS_DEFAULT_PERIOD 10	// seconds between rewrites of the metrics file
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+typedef enum METRIC_HIST
+{
+	HIST_COMMAND,		// a whole input line, dispatch to done
+	HIST_BUILTIN,		// a builtin command
+	HIST_SPAWN,			// fork/zygote until the parent continues
+	HIST_WAIT,			// waiting for a foreground job
+	HIST_REAP,			// one run of the SIGCHLD handler
+	NUM_HISTS,
+
+} METRIC_HIST;
+
+typedef enum METRIC_COUNTER
+{
+	CNT_COMMANDS,
+	CNT_BUILTINS,
+	CNT_SPAWNS,
+	CNT_SPAWN_FAILURES,
+	CNT_SIGCHLD,
+	CNT_REAPED,
+	CNT_GLOB_HITS,		// directory listings reused by the glob cache
+	CNT_GLOB_MISSES,
+	CNT_SCRIPT_HITS,	// scripts run from their compiled form
+	CNT_SCRIPT_MISSES,
+	NUM_COUNTERS,
+
+} METRIC_COUNTER;
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+/**
+ * metricsNow function
+ * @return CLOCK_MONOTONIC in ns (vDSO, no syscall)
+ */
+static inline unsigned long long metricsNow()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#ifndef SMASH_NO_METRICS
+/**
+ * metricsStart function
+ * @return the start time to pass to metricsRecord
+ */
+static inline unsigned long long metricsStart()
+{
+	return metricsNow();
+}
+void metricsRecord(METRIC_HIST hist, unsigned long long start_ns);
+void metricsCount(METRIC_COUNTER counter);
+#else
+// build with -DSMASH_NO_METRICS to measure what the instrumentation costs
+static inline unsigned long long metricsStart() { return 0; }
+static inline void metricsRecord(METRIC_HIST hist, unsigned long long start_ns) {}
+static inline void metricsCount(METRIC_COUNTER counter) {}
+#endif
+void metricsPrint();
+int  metricsFile(const char* path, int period_secs);
+
+
+#endif
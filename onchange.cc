@@ -0,0 +1,399 @@
+/* ####################################################################################
+ *                                  ONCHANGE.CC
+ *  onchange [-r] [-d MS] PATH... -- cmd: runs cmd as a background job whenever PATH
+ *  changed, once the changes settled for MS milliseconds.
+ *
+ *  Every registration shares one inotify fd in the event loop, however many files are
+ *  watched; a path watched twice is one inotify watch with two owners. With -r the
+ *  directories under PATH are watched too, including the ones created later. A change
+ *  (re)arms the registration's timerfd, so a burst of events ends in one run. The run
+ *  waits for smash to be idle at the prompt and goes through RunCmd like a typed
+ *  "cmd &", and it is not started again while its previous job is still in the job
+ *  table: a change meanwhile is marked pending on the registration, and run when
+ *  removeJob reports that job gone (onchangeJobDone). Nothing polls the job table.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <algorithm>
+#include <map>
+#include "commands.h"
+#include "eventloop.h"
+#include "onchange.h"
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define ONCHANGE_MASK (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | \
+					   IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF)
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern smashManager sm;
+
+static int inotify_fd = -1;
+static int next_id = 1;
+static map<int, OnChange*> watchers;		// by id
+static map<int, vector<int> > wd_owners;	// inotify watch -> ids of the registrations on it
+static map<int, string> wd_path;
+static int num_pending = 0;				// registrations waiting for their last job to go
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static OnChange* find_watcher(int id);
+static bool add_watch(OnChange* w, const string& path);
+static void add_tree(OnChange* w, const string& path);
+static void forget_wd(int wd);
+static void changed(OnChange* w, int ms);
+static void inotify_handler(int fd, unsigned int events, void* ctx);
+static void timer_handler(int fd, unsigned int events, void* ctx);
+static void launch(void* ctx);
+
+
+/**
+ * find_watcher function
+ * @param id
+ * @return the registration, NULL if it was removed
+ */
+static OnChange* find_watcher(int id)
+{
+	map<int, OnChange*>::iterator w = watchers.find(id);
+	return (w != watchers.end()) ? w->second : NULL;
+}
+/****************************************************************************************/
+/**
+ * add_watch function
+ * @param w
+ * @param path
+ * @return true if path is watched for w
+ */
+static bool add_watch(OnChange* w, const string& path)
+{
+	int wd = inotify_add_watch(inotify_fd, path.c_str(), ONCHANGE_MASK);
+	if (wd == -1)
+	{
+		perror(path.c_str());
+		return false;
+	}
+	vector<int>& owners = wd_owners[wd];
+	if (find(owners.begin(), owners.end(), w->id) == owners.end())
+	{
+		owners.push_back(w->id);
+		w->wds.push_back(wd);
+	}
+	wd_path[wd] = path;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * add_tree function
+ * watches path, and if it is a directory every directory under it (symlinks are not followed)
+ * @param w
+ * @param path
+ */
+static void add_tree(OnChange* w, const string& path)
+{
+	if (!add_watch(w, path))
+		return;
+	DIR* dir = opendir(path.c_str());
+	if (dir == NULL)
+		return;
+	struct dirent* e;
+	while ((e = readdir(dir)) != NULL)
+	{
+		if (!strcmp(e->d_name, ".") || !strcmp(e->d_name, ".."))
+			continue;
+		string sub = path + "/" + e->d_name;
+		bool is_dir = (e->d_type == DT_DIR);
+		struct stat st;
+		if (e->d_type == DT_UNKNOWN && lstat(sub.c_str(), &st) == 0)
+			is_dir = S_ISDIR(st.st_mode);
+		if (is_dir)
+			add_tree(w, sub);
+	}
+	closedir(dir);
+}
+/****************************************************************************************/
+/**
+ * forget_wd function
+ * drops an inotify watch the kernel removed (its file is gone)
+ * @param wd
+ */
+static void forget_wd(int wd)
+{
+	map<int, vector<int> >::iterator o = wd_owners.find(wd);
+	if (o == wd_owners.end())
+		return;
+	for (size_t i = 0; i < o->second.size(); i++)
+	{
+		OnChange* w = find_watcher(o->second[i]);
+		if (w != NULL)
+			w->wds.erase(remove(w->wds.begin(), w->wds.end(), wd), w->wds.end());
+	}
+	wd_owners.erase(o);
+	wd_path.erase(wd);
+}
+/****************************************************************************************/
+/**
+ * changed function
+ * (re)arms w's timer, so that it fires ms after the last change
+ * @param w
+ * @param ms
+ */
+static void changed(OnChange* w, int ms)
+{
+	struct itimerspec when;
+	memset(&when, 0, sizeof(when));
+	when.it_value.tv_sec = ms / 1000;
+	when.it_value.tv_nsec = (ms % 1000) * 1000000L + 1;	// 0 would disarm it
+	timerfd_settime(w->timer_fd, 0, &when, NULL);
+}
+/****************************************************************************************/
+/**
+ * inotify_handler function
+ * @param fd
+ * @param events
+ * @param ctx
+ */
+static void inotify_handler(int fd, unsigned int events, void* ctx)
+{
+	char buf[ONCHANGE_READ_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+	{
+		const struct inotify_event* ev;
+		for (char* p = buf; p < buf + n; p += sizeof(struct inotify_event) + ev->len)
+		{
+			ev = (const struct inotify_event*)p;
+			if (ev->mask & IN_Q_OVERFLOW)
+			{
+				// events were lost, any registration may have changed
+				for (map<int, OnChange*>::iterator w = watchers.begin(); w != watchers.end(); ++w)
+					changed(w->second, w->second->debounce_ms);
+				continue;
+			}
+			map<int, vector<int> >::iterator o = wd_owners.find(ev->wd);
+			if (o == wd_owners.end())
+				continue;
+			if (ev->mask & IN_IGNORED)
+			{
+				forget_wd(ev->wd);
+				continue;
+			}
+			vector<int> owners = o->second;		// add_tree below may add watches
+			for (size_t i = 0; i < owners.size(); i++)
+			{
+				OnChange* w = find_watcher(owners[i]);
+				if (w == NULL)
+					continue;
+				if (w->recursive && (ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO)) && ev->len > 0)
+					add_tree(w, wd_path[ev->wd] + "/" + ev->name);
+				changed(w, w->debounce_ms);
+			}
+		}
+	}
+}
+/****************************************************************************************/
+/**
+ * timer_handler function
+ * the changes settled: queue a run, or mark it pending while the previous one is still a job
+ * @param fd
+ * @param events
+ * @param ctx the registration id
+ */
+static void timer_handler(int fd, unsigned int events, void* ctx)
+{
+	uint64_t expirations;
+	(void)read(fd, &expirations, sizeof(expirations));
+	OnChange* w = find_watcher((int)(intptr_t)ctx);
+	if (w == NULL || w->queued)
+		return;
+	if (w->pid != -1 && sm.getJobBbPID(w->pid) != sm.jobs.end())
+	{
+		// onchangeJobDone runs it once that job is gone
+		if (!w->pending)
+		{
+			w->pending = true;
+			num_pending++;
+		}
+		return;
+	}
+	w->queued = true;
+	evDefer(launch, ctx);
+}
+/****************************************************************************************/
+/**
+ * launch function
+ * runs the registration's command as a background job, when smash is idle at the prompt
+ * @param ctx the registration id
+ */
+static void launch(void* ctx)
+{
+	OnChange* w = find_watcher((int)(intptr_t)ctx);
+	if (w == NULL)
+		return;
+	w->queued = false;
+	char lineSize[MAX_LINE_SIZE];
+	char cmdString[MAX_LINE_SIZE];
+	strcpy(lineSize, w->line.c_str());
+	strcpy(cmdString, lineSize);
+	pid_t last = sm.jobs.empty() ? -1 : sm.jobs.back().pid;
+	RunCmd(lineSize, cmdString);
+	if (!sm.jobs.empty() && sm.jobs.back().pid != last)
+		w->pid = sm.jobs.back().pid;
+	w->runs++;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * onchangeAdd function
+ * @param paths
+ * @param recursive
+ * @param debounce_ms
+ * @param line the command, without the "&"
+ * @return the id of the new registration, -1 if no path could be watched
+ */
+int onchangeAdd(const vector<string>& paths, bool recursive, int debounce_ms, const string& line)
+{
+	if (line.length() + 2 >= MAX_LINE_SIZE)
+	{
+		cout << "onchange: command too long" << endl;
+		return -1;
+	}
+	if (inotify_fd == -1)
+	{
+		inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (inotify_fd == -1)
+		{
+			perror("inotify_init1");
+			return -1;
+		}
+		if (!evAdd(inotify_fd, EPOLLIN, inotify_handler, NULL))
+		{
+			close(inotify_fd);
+			inotify_fd = -1;
+			return -1;
+		}
+	}
+
+	OnChange* w = new OnChange(next_id, line + " &", debounce_ms, recursive);
+	watchers[w->id] = w;
+	w->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (w->timer_fd == -1 || !evAdd(w->timer_fd, EPOLLIN, timer_handler, (void*)(intptr_t)w->id))
+	{
+		if (w->timer_fd == -1)
+			perror("timerfd_create");
+		onchangeRemove(w->id);
+		return -1;
+	}
+	for (size_t i = 0; i < paths.size(); i++)
+	{
+		if (recursive)
+			add_tree(w, paths[i]);
+		else
+			add_watch(w, paths[i]);
+	}
+	if (w->wds.empty())
+	{
+		onchangeRemove(w->id);
+		return -1;
+	}
+	return next_id++;
+}
+/****************************************************************************************/
+/**
+ * onchangeRemove function
+ * @param id
+ * @return false if there is no such registration
+ */
+bool onchangeRemove(int id)
+{
+	OnChange* w = find_watcher(id);
+	if (w == NULL)
+		return false;
+	for (size_t i = 0; i < w->wds.size(); i++)
+	{
+		vector<int>& owners = wd_owners[w->wds[i]];
+		owners.erase(remove(owners.begin(), owners.end(), id), owners.end());
+		if (owners.empty())
+		{
+			inotify_rm_watch(inotify_fd, w->wds[i]);
+			wd_owners.erase(w->wds[i]);
+			wd_path.erase(w->wds[i]);
+		}
+	}
+	if (w->timer_fd != -1)
+	{
+		evDel(w->timer_fd);
+		close(w->timer_fd);
+	}
+	if (w->pending)
+		num_pending--;
+	watchers.erase(id);
+	delete w;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * onchangePrint function
+ * lists the registrations: "[id] cmd : N watches, MS ms, R runs"
+ */
+void onchangePrint()
+{
+	for (map<int, OnChange*>::iterator i = watchers.begin(); i != watchers.end(); ++i)
+	{
+		OnChange* w = i->second;
+		cout << "[" << w->id << "] " << w->line.substr(0, w->line.length() - 2) << " : " << w->wds.size()
+			 << " watches, " << w->debounce_ms << " ms, " << w->runs << " runs";
+		if (w->pid != -1 && sm.getJobBbPID(w->pid) != sm.jobs.end())
+			cout << ", running";
+		cout << endl;
+	}
+}
+/****************************************************************************************/
+/**
+ * onchangeJobDone function
+ * a job left the job table: the registrations whose change waited for it queue their run
+ * @param pid of the job
+ */
+void onchangeJobDone(pid_t pid)
+{
+	if (num_pending == 0)
+		return;
+	for (map<int, OnChange*>::iterator i = watchers.begin(); i != watchers.end(); ++i)
+	{
+		OnChange* w = i->second;
+		if (!w->pending || w->pid != pid)
+			continue;
+		w->pending = false;
+		num_pending--;
+		if (!w->queued)
+		{
+			w->queued = true;
+			evDefer(launch, (void*)(intptr_t)w->id);
+		}
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef _ONCHANGE_H
+#define _ONCHANGE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define ONCHANGE_DEFAULT_MS 100
+#define ONCHANGE_READ_SIZE 65536
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * one onchange registration: a command run as a background job after its paths changed
+ */
+class OnChange
+{
+	public:
+		int id;
+		string line;			// the command line, run through RunCmd
+		int debounce_ms;
+		bool recursive;
+		int timer_fd;			// armed by every change, fires once they settle
+		vector<int> wds;		// its inotify watches
+		pid_t pid;				// its last job, -1 if none yet
+		bool queued;			// a run waits for smash to be idle
+		bool pending;			// a change settled while its last job was in the table
+		unsigned long runs;
+
+		OnChange(int my_id, const string& command, int ms, bool rec)
+		{
+			id = my_id;
+			line = command;
+			debounce_ms = ms;
+			recursive = rec;
+			timer_fd = -1;
+			pid = -1;
+			queued = false;
+			pending = false;
+			runs = 0;
+		}
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  onchangeAdd(const vector<string>& paths, bool recursive, int debounce_ms, const string& line);
+bool onchangeRemove(int id);
+void onchangePrint();
+void onchangeJobDone(pid_t pid);
+
+
+#endif
@@ -0,0 +1,449 @@
+/* ####################################################################################
+ *                                  PARSER.CC
+ *  Splits a command line into a CmdList in one pass. Words are separated by blanks
+ *  and end in place (like strtok), ";", "&&" and "||" join commands whether or not
+ *  blanks surround them, and a final "&" makes the whole list a background job.
+ *  smash has no quoting, so every other character is part of a word.
+ *
+ *  $NAME, ${NAME}, $? and $$, $(cmd), then globs (see pathglob.cc) are expanded by
+ *  expandItem when the command is about to run, so "a=1; echo $a" and "false; echo $?"
+ *  see what the previous commands did. A word that expands to nothing is dropped, like
+ *  an unquoted one in sh, and the output of $(cmd) is split into words at blanks.
+ *  Inside $(...) blanks and operators belong to the inner command.
+ *
+ *  A command may have one here-document (<<WORD) or here-string (<<<word) as its stdin.
+ *  The parser only notes it; RunCmd reads the body, and the text is expanded like a
+ *  word (without splitting or globbing) when the command runs.
+ *
+ *  "name() { list }" defines a function and is recognized before the line is parsed
+ *  as a list (parseFunction). Its body may go on over the next lines, up to a "}".
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <ctype.h>
+#include <string.h>
+#include "parser.h"
+#include "pathglob.h"
+#include "vars.h"
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static CmdItem* next_item(CmdList& list, LIST_OP op);
+static const char* expand_name(const char* p, const char** value);
+static const char* subst_end(const char* p);
+static const char* expand_ref(const char* p, const char** value, string& subst);
+static void end_word(CmdList& list, size_t start);
+
+
+/**
+ * next_item function
+ * @param list
+ * @param op how the new item joins the previous one
+ * @return a cleared item at the end of the list
+ */
+static CmdItem* next_item(CmdList& list, LIST_OP op)
+{
+	if (list.num_items == list.items.size())
+		list.items.push_back(CmdItem());
+	CmdItem* item = &list.items[list.num_items++];
+	item->num_arg = 0;
+	item->args[0] = NULL;
+	item->argc = 0;
+	item->op = op;
+	item->expand = false;
+	item->here_kind = HERE_NONE;
+	item->here_word = NULL;
+	return item;
+}
+/****************************************************************************************/
+/**
+ * subst_end function
+ * @param p points at "$("
+ * @return the ")" that closes it, NULL if there is none
+ */
+static const char* subst_end(const char* p)
+{
+	int depth = 0;
+	for (p++; *p; p++)
+	{
+		if (*p == '(')
+			depth++;
+		else if (*p == ')' && --depth == 0)
+			return p;
+	}
+	return NULL;
+}
+/****************************************************************************************/
+/**
+ * end_word function
+ * terminates the word that starts at start in list.words, and adds it - or the paths it
+ * matches if it is a glob pattern - to list.offsets
+ * @param list
+ * @param start
+ */
+static void end_word(CmdList& list, size_t start)
+{
+	static string pattern;	// the words may move while it is globbed
+	list.words.push_back('\0');
+	if (pathGlobMagic(&list.words[start]))
+	{
+		pattern = &list.words[start];
+		if (pathGlob(pattern.c_str(), list.words, list.offsets) > 0)
+			return;
+	}
+	list.offsets.push_back(start);
+}
+/****************************************************************************************/
+/**
+ * expand_name function
+ * @param p points at a "$"
+ * @param value receives the value of the variable, NULL if it is not set
+ * @return the end of the reference, p if it is none (a "$" alone stays a "$")
+ */
+static const char* expand_name(const char* p, const char** value)
+{
+	const char* name = p + 1;
+	const char* end;
+	if ((*name != '\0' && strchr("?$#@*", *name) != NULL) || isdigit((unsigned char)*name))
+	{
+		end = name + 1;
+		*value = varLookup(name, 1);
+		return end;
+	}
+	if (*name == '{')
+	{
+		end = strchr(++name, '}');
+		if (end == NULL || !varIsName(name, end - name))
+			return p;
+		*value = varLookup(name, end - name);
+		return end + 1;
+	}
+	for (end = name; *end == '_' || isalnum((unsigned char)*end); end++)
+		;
+	if (!varIsName(name, end - name))
+		return p;
+	*value = varLookup(name, end - name);
+	return end;
+}
+
+
+/****************************************************************************************/
+/**
+ * expand_ref function
+ * @param p points at a "$"
+ * @param value receives the value of the reference, NULL if it is an unset variable
+ * @param subst holds the output of a $(cmd)
+ * @return the end of the reference, p if it is none or a "$(" that is not closed
+ */
+static const char* expand_ref(const char* p, const char** value, string& subst)
+{
+	if (p[1] != '(')
+		return expand_name(p, value);
+	const char* end = subst_end(p);
+	if (end == NULL)
+		return p;	// not closed: the text stays as it is
+	CaptureCmd(string(p + 2, end - p - 2).c_str(), subst);
+	*value = subst.c_str();
+	return end + 1;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * parseLine function
+ * @param line changed in place, list points into it
+ * @param list receives the commands, no items for a blank line
+ * @return false on a syntax error: an empty command before an operator, "&" before the end,
+ * "&&"/"||" at the end, a "$(" that is not closed, or a second or empty "<<"
+ */
+bool parseLine(char* line, CmdList& list)
+{
+	list.num_items = 0;
+	list.background = false;
+	CmdItem* item = next_item(list, OP_SEQ);
+	bool in_word = false;
+	for (char* p = line; *p; p++)
+	{
+		char c = *p;
+		if (c == ' ' || c == '\t' || c == '\n')
+		{
+			*p = '\0';
+			in_word = false;
+			continue;
+		}
+		LIST_OP op;
+		if (c == ';')
+			op = OP_SEQ;
+		else if (c == '&' && p[1] == '&')
+			op = OP_AND;
+		else if (c == '|' && p[1] == '|')
+			op = OP_OR;
+		else if (c == '<' && p[1] == '<')
+		{
+			*p = '\0';
+			HERE_KIND kind = (p[2] == '<') ? HERE_STRING : HERE_DOC;
+			p += (kind == HERE_STRING) ? 3 : 2;
+			p += strspn(p, " \t\n");
+			char* word = p;
+			for (; *p && !strchr(" \t\n;&", *p) && !(p[0] == '|' && p[1] == '|'); p++)
+			{
+				if (p[0] == '$' && p[1] == '(' && (p = (char*)subst_end(p)) == NULL)
+					return false;
+			}
+			if (p == word || item->here_kind != HERE_NONE)
+				return false;
+			item->here_kind = kind;
+			item->here_word = word;
+			in_word = false;
+			p--;	// the loop ends the word
+			continue;
+		}
+		else if (c == '&')
+		{
+			// only at the end of the line
+			*p = '\0';
+			if (item->num_arg == 0 || p[1 + strspn(p + 1, " \t\n")] != '\0')
+				return false;
+			list.background = true;
+			break;
+		}
+		else
+		{
+			if (!in_word && item->num_arg < MAX_NUM_OF_ARG - 1)
+			{
+				item->args[item->num_arg++] = p;
+				item->args[item->num_arg] = NULL;
+				item->argc = item->num_arg;
+			}
+			if (c == '$' || c == '*' || c == '?' || c == '[')
+				item->expand = true;
+			if (c == '$' && p[1] == '(')
+			{
+				p = (char*)subst_end(p);
+				if (p == NULL)
+					return false;
+			}
+			in_word = true;
+			continue;
+		}
+
+		*p = '\0';
+		if (op != OP_SEQ)
+			*++p = '\0';
+		in_word = false;
+		if (item->num_arg == 0)
+			return false;
+		item = next_item(list, op);
+	}
+
+	if (item->num_arg == 0)
+	{
+		// "a;" ends with an empty command, "a &&" lacks one
+		if (item->op != OP_SEQ)
+			return false;
+		list.num_items--;
+	}
+	// not while items may still move
+	for (size_t i = 0; i < list.num_items; i++)
+		list.items[i].argv = list.items[i].args;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * parseFunction function
+ * recognizes a function definition: "name() { list }", or "name() {" with the body on the next lines
+ * @param line changed in place when it is one: name and body are NUL terminated
+ * @param name receives the name
+ * @param body receives the body, without its braces
+ * @param open set to true if the body is not closed on this line
+ * @return false if line is not a function definition
+ */
+bool parseFunction(char* line, char** name, char** body, bool* open)
+{
+	char* start = line + strspn(line, " \t\n");
+	char* p = start;
+	while (*p == '_' || isalnum((unsigned char)*p))
+		p++;
+	if (!varIsName(start, p - start))
+		return false;
+	char* name_end = p;
+	p += strspn(p, " \t");
+	if (p[0] != '(' || p[1] != ')')
+		return false;
+	p += 2;
+	p += strspn(p, " \t\n");
+	if (*p != '{')
+		return false;
+	*name_end = '\0';
+	*name = start;
+	*body = p + 1;
+	*open = !parseBodyEnd(*body);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * parseBodyEnd function
+ * @param line a line of a function body
+ * @return true if it ends the body: its last word is "}". The brace is then removed.
+ */
+bool parseBodyEnd(char* line)
+{
+	size_t len = strlen(line);
+	while (len > 0 && strchr(" \t\n", line[len - 1]) != NULL)
+		len--;
+	if (len == 0 || line[len - 1] != '}' || (len > 1 && strchr(" \t\n;", line[len - 2]) == NULL))
+		return false;
+	line[len - 1] = '\0';
+	return true;
+}
+/****************************************************************************************/
+/**
+ * parseBodyLine function
+ * adds a line to a function body that goes on over several lines: they are the commands of one list
+ * @param body
+ * @param line without its newline
+ */
+void parseBodyLine(string& body, const char* line)
+{
+	if (line[strspn(line, " \t")] == '\0')
+		return;
+	size_t last = body.find_last_not_of(" \t\n");
+	if (last != string::npos && body[last] != ';' && body[last] != '&' && body[last] != '|')
+		body += ';';
+	body += ' ';
+	body += line;
+}
+/****************************************************************************************/
+/**
+ * parseFunctionBody function
+ * @param body
+ * @return a function that runs body, NULL if it is not a valid list. Here-documents, which
+ * would read their body at each call, and "&" are not allowed in it.
+ */
+ShellFunction* parseFunctionBody(const string& body)
+{
+	ShellFunction* f = new ShellFunction();
+	f->text.assign(body.c_str(), body.c_str() + body.size() + 1);
+	bool valid = parseLine(&f->text[0], f->body) && f->body.num_items > 0 && !f->body.background;
+	for (size_t i = 0; valid && i < f->body.num_items; i++)
+		valid = (f->body.items[i].here_kind != HERE_DOC);
+	if (!valid)
+	{
+		delete f;
+		return NULL;
+	}
+	return f;
+}
+/****************************************************************************************/
+/**
+ * copyFunction function
+ * @param f
+ * @return a copy of f, without parsing it again: the words are moved to the copy's text
+ */
+ShellFunction* copyFunction(const ShellFunction* f)
+{
+	ShellFunction* copy = new ShellFunction();
+	copy->text = f->text;
+	copy->body.items.assign(f->body.items.begin(), f->body.items.begin() + f->body.num_items);
+	copy->body.num_items = f->body.num_items;
+	const char* from = &f->text[0];
+	char* to = &copy->text[0];
+	for (size_t i = 0; i < copy->body.num_items; i++)
+	{
+		CmdItem& item = copy->body.items[i];
+		for (int j = 0; j < item.num_arg; j++)
+			item.args[j] = to + (item.args[j] - from);
+		if (item.here_word != NULL)
+			item.here_word = to + (item.here_word - from);
+		item.argv = item.args;
+	}
+	return copy;
+}
+/****************************************************************************************/
+/**
+ * expandItem function
+ * replaces the variable references and $(cmd) in item's words, then the words with glob
+ * characters by the paths they match (a pattern that matches nothing stays as it is).
+ * The new words are in list, which the next call reuses.
+ * @param list
+ * @param item its argv and argc are set
+ */
+void expandItem(CmdList& list, CmdItem& item)
+{
+	string subst;
+	list.words.clear();
+	list.offsets.clear();
+	for (int i = 0; i < item.num_arg; i++)
+	{
+		size_t start = list.words.size();
+		bool expanded = false;
+		for (const char* p = item.args[i]; *p; )
+		{
+			const char* value = NULL;
+			const char* end = (*p == '$') ? expand_ref(p, &value, subst) : p;
+			if (end == p)
+			{
+				list.words.push_back(*p++);
+				continue;
+			}
+			expanded = true;
+			for (; value != NULL && *value; value++)
+			{
+				// the output of $(cmd), $@ and $* are split at blanks
+				bool split = (p[1] == '(' || p[1] == '@' || p[1] == '*');
+				if (!split || (*value != ' ' && *value != '\t' && *value != '\n'))
+					list.words.push_back(*value);
+				else if (list.words.size() > start)
+				{
+					end_word(list, start);
+					start = list.words.size();
+				}
+			}
+			p = end;
+		}
+		if (expanded && list.words.size() == start)
+			continue;
+		end_word(list, start);
+	}
+
+	list.argv.clear();
+	for (size_t i = 0; i < list.offsets.size(); i++)
+		list.argv.push_back(&list.words[list.offsets[i]]);
+	list.argv.push_back(NULL);
+	item.argv = &list.argv[0];
+	item.argc = list.offsets.size();
+}
+/****************************************************************************************/
+/**
+ * expandText function
+ * replaces the variable references and $(cmd) in text, for here-documents and here-strings
+ * @param text
+ * @param out receives the expanded text
+ */
+void expandText(const char* text, string& out)
+{
+	string subst;
+	out.clear();
+	for (const char* p = text; *p; )
+	{
+		const char* value = NULL;
+		const char* end = (*p == '$') ? expand_ref(p, &value, subst) : p;
+		if (end == p)
+		{
+			out += *p++;
+			continue;
+		}
+		if (value != NULL)
+			out += value;
+		p = end;
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef _PARSER_H
+#define _PARSER_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <string>
+#include <vector>
+#include "commands.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+typedef enum LIST_OP
+{
+	OP_SEQ,		// ;  runs whatever the previous status
+	OP_AND,		// && runs if the previous status is 0
+	OP_OR,		// || runs if it is not
+
+} LIST_OP;
+
+typedef enum HERE_KIND
+{
+	HERE_NONE,
+	HERE_DOC,		// <<WORD: the lines after the command, up to WORD
+	HERE_STRING,	// <<<word: word and a newline
+
+} HERE_KIND;
+
+/**
+ * one simple command of a list. args points into the parsed line and ends with NULL.
+ */
+struct CmdItem
+{
+	char* args[MAX_NUM_OF_ARG];
+	int num_arg;
+	LIST_OP op;		// joins it to the previous item, OP_SEQ for the first one
+	bool expand;	// has a "$" or a glob character, see expandItem
+	char** argv;	// the words to run: args, or after expandItem the expanded words
+	int argc;
+	HERE_KIND here_kind;	// its stdin
+	char* here_word;		// the delimiter of a here-document, the word of a here-string
+	string here;			// the body of a here-document, once it was read
+};
+
+/**
+ * a parsed command line: "a && b || c; d", with "&" at the end it is one background job.
+ * Kept and reused from line to line, so parsing does not allocate once it has grown.
+ */
+class CmdList
+{
+	public:
+		vector<CmdItem> items;
+		size_t num_items;		// items[0, num_items) belong to the current line
+		bool background;
+		// the words made by expandItem, for one item at a time
+		vector<char> words;
+		vector<size_t> offsets;
+		vector<char*> argv;
+
+		CmdList()
+		{
+			num_items = 0;
+			background = false;
+		}
+};
+
+/**
+ * a shell function, "name() { list }": its body is parsed once, when it is defined.
+ * Not copied, since body points into text.
+ */
+class ShellFunction
+{
+	public:
+		vector<char> text;	// the body, parsed in place
+		CmdList body;
+		int running;		// calls in progress; a function redefined meanwhile is freed after them
+
+		ShellFunction()
+		{
+			running = 0;
+		}
+};
+
+/**
+ * an alias: the words that replace the name of a command, split once, when it is defined
+ */
+class ShellAlias
+{
+	public:
+		vector<char> words;		// NUL terminated, one after the other
+		vector<char*> argv;		// points into words
+		string value;			// the words joined by blanks, for listing
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool parseLine(char* line, CmdList& list);
+bool parseFunction(char* line, char** name, char** body, bool* open);
+bool parseBodyEnd(char* line);
+void parseBodyLine(string& body, const char* line);
+ShellFunction* parseFunctionBody(const string& body);
+ShellFunction* copyFunction(const ShellFunction* f);
+void expandItem(CmdList& list, CmdItem& item);
+void expandText(const char* text, string& out);
+
+
+#endif
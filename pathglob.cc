@@ -0,0 +1,397 @@
+/* ####################################################################################
+ *                                  PATHGLOB.CC
+ *  Pathname expansion: *, ?, [...] in every component of a path, and ** for any number
+ *  of directories (hidden ones and symlinks to directories excluded, like bash's
+ *  globstar). Directories are read with openat and getdents64 directly, so d_type
+ *  spares a stat per entry, and each step down is relative to its parent's fd.
+ *
+ *  With the listing cache on (smash --glob-cache), a listing is kept per directory,
+ *  keyed by (dev, ino), and reused as long as the directory's mtime did not change:
+ *  one fstat instead of reading 100k entries again. A listing read within
+ *  GLOB_RACY_NS of its mtime is not kept, since a change in the same clock tick
+ *  would not move the mtime.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include "metrics.h"
+#include "pathglob.h"
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define GLOB_SPECIAL "*?[\\"		// ends the literal part of a pattern
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+/**
+ * a getdents64 record
+ */
+struct LinuxDirent64
+{
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+/**
+ * one pathGlob call
+ */
+struct GlobRun
+{
+	vector<string> comps;		// the pattern's components, "" last if it ends with "/"
+	string path;				// the directory being matched, "" or ending with "/"
+	vector<char>* words;
+	vector<size_t>* offsets;
+};
+
+/**
+ * orders the offsets of words by name
+ */
+struct ByName
+{
+	const vector<char>* words;
+
+	bool operator()(size_t a, size_t b) const
+	{
+		return strcmp(&(*words)[a], &(*words)[b]) < 0;
+	}
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static bool cache_on = false;
+static map<pair<dev_t, ino_t>, DirListing*> cache;
+static size_t cache_names = 0;
+static vector<DirListing*> scratch;		// listings of the current call that are not cached
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static bool read_dir(int fd, DirListing* l);
+static DirListing* list_dir(int fd);
+static void drop_cache();
+static bool is_dir(int dirfd, const char* name, unsigned char type, bool follow);
+static void emit(GlobRun& run, const char* name);
+static void descend(GlobRun& run, int dirfd, const char* name, size_t ci);
+static void match(GlobRun& run, int dirfd, size_t ci);
+
+
+/**
+ * read_dir function
+ * @param fd an open directory
+ * @param l receives its entries
+ * @return false if it could not be read
+ */
+static bool read_dir(int fd, DirListing* l)
+{
+	static char buf[GLOB_DENTS_SIZE] __attribute__((aligned(8)));
+	long n;
+	lseek(fd, 0, SEEK_SET);		// ** lists a directory twice
+	while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0)
+	{
+		for (long pos = 0; pos < n; )
+		{
+			LinuxDirent64* d = (LinuxDirent64*)(buf + pos);
+			pos += d->d_reclen;
+			if (d->d_name[0] == '.' && (d->d_name[1] == '\0' || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+				continue;
+			size_t len = strlen(d->d_name) + 1;
+			l->offsets.push_back(l->names.size());
+			l->names.insert(l->names.end(), d->d_name, d->d_name + len);
+			l->types.push_back(d->d_type);
+		}
+	}
+	return n == 0;
+}
+/****************************************************************************************/
+/**
+ * list_dir function
+ * @param fd an open directory
+ * @return its entries, from the cache if its mtime did not change. Valid until pathGlob returns.
+ */
+static DirListing* list_dir(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+		return NULL;
+	pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+	map<pair<dev_t, ino_t>, DirListing*>::iterator c = cache.end();
+	if (cache_on)
+	{
+		c = cache.find(key);
+		if (c != cache.end() && c->second->mtime.tv_sec == st.st_mtim.tv_sec &&
+			c->second->mtime.tv_nsec == st.st_mtim.tv_nsec)
+		{
+			metricsCount(CNT_GLOB_HITS);
+			return c->second;
+		}
+		metricsCount(CNT_GLOB_MISSES);
+	}
+
+	DirListing* l = new DirListing();
+	l->mtime = st.st_mtim;
+	if (!read_dir(fd, l))
+	{
+		delete l;
+		return NULL;
+	}
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	long long age = (now.tv_sec - st.st_mtim.tv_sec) * 1000000000LL + (now.tv_nsec - st.st_mtim.tv_nsec);
+	if (!cache_on || age < GLOB_RACY_NS)
+	{
+		scratch.push_back(l);
+		return l;
+	}
+	if (c != cache.end())
+	{
+		// an outer directory of this call may still be going through the old one
+		cache_names -= c->second->offsets.size();
+		scratch.push_back(c->second);
+		c->second = l;
+	}
+	else
+	{
+		cache[key] = l;
+	}
+	cache_names += l->offsets.size();
+	return l;
+}
+/****************************************************************************************/
+/**
+ * drop_cache function
+ */
+static void drop_cache()
+{
+	for (map<pair<dev_t, ino_t>, DirListing*>::iterator c = cache.begin(); c != cache.end(); ++c)
+		delete c->second;
+	cache.clear();
+	cache_names = 0;
+}
+/****************************************************************************************/
+/**
+ * is_dir function
+ * @param dirfd
+ * @param name an entry of dirfd
+ * @param type its d_type
+ * @param follow if true, a symlink to a directory counts
+ * @return true if name is a directory
+ */
+static bool is_dir(int dirfd, const char* name, unsigned char type, bool follow)
+{
+	if (type == DT_DIR)
+		return true;
+	if (type != DT_UNKNOWN && !(type == DT_LNK && follow))
+		return false;
+	struct stat st;
+	return fstatat(dirfd, name, &st, follow ? 0 : AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+}
+/****************************************************************************************/
+/**
+ * emit function
+ * adds a match: the current directory followed by name
+ * @param run
+ * @param name
+ */
+static void emit(GlobRun& run, const char* name)
+{
+	run.offsets->push_back(run.words->size());
+	run.words->insert(run.words->end(), run.path.begin(), run.path.end());
+	run.words->insert(run.words->end(), name, name + strlen(name) + 1);
+}
+/****************************************************************************************/
+/**
+ * descend function
+ * matches the components from ci on inside the directory name
+ * @param run
+ * @param dirfd
+ * @param name
+ * @param ci
+ */
+static void descend(GlobRun& run, int dirfd, const char* name, size_t ci)
+{
+	int fd = openat(dirfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return;
+	size_t len = run.path.size();
+	run.path += name;
+	run.path += '/';
+	match(run, fd, ci);
+	run.path.resize(len);
+	close(fd);
+}
+/****************************************************************************************/
+/**
+ * match function
+ * @param run
+ * @param dirfd the directory run.path
+ * @param ci the component to match in it
+ */
+static void match(GlobRun& run, int dirfd, size_t ci)
+{
+	const string& comp = run.comps[ci];
+	bool last = (ci + 1 == run.comps.size());
+	if (comp.empty())
+	{
+		// the pattern ends with "/": the directory itself
+		emit(run, "");
+		return;
+	}
+	if (!pathGlobMagic(comp.c_str()))
+	{
+		struct stat st;
+		if (!last)
+			descend(run, dirfd, comp.c_str(), ci + 1);
+		else if (fstatat(dirfd, comp.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0)
+			emit(run, comp.c_str());
+		return;
+	}
+
+	bool globstar = (comp == "**");
+	if (globstar && !last)
+		match(run, dirfd, ci + 1);		// ** as no directory at all
+	DirListing* l = list_dir(dirfd);
+	if (l == NULL)
+		return;
+
+	// most patterns are "pre*suf": compared directly, without fnmatch
+	const char* pat = comp.c_str();
+	size_t prefix = strcspn(pat, GLOB_SPECIAL);
+	const char* suffix = pat + prefix + 1;
+	size_t suffix_len = strlen(suffix);
+	bool simple = (pat[prefix] == '*' && strcspn(suffix, GLOB_SPECIAL) == suffix_len);
+	for (size_t i = 0; i < l->offsets.size(); i++)
+	{
+		const char* name = &l->names[l->offsets[i]];
+		if (globstar)
+		{
+			if (name[0] == '.')
+				continue;
+			if (last)
+				emit(run, name);
+			if (is_dir(dirfd, name, l->types[i], false))
+				descend(run, dirfd, name, ci);
+			continue;
+		}
+		if (strncmp(name, pat, prefix) != 0)
+			continue;
+		if (simple)
+		{
+			size_t len = ((i + 1 < l->offsets.size()) ? l->offsets[i + 1] : l->names.size()) - l->offsets[i] - 1;
+			if ((prefix == 0 && name[0] == '.') || len < prefix + suffix_len ||
+				memcmp(name + len - suffix_len, suffix, suffix_len) != 0)
+				continue;
+		}
+		else if (fnmatch(pat, name, FNM_PERIOD) != 0)
+			continue;
+		if (last)
+			emit(run, name);
+		else if (is_dir(dirfd, name, l->types[i], true))
+			descend(run, dirfd, name, ci + 1);
+	}
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * pathGlobMagic function
+ * @param word
+ * @return true if word has a "*", a "?" or a "[...]"
+ */
+bool pathGlobMagic(const char* word)
+{
+	for (const char* p = word; *p; p++)
+	{
+		if (*p == '*' || *p == '?')
+			return true;
+		if (*p == '[' && strchr(p + 1, ']') != NULL)
+			return true;
+	}
+	return false;
+}
+/****************************************************************************************/
+/**
+ * pathGlob function
+ * @param pattern
+ * @param words the matches are added to it, NUL terminated
+ * @param offsets receives the offset of each match in words, sorted by name
+ * @return the number of matches
+ */
+size_t pathGlob(const char* pattern, vector<char>& words, vector<size_t>& offsets)
+{
+	if (cache_names > GLOB_CACHE_MAX_NAMES)
+		drop_cache();
+
+	static GlobRun run;		// reused, so that its vectors keep their capacity
+	run.comps.clear();
+	run.path = (pattern[0] == '/') ? "/" : "";
+	run.words = &words;
+	run.offsets = &offsets;
+	for (const char* p = pattern; *p; )
+	{
+		const char* slash = strchr(p, '/');
+		const char* end = (slash != NULL) ? slash : p + strlen(p);
+		if (end > p)
+			run.comps.push_back(string(p, end - p));
+		if (slash == NULL)
+			break;
+		p = slash + 1;
+		if (*p == '\0' && !run.comps.empty())
+			run.comps.push_back("");
+	}
+
+	size_t first = offsets.size();
+	int fd = open(run.path.empty() ? "." : "/", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd != -1)
+	{
+		if (!run.comps.empty())
+			match(run, fd, 0);
+		close(fd);
+	}
+	for (size_t i = 0; i < scratch.size(); i++)
+		delete scratch[i];
+	scratch.clear();
+
+	ByName by_name = { &words };
+	sort(offsets.begin() + first, offsets.end(), by_name);
+	return offsets.size() - first;
+}
+/****************************************************************************************/
+/**
+ * pathGlobCache function
+ * @param on turns the directory listing cache on or off (and drops it)
+ */
+void pathGlobCache(bool on)
+{
+	cache_on = on;
+	if (!on)
+		drop_cache();
+}
@@ -0,0 +1,49 @@
+#ifndef _PATHGLOB_H
+#define _PATHGLOB_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define GLOB_DENTS_SIZE 65536				// getdents64 buffer
+#define GLOB_CACHE_MAX_NAMES 2000000		// the cache is dropped when it holds more names
+#define GLOB_RACY_NS 1000000000LL			// a listing this close to its mtime is not cached
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * the entries of a directory, without "." and ".."
+ */
+class DirListing
+{
+	public:
+		struct timespec mtime;			// of the directory when it was read
+		vector<char> names;				// NUL terminated, one after the other
+		vector<uint32_t> offsets;		// of each name in names
+		vector<unsigned char> types;	// DT_* of each name
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool   pathGlobMagic(const char* word);
+size_t pathGlob(const char* pattern, vector<char>& words, vector<size_t>& offsets);
+void   pathGlobCache(bool on);
+
+
+#endif
@@ -0,0 +1,396 @@
+/* ####################################################################################
+ *                                  PROCSTAT.CC
+ *  Reads process state and resource usage from /proc/<pid>/stat
+ *
+ *  procSampleGroup sums the usage of a job's process group, for jobs --top. The
+ *  /proc files of every process it samples stay open and are read again with pread,
+ *  into the same static buffers, so a refresh of N jobs costs about 3N syscalls and
+ *  no allocation. The open files are kept in a fixed hash table by pid (linear
+ *  probing); the processes that do not fit are read without caching. The members of
+ *  the group are found from the leader down through /proc/<pid>/task/<pid>/children.
+ *  procSampleSweep closes the files of the processes that were not sampled since the
+ *  last sweep. A pid that was reused fails its cached read (ESRCH) and is opened again.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <vector>
+#include "procstat.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+typedef enum PROC_FILE
+{
+	PROC_STAT,
+	PROC_IO,
+	PROC_CHILDREN,
+	PROC_NUM_FILES,
+
+} PROC_FILE;
+
+/**
+ * the open /proc files of a sampled process, -1 for the ones not open
+ */
+struct ProcFds
+{
+	pid_t pid;				// 0: a free slot, or a process read without caching
+	int fd[PROC_NUM_FILES];
+	unsigned gen;			// the sweep it was last sampled in
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static ProcFds proc_fds[PROC_FDS_SLOTS];
+static int used_slots = 0;
+static ProcFds uncached;			// for a process that found no slot
+static unsigned sample_gen = 0;
+static int open_fds = 0;
+static int max_open_fds = -1;		// a quarter of RLIMIT_NOFILE, the rest are read without caching
+static char sample_buf[PROC_STAT_BUF_SIZE];
+static char io_buf[PROC_IO_BUF_SIZE];
+static char children_buf[PROC_CHILDREN_BUF_SIZE];
+static vector<pid_t> group;			// the members of the group being sampled
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void close_fds(ProcFds& p);
+static ProcFds* find_slot(pid_t pid);
+static void free_slot(ProcFds* p);
+static ssize_t read_proc(ProcFds& p, PROC_FILE file, pid_t pid, char* buf, size_t size);
+static ProcFds* sample_process(pid_t pid, pid_t pgid, ProcUsage* usage);
+static unsigned long long io_field(const char* buf, const char* name);
+
+
+/**
+ * close_fds function
+ * @param p
+ */
+static void close_fds(ProcFds& p)
+{
+	for (int i = 0; i < PROC_NUM_FILES; i++)
+	{
+		if (p.fd[i] != -1)
+		{
+			close(p.fd[i]);
+			p.fd[i] = -1;
+			open_fds--;
+		}
+	}
+}
+/****************************************************************************************/
+/**
+ * find_slot function
+ * @param pid
+ * @return the slot of pid, a new one with no open file if it had none, NULL if the table is full
+ */
+static ProcFds* find_slot(pid_t pid)
+{
+	unsigned i = (unsigned)pid & (PROC_FDS_SLOTS - 1);
+	while (proc_fds[i].pid != 0)
+	{
+		if (proc_fds[i].pid == pid)
+			return &proc_fds[i];
+		i = (i + 1) & (PROC_FDS_SLOTS - 1);
+	}
+	if (used_slots == PROC_FDS_MAX_USED)
+		return NULL;
+	used_slots++;
+	ProcFds& p = proc_fds[i];
+	p.pid = pid;
+	for (int f = 0; f < PROC_NUM_FILES; f++)
+		p.fd[f] = -1;
+	return &p;
+}
+/****************************************************************************************/
+/**
+ * free_slot function
+ * closes the files of a slot and frees it. The slots after it in its probe sequence move
+ * back, so that a lookup never stops at a hole before its pid.
+ * @param p
+ */
+static void free_slot(ProcFds* p)
+{
+	close_fds(*p);
+	unsigned hole = p - proc_fds;
+	unsigned i = hole;
+	while (1)
+	{
+		i = (i + 1) & (PROC_FDS_SLOTS - 1);
+		if (proc_fds[i].pid == 0)
+			break;
+		unsigned home = (unsigned)proc_fds[i].pid & (PROC_FDS_SLOTS - 1);
+		// it may fill the hole if its home is not in (hole, i], cyclically
+		if (((i - home) & (PROC_FDS_SLOTS - 1)) >= ((i - hole) & (PROC_FDS_SLOTS - 1)))
+		{
+			proc_fds[hole] = proc_fds[i];
+			hole = i;
+		}
+	}
+	proc_fds[hole].pid = 0;
+	used_slots--;
+}
+/****************************************************************************************/
+/**
+ * read_proc function
+ * reads one of the /proc files of pid from its start, opening it the first time
+ * @param p the open files of pid
+ * @param file
+ * @param pid
+ * @param buf receives the content, NUL terminated
+ * @param size of buf
+ * @return the length read, -1 if the process is gone
+ */
+static ssize_t read_proc(ProcFds& p, PROC_FILE file, pid_t pid, char* buf, size_t size)
+{
+	static const char* names[PROC_NUM_FILES] = { "stat", "io", "task/%d/children" };
+	int fd = p.fd[file];
+	if (fd == -1)
+	{
+		char name[32], path[64];
+		snprintf(name, sizeof(name), names[file], (int)pid);
+		snprintf(path, sizeof(path), "/proc/%d/%s", (int)pid, name);
+		fd = open(path, O_RDONLY | O_CLOEXEC);
+		if (fd == -1)
+			return -1;
+		if (p.pid != 0 && open_fds < max_open_fds)
+		{
+			p.fd[file] = fd;
+			open_fds++;
+		}
+	}
+	ssize_t n;
+	do
+	{
+		n = pread(fd, buf, size - 1, 0);
+	} while (n == -1 && errno == EINTR);
+	if (fd != p.fd[file])
+		close(fd);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return n;
+}
+/****************************************************************************************/
+/**
+ * io_field function
+ * @param buf content of /proc/<pid>/io
+ * @param name of a field with its colon, "rchar:"
+ * @return its value, 0 if it is missing
+ */
+static unsigned long long io_field(const char* buf, const char* name)
+{
+	const char* p = strstr(buf, name);
+	return (p != NULL) ? strtoull(p + strlen(name), NULL, 10) : 0;
+}
+/****************************************************************************************/
+/**
+ * sample_process function
+ * adds the usage of pid to usage if it is in the process group pgid
+ * @param pid
+ * @param pgid
+ * @param usage
+ * @return its open files, NULL if pid is gone or not in the group
+ */
+static ProcFds* sample_process(pid_t pid, pid_t pgid, ProcUsage* usage)
+{
+	ProcFds* slot = find_slot(pid);
+	if (slot == NULL)
+	{
+		slot = &uncached;
+		for (int i = 0; i < PROC_NUM_FILES; i++)
+			slot->fd[i] = -1;
+	}
+	ProcFds& p = *slot;
+	p.gen = sample_gen;
+
+	ProcStat st;
+	if (read_proc(p, PROC_STAT, pid, sample_buf, sizeof(sample_buf)) <= 0 || !procParseStat(sample_buf, &st))
+	{
+		// a cached file of a process that is gone: the pid may be in use again
+		bool cached = (p.fd[PROC_STAT] != -1);
+		close_fds(p);
+		if (!cached || read_proc(p, PROC_STAT, pid, sample_buf, sizeof(sample_buf)) <= 0 ||
+			!procParseStat(sample_buf, &st))
+		{
+			if (p.pid != 0)
+				free_slot(&p);
+			return NULL;
+		}
+	}
+	if (st.pgid != pgid)
+		return NULL;
+	if (usage->procs == 0)
+		usage->state = st.state;
+	usage->procs++;
+	usage->threads += st.num_threads;
+	usage->cpu_us += st.utime_us + st.stime_us;
+	usage->rss_kb += st.rss_kb;
+	// not readable for a process that changed its credentials
+	if (read_proc(p, PROC_IO, pid, io_buf, sizeof(io_buf)) > 0)
+	{
+		usage->read_bytes += io_field(io_buf, "rchar:");
+		usage->write_bytes += io_field(io_buf, "wchar:");
+	}
+	return &p;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * procParseStat function
+ * @param buf NUL terminated content of /proc/<pid>/stat
+ * @param st
+ * @return false if buf is not a stat line
+ */
+bool procParseStat(const char* buf, ProcStat* st)
+{
+	static long ticks = 0;
+	static long page_kb = 0;
+	if (ticks == 0)
+	{
+		ticks = sysconf(_SC_CLK_TCK);
+		page_kb = sysconf(_SC_PAGESIZE) / 1024;
+	}
+
+	// the command name is in parentheses and may contain anything, so parse after the last ')'
+	const char* p = strrchr(buf, ')');
+	if (p == NULL || p[1] == '\0')
+		return false;
+	p += 2;
+	st->state = *p;
+
+	// fields are numbered as in proc(5), field 3 is the state
+	char* end;
+	unsigned long long utime = 0, stime = 0;
+	for (int field = 4; field <= 24; field++)
+	{
+		unsigned long long v = strtoull(p + 1, &end, 10);
+		if (end == p + 1)
+			return false;
+		p = end;
+		switch (field)
+		{
+			case 5:  st->pgid = (pid_t)v; break;
+			case 10: st->minflt = v; break;
+			case 12: st->majflt = v; break;
+			case 14: utime = v; break;
+			case 15: stime = v; break;
+			case 20: st->num_threads = (long)v; break;
+			case 22: st->starttime = v; break;
+			case 24: st->rss_kb = (long)v * page_kb; break;
+			default: break;
+		}
+	}
+	st->utime_us = utime * 1000000ULL / ticks;
+	st->stime_us = stime * 1000000ULL / ticks;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * procReadStat function
+ * @param pid
+ * @param st
+ * @return false if the process is gone
+ */
+bool procReadStat(pid_t pid, ProcStat* st)
+{
+	char path[32];
+	char buf[PROC_STAT_BUF_SIZE];
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+	ssize_t n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (n <= 0)
+		return false;
+	buf[n] = '\0';
+	return procParseStat(buf, st);
+}
+/****************************************************************************************/
+/**
+ * procSampleGroup function
+ * sums the usage of the processes of a process group, from its leader down.
+ * A child that moved to another group is left out, with its children.
+ * @param leader
+ * @param pgid
+ * @param usage
+ * @return false if the leader is gone
+ */
+bool procSampleGroup(pid_t leader, pid_t pgid, ProcUsage* usage)
+{
+	if (max_open_fds == -1)
+	{
+		struct rlimit rl;
+		max_open_fds = (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) ? rl.rlim_cur / 4 : 256;
+		group.reserve(PROC_GROUP_MAX);
+	}
+	memset(usage, 0, sizeof(*usage));
+	group.clear();
+	group.push_back(leader);
+	bool first = true;
+	while (!group.empty())
+	{
+		pid_t pid = group.back();
+		group.pop_back();
+		ProcFds* p = sample_process(pid, pgid, usage);
+		if (p == NULL)
+		{
+			if (first)
+				return false;
+			continue;
+		}
+		first = false;
+		if (read_proc(*p, PROC_CHILDREN, pid, children_buf, sizeof(children_buf)) <= 0)
+			continue;
+		char* end;
+		for (const char* c = children_buf; usage->procs + (int)group.size() < PROC_GROUP_MAX; c = end)
+		{
+			long child = strtol(c, &end, 10);
+			if (end == c)
+				break;
+			group.push_back((pid_t)child);
+		}
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * procSampleSweep function
+ * closes the files of the processes that were not sampled since the last sweep
+ */
+void procSampleSweep()
+{
+	for (unsigned i = 0; i < PROC_FDS_SLOTS; )
+	{
+		// a freed slot may take the one after it: it is looked at again
+		if (proc_fds[i].pid != 0 && proc_fds[i].gen != sample_gen)
+			free_slot(&proc_fds[i]);
+		else
+			i++;
+	}
+	sample_gen++;
+}
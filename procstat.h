@@ -0,0 +1,66 @@
+#ifndef _PROCSTAT_H
+#define _PROCSTAT_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define PROC_STAT_BUF_SIZE 1024
+#define PROC_IO_BUF_SIZE 512
+#define PROC_CHILDREN_BUF_SIZE 4096
+#define PROC_GROUP_MAX 4096			// processes summed for one process group
+#define PROC_FDS_SLOTS 4096			// processes whose /proc files stay open, a power of 2
+#define PROC_FDS_MAX_USED 3072		// of the slots used at most, so probes stay short
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+/**
+ * the fields of /proc/<pid>/stat that smash uses
+ */
+struct ProcStat
+{
+	char state;					// R, S, D, T, Z...
+	pid_t pgid;
+	unsigned long minflt;
+	unsigned long majflt;
+	unsigned long long utime_us;
+	unsigned long long stime_us;
+	long num_threads;
+	unsigned long long starttime;	// clock ticks after boot
+	long rss_kb;
+};
+
+/**
+ * the resource usage of a process group, summed over its processes
+ */
+struct ProcUsage
+{
+	int procs;					// processes sampled, 0 if the group is gone
+	char state;					// of the leader
+	long threads;
+	long rss_kb;
+	unsigned long long cpu_us;	// user + system
+	unsigned long long read_bytes;	// rchar and wchar of /proc/<pid>/io: all reads and writes,
+	unsigned long long write_bytes;	// pipes and page cache included
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool procParseStat(const char* buf, ProcStat* st);
+bool procReadStat(pid_t pid, ProcStat* st);
+bool procSampleGroup(pid_t leader, pid_t pgid, ProcUsage* usage);
+void procSampleSweep();
+
+
+#endif
@@ -0,0 +1,408 @@
+/* ####################################################################################
+ *                                  SCRIPT.CC
+ *  Script files, for "smash FILE" and "source FILE": read at once, then compiled one
+ *  statement at a time as they run - the same parser as typed lines, the bodies of
+ *  here-documents and functions are read from the following lines of the file.
+ *
+ *  Each statement is kept in a compact form: its words as offsets into the parsed
+ *  text, a few bytes per command. Once a script ran to its end it is cached, keyed by
+ *  (dev, ino) and valid while its mtime and size did not change, and a later run of it
+ *  skips parsing: each CmdList is rebuilt from the offsets. Like the glob cache, a file
+ *  changed within SCRIPT_RACY_NS of being read is not cached, since a change in the
+ *  same clock tick would not move the mtime.
+ *
+ *  Blank lines and lines starting with "#" are skipped.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <map>
+#include "metrics.h"
+#include "script.h"
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static map<pair<dev_t, ino_t>, Script*> cache;
+static size_t cache_bytes = 0;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static bool read_file(int fd, Script* s);
+static char* next_line(ScriptRun& run);
+static bool compile_next(ScriptRun& run, CmdList& list);
+static bool compile_list(ScriptRun& run, ScriptStmt& st, char* line, CmdList& list);
+static void load_list(const Script* s, const ScriptStmt& st, CmdList& list);
+static void drop(Script* s);
+static void insert(Script* s);
+
+
+/**
+ * read_file function
+ * @param fd
+ * @param s receives the file in lines and text, its lines NUL terminated
+ * @return false if it could not be read
+ */
+static bool read_file(int fd, Script* s)
+{
+	size_t len = 0;
+	s->lines.resize((s->size > 0) ? s->size + 1 : 4096);
+	while (1)
+	{
+		if (len + 1 == s->lines.size())
+			s->lines.resize(s->lines.size() * 2);	// not a regular file, or it grew
+		ssize_t n = read(fd, &s->lines[len], s->lines.size() - len - 1);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n == -1)
+			return false;
+		if (n == 0)
+			break;
+		len += n;
+		if (len > (size_t)SCRIPT_MAX_SIZE)
+		{
+			errno = EFBIG;
+			return false;
+		}
+	}
+	s->lines.resize(len + 1);
+	s->lines[len] = '\0';
+	for (size_t i = 0; i < len; i++)
+	{
+		if (s->lines[i] == '\n')
+			s->lines[i] = '\0';
+	}
+	s->text = s->lines;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * next_line function
+ * @param run
+ * @return the next line of the file to compile, NULL at its end
+ */
+static char* next_line(ScriptRun& run)
+{
+	Script* s = run.script;
+	if (run.pos + 1 >= s->text.size())
+		return NULL;
+	char* line = &s->text[run.pos];
+	run.pos += strlen(line) + 1;
+	return line;
+}
+/****************************************************************************************/
+/**
+ * compile_next function
+ * compiles the next statement of a script that is not cached
+ * @param run
+ * @param list receives it, if it is a command line
+ * @return false at the end of the file
+ */
+static bool compile_next(ScriptRun& run, CmdList& list)
+{
+	Script* s = run.script;
+	char* line;
+	size_t at;
+	while (1)
+	{
+		at = run.pos;
+		line = next_line(run);
+		if (line == NULL)
+			return false;
+		const char* first = line + strspn(line, " \t\r");
+		if (*first != '\0' && *first != '#')
+			break;
+	}
+
+	ScriptStmt st;
+	st.line = at;
+	st.first_item = s->items.size();
+	st.num_items = 0;
+	st.name = SCRIPT_NONE;
+	st.kind = STMT_LIST;
+	st.background = 0;
+	char* name;
+	char* body;
+	bool open;
+	if (parseFunction(line, &name, &body, &open))
+	{
+		string joined = body;
+		char* more;
+		while (open && (more = next_line(run)) != NULL)
+		{
+			open = !parseBodyEnd(more);
+			parseBodyLine(joined, more);
+		}
+		ShellFunction* f = open ? NULL : parseFunctionBody(joined);
+		st.kind = STMT_ERROR;
+		if (f != NULL)
+		{
+			st.kind = STMT_FUNCTION;
+			st.name = name - &s->text[0];
+			st.first_item = s->functions.size();
+			s->functions.push_back(f);
+		}
+	}
+	else if (!compile_list(run, st, line, list))
+	{
+		st.kind = STMT_ERROR;
+	}
+	s->stmts.push_back(st);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * compile_list function
+ * parses a command line and reads the bodies of its here-documents, into list and into st
+ * @param run
+ * @param st
+ * @param line
+ * @param list
+ * @return false if the line is invalid, or the file ends before the delimiter of a here-document
+ */
+static bool compile_list(ScriptRun& run, ScriptStmt& st, char* line, CmdList& list)
+{
+	Script* s = run.script;
+	if (!parseLine(line, list))
+		return false;
+	const char* base = &s->text[0];
+	for (size_t i = 0; i < list.num_items; i++)
+	{
+		CmdItem& item = list.items[i];
+		ScriptItem si;
+		si.first_arg = s->args.size();
+		si.num_arg = item.num_arg;
+		si.op = item.op;
+		si.expand = item.expand;
+		si.here_kind = item.here_kind;
+		si.here_word = (item.here_word != NULL) ? item.here_word - base : SCRIPT_NONE;
+		si.here = SCRIPT_NONE;
+		si.here_len = 0;
+		for (int j = 0; j < item.num_arg; j++)
+			s->args.push_back(item.args[j] - base);
+		if (item.here_kind == HERE_DOC)
+		{
+			si.here = s->bodies.size();
+			while (1)
+			{
+				char* body_line = next_line(run);
+				if (body_line == NULL)
+					return false;
+				if (!strcmp(body_line, item.here_word))
+					break;
+				s->bodies.insert(s->bodies.end(), body_line, body_line + strlen(body_line));
+				s->bodies.push_back('\n');
+			}
+			si.here_len = s->bodies.size() - si.here;
+			item.here.assign(s->bodies.begin() + si.here, s->bodies.end());
+		}
+		s->items.push_back(si);
+	}
+	st.num_items = list.num_items;
+	st.background = list.background;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * load_list function
+ * rebuilds a compiled command line, without parsing it
+ * @param s
+ * @param st
+ * @param list
+ */
+static void load_list(const Script* s, const ScriptStmt& st, CmdList& list)
+{
+	if (list.items.size() < st.num_items)
+		list.items.resize(st.num_items);
+	list.num_items = st.num_items;
+	list.background = st.background;
+	char* base = (char*)&s->text[0];
+	for (size_t i = 0; i < st.num_items; i++)
+	{
+		const ScriptItem& si = s->items[st.first_item + i];
+		CmdItem& item = list.items[i];
+		item.num_arg = si.num_arg;
+		for (int j = 0; j < si.num_arg; j++)
+			item.args[j] = base + s->args[si.first_arg + j];
+		item.args[si.num_arg] = NULL;
+		item.argv = item.args;
+		item.argc = si.num_arg;
+		item.op = (LIST_OP)si.op;
+		item.expand = si.expand;
+		item.here_kind = (HERE_KIND)si.here_kind;
+		item.here_word = (si.here_word != SCRIPT_NONE) ? base + si.here_word : NULL;
+		if (si.here_kind == HERE_DOC)
+			item.here.assign(s->bodies.begin() + si.here, s->bodies.begin() + si.here + si.here_len);
+	}
+}
+/****************************************************************************************/
+/**
+ * drop function
+ * removes a script from the cache; it is freed once no run of it is left
+ * @param s
+ */
+static void drop(Script* s)
+{
+	cache.erase(make_pair(s->dev, s->ino));
+	cache_bytes -= s->bytes;
+	s->cached = false;
+	if (s->running == 0)
+		delete s;
+}
+/****************************************************************************************/
+/**
+ * insert function
+ * caches a script that was compiled to its end, in place of an older version of the file
+ * @param s
+ */
+static void insert(Script* s)
+{
+	map<pair<dev_t, ino_t>, Script*>::iterator old = cache.find(make_pair(s->dev, s->ino));
+	if (old != cache.end())
+		drop(old->second);
+	s->bytes = s->lines.size() + s->text.size() + s->bodies.size() + s->stmts.size() * sizeof(ScriptStmt) +
+			   s->items.size() * sizeof(ScriptItem) + s->args.size() * sizeof(uint32_t);
+	while (!cache.empty() && cache_bytes + s->bytes > SCRIPT_CACHE_MAX_BYTES)
+		drop(cache.begin()->second);
+	cache[make_pair(s->dev, s->ino)] = s;
+	cache_bytes += s->bytes;
+	s->cached = true;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * scriptOpen function
+ * @param path
+ * @param run receives the start of a run of the script, from the cache if the file did not change
+ * @return false if it could not be read, errno is set
+ */
+bool scriptOpen(const char* path, ScriptRun& run)
+{
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) == -1)
+	{
+		close(fd);
+		return false;
+	}
+	if (S_ISDIR(st.st_mode))
+	{
+		close(fd);
+		errno = EISDIR;
+		return false;
+	}
+	run.stmt = 0;
+	run.pos = 0;
+	map<pair<dev_t, ino_t>, Script*>::iterator c = cache.find(make_pair(st.st_dev, st.st_ino));
+	if (c != cache.end() && c->second->size == st.st_size && c->second->mtime.tv_sec == st.st_mtim.tv_sec &&
+		c->second->mtime.tv_nsec == st.st_mtim.tv_nsec)
+	{
+		close(fd);
+		metricsCount(CNT_SCRIPT_HITS);
+		run.script = c->second;
+		run.script->running++;
+		run.compiled = false;
+		run.cacheable = false;
+		return true;
+	}
+	metricsCount(CNT_SCRIPT_MISSES);
+
+	Script* s = new Script();
+	s->dev = st.st_dev;
+	s->ino = st.st_ino;
+	s->mtime = st.st_mtim;
+	s->size = S_ISREG(st.st_mode) ? st.st_size : 0;
+	if (!read_file(fd, s))
+	{
+		int saved_errno = errno;
+		close(fd);
+		delete s;
+		errno = saved_errno;
+		return false;
+	}
+	close(fd);
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+	long long age = (now.tv_sec - st.st_mtim.tv_sec) * 1000000000LL + (now.tv_nsec - st.st_mtim.tv_nsec);
+	s->running = 1;
+	run.script = s;
+	run.compiled = true;
+	run.cacheable = S_ISREG(st.st_mode) && age >= SCRIPT_RACY_NS && s->size == (off_t)(s->lines.size() - 1);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * scriptNext function
+ * @param run
+ * @param list receives the next statement if it is a command line, ready to run
+ * @param kind receives the kind of the statement
+ * @param cmdString receives its first line as written, for error messages
+ * @param name receives the name of a function it defines
+ * @param func receives that function, to be copied (see copyFunction)
+ * @return false at the end of the script
+ */
+bool scriptNext(ScriptRun& run, CmdList& list, STMT_KIND* kind, char** cmdString, char** name,
+				ShellFunction** func)
+{
+	Script* s = run.script;
+	if (run.stmt == s->stmts.size())
+	{
+		if (s->complete || !compile_next(run, list))
+		{
+			s->complete = true;
+			return false;
+		}
+	}
+	else if (s->stmts[run.stmt].kind == STMT_LIST)
+	{
+		load_list(s, s->stmts[run.stmt], list);
+	}
+	const ScriptStmt& st = s->stmts[run.stmt++];
+	*kind = (STMT_KIND)st.kind;
+	*cmdString = &s->lines[st.line];
+	*name = (st.kind == STMT_FUNCTION) ? &s->text[st.name] : NULL;
+	*func = (st.kind == STMT_FUNCTION) ? s->functions[st.first_item] : NULL;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * scriptClose function
+ * ends a run. A script it compiled is cached, the statements it did not reach (after
+ * a "return") are compiled for that.
+ * @param run
+ */
+void scriptClose(ScriptRun& run)
+{
+	Script* s = run.script;
+	s->running--;
+	if (run.compiled && run.cacheable && !s->complete)
+	{
+		static CmdList rest;
+		while (compile_next(run, rest))
+			;
+		s->complete = true;
+	}
+	if (run.compiled && s->complete && run.cacheable)
+		insert(s);
+	else if (!s->cached && s->running == 0)
+		delete s;
+	run.script = NULL;
+}
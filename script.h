@@ -0,0 +1,132 @@
+#ifndef _SCRIPT_H
+#define _SCRIPT_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <vector>
+#include "parser.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define SCRIPT_MAX_SIZE 0x7fffffffL				// offsets are 32 bits
+#define SCRIPT_CACHE_MAX_BYTES (256L << 20)		// the cache is dropped when it holds more
+#define SCRIPT_RACY_NS 1000000000LL				// a file this close to its mtime is not cached
+#define SCRIPT_NONE 0xffffffffU					// an offset that is not set
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+typedef enum STMT_KIND
+{
+	STMT_LIST,			// a command line
+	STMT_FUNCTION,		// name() { ... }
+	STMT_ERROR,			// a line that does not parse
+
+} STMT_KIND;
+
+/**
+ * a simple command of a compiled statement, see CmdItem
+ */
+struct ScriptItem
+{
+	uint32_t first_arg;		// in Script::args
+	uint32_t here_word;		// offset in Script::text, SCRIPT_NONE
+	uint32_t here;			// offset of the here-document body in Script::bodies
+	uint32_t here_len;
+	uint8_t num_arg;
+	uint8_t op;				// LIST_OP
+	uint8_t expand;
+	uint8_t here_kind;		// HERE_KIND
+};
+
+/**
+ * a statement of a script: a command line (with the bodies of its here-documents),
+ * or a function definition (with the lines of its body)
+ */
+struct ScriptStmt
+{
+	uint32_t line;			// offset of its first line in Script::lines
+	uint32_t first_item;	// in Script::items, or the index of the function in Script::functions
+	uint32_t num_items;
+	uint32_t name;			// offset of the function name in Script::text
+	uint8_t kind;			// STMT_KIND
+	uint8_t background;
+};
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * a script file, compiled statement by statement the first time it runs. Once all of it
+ * was, it is cached and a run only rebuilds each CmdList from these arrays.
+ */
+class Script
+{
+	public:
+		dev_t dev;
+		ino_t ino;
+		struct timespec mtime;
+		off_t size;
+		vector<char> lines;			// the file, each line NUL terminated: the command strings
+		vector<char> text;			// the same, parsed in place
+		vector<ScriptStmt> stmts;
+		vector<ScriptItem> items;
+		vector<uint32_t> args;		// offsets in text
+		vector<char> bodies;		// of the here-documents
+		vector<ShellFunction*> functions;	// the functions it defines, copied at each definition
+		size_t bytes;				// its size in the cache
+		bool complete;				// every statement was compiled
+		bool cached;				// else freed when no run is left
+		int running;				// runs in progress
+
+		Script()
+		{
+			bytes = 0;
+			complete = false;
+			cached = false;
+			running = 0;
+		}
+
+		~Script()
+		{
+			for (size_t i = 0; i < functions.size(); i++)
+				delete functions[i];
+		}
+};
+
+/**
+ * a run of a script
+ */
+struct ScriptRun
+{
+	Script* script;
+	size_t stmt;		// the next statement
+	size_t pos;			// while compiling, the offset of the next line
+	bool compiled;		// it was not cached: this run compiles it
+	bool cacheable;		// a regular file, not changed in the last SCRIPT_RACY_NS
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool scriptOpen(const char* path, ScriptRun& run);
+bool scriptNext(ScriptRun& run, CmdList& list, STMT_KIND* kind, char** cmdString, char** name,
+				ShellFunction** func);
+void scriptClose(ScriptRun& run);
+
+
+#endif
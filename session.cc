@@ -0,0 +1,325 @@
+/* ####################################################################################
+ *                                  SESSION.CC
+ *  smash --record FILE logs every line read at the prompt, and smash --replay FILE
+ *  feeds those lines to the same input loop again, as a load generator.
+ *
+ *  The log is text, one record per command line:
+ *      <start_ns> <duration_ns> <status> <line>
+ *  start_ns is CLOCK_MONOTONIC when the line came in, duration_ns how long it ran
+ *  and status its exit status. The lines read while it ran (here-documents, function
+ *  bodies) follow it as "+ <line>". Lines starting with "#" are comments.
+ *
+ *  A replay keeps the original gaps between lines, divided by --speed N, or runs
+ *  them back to back with --max; a line that is late starts at once. The event loop
+ *  keeps running while a line is not due, so background jobs are reaped as usual.
+ *  At the end it prints the latency distribution next to the recorded one, how late
+ *  the lines started, and how many ended with another status than recorded.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "eventloop.h"
+#include "metrics.h"
+#include "session.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+/**
+ * a recorded command line
+ */
+struct SessionEntry
+{
+	unsigned long long start_ns;
+	unsigned long long duration_ns;
+	int status;
+	string line;
+	vector<string> more;		// the lines it read
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static int record_fd = -1;
+static string record_more;			// the lines read by the current command, written after it
+static string record_buf;
+
+static vector<SessionEntry> entries;
+static bool replaying = false;
+static double replay_speed = 1.0;
+static size_t next_entry = 0;		// the next line to replay
+static size_t next_more = 0;		// the next line it reads
+static unsigned long long replay_start = 0;
+static unsigned long long due_ns = 0;	// when the current line should have started
+static vector<unsigned long long> latencies;
+static vector<unsigned long long> lateness;
+static size_t mismatches = 0;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static bool parse_entry(const string& text, SessionEntry& e);
+static unsigned long long percentile(vector<unsigned long long>& v, int pct);
+
+
+/**
+ * parse_entry function
+ * @param text a record, "<start_ns> <duration_ns> <status> <line>"
+ * @param e receives it
+ * @return false if it is not one
+ */
+static bool parse_entry(const string& text, SessionEntry& e)
+{
+	const char* p = text.c_str();
+	char* end;
+	e.start_ns = strtoull(p, &end, 10);
+	if (end == p || *end != ' ')
+		return false;
+	p = end + 1;
+	e.duration_ns = strtoull(p, &end, 10);
+	if (end == p || *end != ' ')
+		return false;
+	p = end + 1;
+	e.status = strtol(p, &end, 10);
+	if (end == p || (*end != ' ' && *end != '\0'))
+		return false;
+	e.line = (*end == ' ') ? end + 1 : "";
+	e.more.clear();
+	return true;
+}
+/****************************************************************************************/
+/**
+ * percentile function
+ * @param v sorted
+ * @param pct
+ * @return the pct percentile of v, 0 if it is empty
+ */
+static unsigned long long percentile(vector<unsigned long long>& v, int pct)
+{
+	if (v.empty())
+		return 0;
+	size_t i = v.size() * pct / 100;
+	return v[(i < v.size()) ? i : v.size() - 1];
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * sessionRecord function
+ * starts logging the input lines to path, replacing it
+ * @param path
+ * @return 0, -1 if it could not be created
+ */
+int sessionRecord(const char* path)
+{
+	record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (record_fd == -1)
+	{
+		perror(path);
+		return -1;
+	}
+	string header = SESSION_HEADER "\n";
+	writeAll(record_fd, header.data(), header.size());
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * sessionReplay function
+ * loads a recorded session; the input loop then takes its lines from sessionNextLine
+ * @param path
+ * @param speed the recorded gaps are divided by it, SESSION_SPEED_MAX for none
+ * @return 0, -1 if it could not be read or is not a session log
+ */
+int sessionReplay(const char* path, double speed)
+{
+	FILE* f = fopen(path, "re");
+	if (f == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	char* buf = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int line_no = 0;
+	while ((len = getline(&buf, &cap, f)) != -1)
+	{
+		line_no++;
+		if (len > 0 && buf[len - 1] == '\n')
+			buf[--len] = '\0';
+		if (buf[0] == '#' || buf[0] == '\0')
+			continue;
+		if (buf[0] == '+' && buf[1] == ' ' && !entries.empty())
+		{
+			entries.back().more.push_back(buf + 2);
+			continue;
+		}
+		SessionEntry e;
+		if (!parse_entry(buf, e))
+		{
+			cerr << path << ":" << line_no << ": not a session record" << endl;
+			free(buf);
+			fclose(f);
+			return -1;
+		}
+		entries.push_back(e);
+	}
+	free(buf);
+	fclose(f);
+	replaying = true;
+	replay_speed = speed;
+	latencies.reserve(entries.size());
+	lateness.reserve(entries.size());
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * sessionReplaying function
+ * @return true if the input comes from a recorded session
+ */
+bool sessionReplaying()
+{
+	return replaying;
+}
+/****************************************************************************************/
+/**
+ * sessionNextLine function
+ * the next line of the replay, once it is due. The event loop runs meanwhile.
+ * @param line
+ * @param size
+ * @return false when all were replayed
+ */
+bool sessionNextLine(char* line, int size)
+{
+	if (next_entry == entries.size())
+		return false;
+	const SessionEntry& e = entries[next_entry];
+	unsigned long long now = metricsNow();
+	if (next_entry == 0)
+		replay_start = now;
+	due_ns = replay_start;
+	if (replay_speed != SESSION_SPEED_MAX)
+		due_ns += (unsigned long long)((e.start_ns - entries[0].start_ns) / replay_speed);
+	while (now < due_ns)
+	{
+		evRunIdle((int)((due_ns - now + 999999) / 1000000));
+		now = metricsNow();
+	}
+	if (replay_speed == SESSION_SPEED_MAX)
+		due_ns = now;
+	strncpy(line, e.line.c_str(), size - 1);
+	line[size - 1] = '\0';
+	next_more = 0;
+	return true;
+}
+/****************************************************************************************/
+/**
+ * sessionReadLine function
+ * the LineReader of the input loop while recording or replaying: the lines a command
+ * reads after its own are logged with it, and replayed from the log
+ * @param line
+ * @param size
+ * @return false at the end of the input
+ */
+bool sessionReadLine(char* line, int size)
+{
+	if (replaying)
+	{
+		const SessionEntry& e = entries[next_entry];
+		if (next_more == e.more.size())
+			return false;
+		strncpy(line, e.more[next_more++].c_str(), size - 1);
+		line[size - 1] = '\0';
+		return true;
+	}
+	if (!evReadLine(line, size))
+		return false;
+	if (record_fd != -1)
+	{
+		record_more += "+ ";
+		record_more += line;
+		record_more += '\n';
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * sessionDone function
+ * a command line of the input loop ended: it is logged, or its replay measured
+ * @param line as it was read
+ * @param start_ns metricsNow() when it was read
+ * @param status its exit status
+ */
+void sessionDone(const char* line, unsigned long long start_ns, int status)
+{
+	unsigned long long end_ns = metricsNow();
+	if (replaying && next_entry < entries.size())
+	{
+		latencies.push_back(end_ns - start_ns);
+		lateness.push_back((start_ns > due_ns) ? start_ns - due_ns : 0);
+		if (status != entries[next_entry].status)
+			mismatches++;
+		next_entry++;
+	}
+	if (record_fd == -1)
+		return;
+	char head[64];
+	snprintf(head, sizeof(head), "%llu %llu %d ", start_ns, end_ns - start_ns, status);
+	record_buf = head;
+	record_buf += line;
+	record_buf += '\n';
+	record_buf += record_more;
+	writeAll(record_fd, record_buf.data(), record_buf.size());
+	record_more.clear();
+}
+/****************************************************************************************/
+/**
+ * sessionReport function
+ * prints the latency distribution of the replay, as key=value pairs
+ */
+void sessionReport()
+{
+	vector<unsigned long long> recorded;
+	for (size_t i = 0; i < next_entry; i++)
+		recorded.push_back(entries[i].duration_ns);
+	sort(recorded.begin(), recorded.end());
+	sort(latencies.begin(), latencies.end());
+	sort(lateness.begin(), lateness.end());
+	double secs = (metricsNow() - replay_start) / 1e9;
+	char speed[32];
+	if (replay_speed == SESSION_SPEED_MAX)
+		snprintf(speed, sizeof(speed), "max");
+	else
+		snprintf(speed, sizeof(speed), "%g", replay_speed);
+
+	cout << "replay lines=" << latencies.size() << " secs=" << secs << " speed=" << speed
+		 << " p50_us=" << percentile(latencies, 50) / 1000.0 << " p90_us=" << percentile(latencies, 90) / 1000.0
+		 << " p99_us=" << percentile(latencies, 99) / 1000.0
+		 << " max_us=" << (latencies.empty() ? 0 : latencies.back()) / 1000.0
+		 << " recorded_p50_us=" << percentile(recorded, 50) / 1000.0
+		 << " recorded_p99_us=" << percentile(recorded, 99) / 1000.0
+		 << " late_p99_us=" << percentile(lateness, 99) / 1000.0
+		 << " status_mismatches=" << mismatches << endl;
+}
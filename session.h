@@ -0,0 +1,31 @@
+#ifndef _SESSION_H
+#define _SESSION_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define SESSION_HEADER "# smash session 1"
+#define SESSION_SPEED_MAX 0.0		// replay as fast as possible
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  sessionRecord(const char* path);
+int  sessionReplay(const char* path, double speed);
+bool sessionReplaying();
+bool sessionNextLine(char* line, int size);
+bool sessionReadLine(char* line, int size);
+void sessionDone(const char* line, unsigned long long start_ns, int status);
+void sessionReport();
+
+
+#endif
@@ -3,10 +3,16 @@
  /* ####################################################################################
  *                                  SIGNALS.CC
 #####################################################################################*/
+#include <errno.h>
+#include <sys/signalfd.h>
 #include <sys/wait.h>
 #include "commands.h"
 #include "signals.h"
 #include "signal.h"
+#include "eventloop.h"
+#include "jobstate.h"
+#include "metrics.h"
+#include "trace.h"
 
 
  /* ####################################################################################
@@ -16,6 +22,7 @@
 
 extern smashManager sm;
 extern pid_t pid_running_in_fg;
+extern volatile sig_atomic_t smash_interrupted;
 
 
 
@@ -26,8 +33,13 @@ extern pid_t pid_running_in_fg;
 
 
  static string signal_num_to_string(int signum);
- static bool check_if_removable(vector<Job>::iterator j, int options);
+ static bool check_if_removable(vector<Job>::iterator j, int options, int* exit_status = NULL);
  static bool stat_handler(int stat_val, pid_t pid);
+ static int stat_to_exit_status(int stat_val);
+ static void signal_fd_handler(int fd, unsigned int events, void* ctx);
+ static int watch_signals();
+
+ static sigset_t handled_signals;
 
 
 
@@ -57,6 +69,7 @@ extern pid_t pid_running_in_fg;
 		 vector<Job>::iterator j;
 		 j = sm.getJobBbPID(pid);
 		 j->is_delayed = true;
+		 traceAsync('b', "stopped", pid);
 		 if (time(&j->suspension_time.tv_sec) == -1)
 		 {
 			 perror("failed");
@@ -67,33 +80,116 @@ extern pid_t pid_running_in_fg;
 		 vector<Job>::iterator j;
 		 j = sm.getJobBbPID(pid);
 		 j->is_delayed = false;
+		 traceAsync('e', "stopped", pid);
 	 }
 	 return false;
 
  }
 /****************************************************************************************/
+/**
+ * stat_to_exit_status function
+ * @param stat_val
+ * @return the exit status as a shell reports it: the exit code, or 128 + the signal that killed/stopped the child
+ */
+ static int stat_to_exit_status(int stat_val)
+ {
+	 if (WIFEXITED(stat_val))
+		 return WEXITSTATUS(stat_val);
+	 if (WIFSIGNALED(stat_val))
+		 return 128 + WTERMSIG(stat_val);
+	 if (WIFSTOPPED(stat_val))
+		 return 128 + WSTOPSIG(stat_val);
+	 return 0;
+ }
+/****************************************************************************************/
 /**
  * check_if_removable function
  * @param j
  * @param options
- * @return job that has pid finished-> true: we can remove from job vector
+ * @param exit_status if not NULL, receives the status of the reported child (see stat_to_exit_status)
+ * @return job that has pid finished-> true: we can remove from job vector (it was copied to sm.done_jobs)
  * else: false
+ * A blocking wait (no WNOHANG) keeps running the event loop, so captured output is drained meanwhile.
+ * SIGCHLD wakes the loop up, so no status change is missed.
  */
- static bool check_if_removable(vector<Job>::iterator j, int options)
+ static bool check_if_removable(vector<Job>::iterator j, int options, int* exit_status)
  {
 	 int stat_val;
 	 bool result = false;
-	 pid_t returned_pid = waitpid(j->pid, &stat_val, options);
+	 pid_t pid = j->pid;
+	 pid_t returned_pid;
+	 struct rusage usage;
+	 if (options & WNOHANG)
+	 {
+		 returned_pid = wait4(pid, &stat_val, options, &usage);
+	 }
+	 else
+	 {
+		 while ((returned_pid = wait4(pid, &stat_val, options | WNOHANG, &usage)) == 0)
+		 {
+			 evRunOnce(-1);
+		 }
+	 }
 	 if (returned_pid == -1)
 	 {
 		 perror("waitpid");
 	 }
-	 else if (returned_pid == j->pid)
+	 else if (returned_pid == pid)
 	 {
-		 result = stat_handler(stat_val, j->pid);
+		 result = stat_handler(stat_val, pid);
+		 if (exit_status != NULL)
+			 *exit_status = stat_to_exit_status(stat_val);
+		 if (result)
+		 {
+			 metricsCount(CNT_REAPED);
+			 // keep it for jobs --json; the caller removes it from the job vector
+			 vector<Job>::iterator done = sm.getJobBbPID(pid);
+			 if (done != sm.jobs.end())
+			 {
+				 done->status = stat_to_exit_status(stat_val);
+				 done->usage = usage;
+				 clock_gettime(CLOCK_REALTIME, &done->end);
+				 sm.addToDone(*done);
+				 if (done->is_delayed)
+					 traceAsync('e', "stopped", pid);
+			 }
+			 traceAsync('e', "job", pid);
+		 }
 	 }
 	 return result;
  }
+/****************************************************************************************/
+/**
+ * signal_fd_handler function
+ * runs the handler of every pending signal, from the event loop.
+ * So handlers never interrupt code that walks or changes the job vector.
+ * @param fd the signalfd
+ * @param events
+ * @param ctx
+ */
+ static void signal_fd_handler(int fd, unsigned int events, void* ctx)
+ {
+	 struct signalfd_siginfo info[16];
+	 ssize_t n;
+	 while ((n = read(fd, info, sizeof(info))) > 0)
+	 {
+		 for (size_t i = 0; i < n / sizeof(info[0]); i++)
+		 {
+			 switch (info[i].ssi_signo)
+			 {
+				 case SIGCHLD:
+					 sig_child_handler(SIGCHLD);
+					 break;
+				 case SIGINT:
+					 catch_int(SIGINT);
+					 break;
+				 case SIGTSTP:
+					 catch_tstp(SIGTSTP);
+					 break;
+			 }
+		 }
+	 }
+ }
 /********************************************************************************************/
  /**
   * signal_num_to_string function
@@ -180,40 +276,76 @@ extern pid_t pid_running_in_fg;
 
 
 
- /* ####################################################################################
-*                               HEADER FUNCTIONS IMPLIMINTATION
-#####################################################################################*/
-
-
-
- /**
-  * setSignalHandlers function
-  * @return Set the signal handlers by methods for SIGCHLD, SIGINT and SIGTSTP
-  */
-int setSignalHandlers()
+/****************************************************************************************/
+/**
+ * watch_signals function
+ * blocks handled_signals and reads them from a signalfd in the event loop
+ * @return 0 on success, -1 on failure
+ */
+static int watch_signals()
 {
-	//SIGCHLD
-	if (signal(SIGCHLD, sig_child_handler) == SIG_ERR)
+	if (sigprocmask(SIG_BLOCK, &handled_signals, NULL) == -1)
 	{
-		perror("signal");
+		perror("sigprocmask");
 		return -1;
 	}
-
-	//SIGINT - CTRL+C
-	if (signal(SIGINT,&catch_int) == SIG_ERR)
+	int fd = signalfd(-1, &handled_signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd == -1)
 	{
-		perror("signal");
+		perror("signalfd");
 		return -1;
 	}
-
-	//SIGTSTP - CTRL+Z
-	if (signal(SIGTSTP,&catch_tstp) == SIG_ERR)
+	if (!evAdd(fd, EPOLLIN, signal_fd_handler, NULL))
 	{
-		perror("signal");
+		close(fd);
 		return -1;
 	}
 	return 0;
 }
+
+ /* ####################################################################################
+*                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+
+
+ /**
+  * setSignalHandlers function
+  * SIGCHLD, SIGINT and SIGTSTP are blocked and read from a signalfd in the event loop,
+  * which calls sig_child_handler, catch_int and catch_tstp
+  * @return 0 on success, -1 on failure
+  */
+int setSignalHandlers()
+{
+	sigemptyset(&handled_signals);
+	sigaddset(&handled_signals, SIGCHLD);
+	sigaddset(&handled_signals, SIGINT);	// CTRL+C
+	sigaddset(&handled_signals, SIGTSTP);	// CTRL+Z
+	return watch_signals();
+}
+/*################################################################################################*/
+/**
+ * setSubshellSignals function
+ * for a fork of smash that runs a background list: only SIGCHLD is read from the event loop,
+ * so CTRL+C and CTRL+Z (or kill) act on it and its commands together, like on any job
+ * @return 0 on success, -1 on failure
+ */
+int setSubshellSignals()
+{
+	unblockSignals();
+	sigemptyset(&handled_signals);
+	sigaddset(&handled_signals, SIGCHLD);
+	return watch_signals();
+}
+/*################################################################################################*/
+/**
+ * unblockSignals function
+ * called by a forked child before exec: the blocked mask would be inherited by the command
+ */
+void unblockSignals()
+{
+	sigprocmask(SIG_UNBLOCK, &handled_signals, NULL);
+}
 /*################################################################################################*/
 /**
  * catch_tstp function
@@ -230,7 +362,8 @@ void catch_tstp(int sig_num)
 	if(!sig_kill(pid_running_in_fg,SIGTSTP)){
 		return;
 	}
-	fg_job->is_delayed = true;
+	if (fg_job != sm.jobs.end())
+		fg_job->is_delayed = true;
 	return;
 }
 /*################################################################################################*/
@@ -242,17 +375,21 @@ void catch_int(int sig_num)
  {
 	if(pid_running_in_fg == -1)
 	{
+		// stops builtins that wait in the event loop (output -f)
+		smash_interrupted = 1;
+		evWakeup();
 		return;
 	}
 	//send SIGINT
-	vector<Job>::iterator fg_job = sm.getJobBbPID(pid_running_in_fg);
 	sig_kill(pid_running_in_fg,SIGINT);
 }
 /*################################################################################################*/
 
 /**
- * sig_kill: wrapper func for kill function that sends sig to jpb with pid
- * @param pid
+ * sig_kill: wrapper func for killpg that sends sig to the job with pid and to its children.
+ * Jobs lead their own process group (setpgrp). Callers pass Job::pgid, as Quit does: for a job
+ * adopted from a state file (jobstate.cc) it need not be the pid.
+ * @param pid the job's pgid, or the pid of the foreground command, which leads its group
  * @param signum
  * @return true if success and false if error happens, we do not deal with special cases like 0 and -1
  */
@@ -265,7 +402,8 @@ bool sig_kill(pid_t pid, int signum)
 	}
 	cout << "signal " << (signal_num_to_string(signum)) << " was sent to pid " << pid << endl;
 
-	if (kill(pid, signum) == -1)
+	// ESRCH: not a group leader (yet), signal the process itself
+	if (killpg(pid, signum) == -1 && (errno != ESRCH || kill(pid, signum) == -1))
 	{
 		perror("kill");
 		return false;
@@ -276,38 +414,117 @@ bool sig_kill(pid_t pid, int signum)
 
 /**
  * wrapper function for waitpid
+ * the status of the job is kept in sm.last_status
  * @param j
  * @param options
  */
  void sig_waitpid(vector<Job>::iterator j, int options)
  {
-	 if (check_if_removable(j, options))
+	 unsigned long long start_ns = metricsStart();
+	 unsigned long long trace_ns = traceBegin();
+	 pid_t pid = j->pid;
+	 jobStateSave();
+	 if (j->pidfd != -1)
+	 {
+		 // adopted, not our child: its pidfd handler removes it, CTRL+Z marks it delayed
+		 while ((j = sm.getJobBbPID(pid)) != sm.jobs.end() && !j->is_delayed)
+			 evRunOnce(-1);
+	 }
+	 else if (check_if_removable(j, options, &sm.last_status))
 	 {
-		 j = sm.jobs.erase(j);
+		 // the job vector may have changed while we were waiting
+		 j = sm.getJobBbPID(pid);
+		 if (j != sm.jobs.end())
+			 sm.removeJob(j);
 	 }
 	 pid_running_in_fg = -1;
+	 metricsRecord(HIST_WAIT, start_ns);
+	 traceSpan("wait", trace_ns);
  }
 /*################################################################################################*/
 /**
- * 	A handler to the SIGCHLD signal
- * @param sig_num
+ * sig_reap function
+ * reaps the job of pid if it is done, without blocking
+ * @param pid
+ * @param exit_status receives the job's status if it is done
+ * @return true if the job is done: reaped now, or earlier and still in sm.done_jobs
  */
-void sig_child_handler(int sig_num)
+ bool sig_reap(pid_t pid, int* exit_status)
+ {
+	 vector<Job>::iterator j = sm.getJobBbPID(pid);
+	 if (j == sm.jobs.end())
+	 {
+		 for (vector<Job>::reverse_iterator d = sm.done_jobs.rbegin(); d != sm.done_jobs.rend(); ++d)
+		 {
+			 if (d->pid == pid)
+			 {
+				 *exit_status = d->status;
+				 return true;
+			 }
+		 }
+		 return false;
+	 }
+	 if (j->pidfd != -1)
+		 return jobStateReap(j, exit_status);
+	 if (!check_if_removable(j, WCONTINUED|WUNTRACED|WNOHANG, exit_status))
+		 return false;
+	 j = sm.getJobBbPID(pid);
+	 if (j != sm.jobs.end())
+		 sm.removeJob(j);
+	 return true;
+ }
+/*################################################################################################*/
+/**
+ * sig_reap_jobs function
+ * takes the status changes of our children one by one (waitid on any child) and removes the
+ * finished jobs, so a SIGCHLD costs one wait per child that changed, not one per job.
+ * The foreground job is left to sig_waitpid, jobs the wait builtin is waiting for to sig_reap,
+ * and children that are not jobs to whoever started them. waitid peeks (WNOWAIT) and returns
+ * the same child until it is waited for, so once such a child is pending every job is polled.
+ * Adopted jobs are not our children, their pidfd tells when they are gone (see jobstate.cc).
+ */
+void sig_reap_jobs()
 {
-	for (vector<Job>::iterator j = sm.jobs.begin(); j != sm.jobs.end() && !sm.jobs.empty(); ++j)
+	// each job has one status change pending at most: more means it keeps changing, poll them all
+	for (size_t left = sm.jobs.size(); left > 0; left--)
 	{
-		if (j->pid != pid_running_in_fg)
+		siginfo_t info;
+		info.si_pid = 0;
+		if (waitid(P_ALL, 0, &info, WEXITED|WSTOPPED|WCONTINUED|WNOHANG|WNOWAIT) == -1 || info.si_pid == 0)
+			return;
+		vector<Job>::iterator j = sm.getJobBbPID(info.si_pid);
+		if (j == sm.jobs.end() || j->pid == pid_running_in_fg || j->is_waited)
+			break;
+		if (check_if_removable(j, WCONTINUED|WUNTRACED|WNOHANG))
 		{
-			if (check_if_removable(j,WCONTINUED|WUNTRACED|WNOHANG))
-			{
-				j = sm.jobs.erase(j);
-				j--;
-			}
+			j = sm.getJobBbPID(info.si_pid);
+			if (j != sm.jobs.end())
+				sm.removeJob(j);
 		}
 	}
-}
-
-
-
-
 
+	vector<Job>::iterator j = sm.jobs.begin();
+	while (j != sm.jobs.end())
+	{
+		if (j->pid != pid_running_in_fg && !j->is_waited && j->pidfd == -1
+			&& check_if_removable(j, WCONTINUED|WUNTRACED|WNOHANG))
+			j = sm.removeJob(j);
+		else
+			++j;
+	}
+}
+/*################################################################################################*/
+/**
+ * 	A handler to the SIGCHLD signal, run from the event loop (see signal_fd_handler).
+ * 	Pending SIGCHLDs coalesce, so it takes every child that changed, not just one.
+ * @param sig_num
+ */
+void sig_child_handler(int sig_num)
+{
+	unsigned long long start_ns = metricsStart();
+	unsigned long long trace_ns = traceBegin();
+	metricsCount(CNT_SIGCHLD);
+	sig_reap_jobs();
+	metricsRecord(HIST_REAP, start_ns);
+	traceSpan("reap", trace_ns);
+}
@@ -31,7 +31,11 @@ void catch_tstp(int sig_num);
 void sig_child_handler(int sig_num);
 bool sig_kill(pid_t pid, int signum);
 int  setSignalHandlers();
+int  setSubshellSignals();
+void unblockSignals();
 void sig_waitpid(vector<Job>::iterator j, int options);
+bool sig_reap(pid_t pid, int* exit_status);
+void sig_reap_jobs();
 
 
 #endif
@@ -3,6 +3,7 @@
  *                                  INCLUDES
 #####################################################################################*/
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,12 +13,21 @@
 #include <unistd.h>
 #include "commands.h"
 #include "signals.h"
+#include "capture.h"
+#include "control.h"
+#include "eventloop.h"
+#include "jobstate.h"
+#include "metrics.h"
+#include "pathglob.h"
+#include "session.h"
+#include "trace.h"
+#include "vars.h"
+#include "zygote.h"
 
 /* ####################################################################################
  *                                  CONSTANTS
 #####################################################################################*/
 
-#define MAX_SIZE 80
 #define SUCCESS 0
 
 
@@ -26,9 +36,123 @@
 #####################################################################################*/
 
 smashManager sm;
-char lineSize[MAX_SIZE];
+char lineSize[MAX_LINE_SIZE];
 pid_t pid_running_in_fg;
 int Job_Num;
+volatile sig_atomic_t smash_interrupted;
+
+/* ####################################################################################
+ *                                 HELPING FUNCTIONS
+#####################################################################################*/
+
+/**
+ * parse_options function
+ * handles smash's command line:
+ *   --capture [KB]   keep the last KB (default CAPTURE_DEFAULT_KB) of every bg job's output in memory
+ *   --zygote         launch external commands from a spawn helper forked at startup
+ *   --listen PATH    accept requests on a unix control socket (see control.cc)
+ *   --metrics-file PATH [SECS]  rewrite Prometheus metrics to PATH every SECS (default METRICS_DEFAULT_PERIOD)
+ *   --trace PATH     record command lifecycles, written to PATH as Chrome trace-event JSON
+ *   --state PATH     journal the job table to PATH, and adopt the living jobs it lists (see jobstate.cc)
+ *   --glob-cache     keep directory listings for globbing while the directories do not change (see pathglob.cc)
+ *   --record PATH    log every input line with its time, duration and status to PATH (see session.cc)
+ *   --replay PATH    run the lines of a recorded session instead of reading stdin, then report their latency
+ *   --speed N        replay N times faster than recorded (default 1)
+ *   --max            replay as fast as possible
+ *   FILE [ARGS...]   run the script FILE with ARGS as $1..., instead of reading commands from stdin
+ * @param argc
+ * @param argv
+ * @param use_zygote set if --zygote was given
+ * @param listen_path set to the --listen argument
+ * @param metrics_path set to the --metrics-file argument
+ * @param metrics_period set to its period
+ * @param trace_path set to the --trace argument
+ * @param state_path set to the --state argument
+ * @param record_path set to the --record argument
+ * @param replay_path set to the --replay argument
+ * @param speed set to the --speed argument, SESSION_SPEED_MAX for --max
+ * @param script_arg set to the index of FILE in argv, 0 without one
+ * @return true if the options are valid
+ */
+static bool parse_options(int argc, char *argv[], bool* use_zygote, const char** listen_path,
+						  const char** metrics_path, int* metrics_period, const char** trace_path,
+						  const char** state_path, const char** record_path, const char** replay_path,
+						  double* speed, int* script_arg)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] != '-')
+		{
+			// the script and its arguments end the options
+			*script_arg = i;
+			return true;
+		}
+		if (!strcmp(argv[i], "--capture"))
+		{
+			size_t kb = CAPTURE_DEFAULT_KB;
+			if (i + 1 < argc && isdigit((unsigned char)argv[i+1][0]))
+			{
+				kb = atoi(argv[++i]);
+				if (kb == 0)
+					return false;
+			}
+			capture_limit = kb * 1024;
+		}
+		else if (!strcmp(argv[i], "--zygote"))
+		{
+			*use_zygote = true;
+		}
+		else if (!strcmp(argv[i], "--listen") && i + 1 < argc)
+		{
+			*listen_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--metrics-file") && i + 1 < argc)
+		{
+			*metrics_path = argv[++i];
+			if (i + 1 < argc && isdigit((unsigned char)argv[i+1][0]))
+			{
+				*metrics_period = atoi(argv[++i]);
+				if (*metrics_period <= 0)
+					return false;
+			}
+		}
+		else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+		{
+			*trace_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--state") && i + 1 < argc)
+		{
+			*state_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--glob-cache"))
+		{
+			pathGlobCache(true);
+		}
+		else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+		{
+			*record_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+		{
+			*replay_path = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--speed") && i + 1 < argc)
+		{
+			*speed = atof(argv[++i]);
+			if (*speed <= 0)
+				return false;
+		}
+		else if (!strcmp(argv[i], "--max"))
+		{
+			*speed = SESSION_SPEED_MAX;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
 
 /* ####################################################################################
  *                                 MAIN FUNCTION
@@ -42,7 +166,64 @@ int Job_Num;
  */
 int main(int argc, char *argv[])
 {
-    char cmdString[MAX_SIZE];
+    char cmdString[MAX_LINE_SIZE];
+	bool use_zygote = false;
+	const char* listen_path = NULL;
+	const char* metrics_path = NULL;
+	int metrics_period = METRICS_DEFAULT_PERIOD;
+	const char* trace_path = NULL;
+	const char* state_path = NULL;
+	const char* record_path = NULL;
+	const char* replay_path = NULL;
+	double speed = 1.0;
+	int script_arg = 0;
+
+	if (!parse_options(argc, argv, &use_zygote, &listen_path, &metrics_path, &metrics_period, &trace_path,
+					   &state_path, &record_path, &replay_path, &speed, &script_arg))
+	{
+		cout << "usage: smash [--capture [KB]] [--zygote] [--listen PATH] [--metrics-file PATH [SECS]] [--trace PATH]"
+				" [--state PATH] [--glob-cache] [--record PATH] [--replay PATH [--speed N|--max]]"
+				" [FILE [ARGS...]]" << endl;
+		exit(1);
+	}
+
+	// before anything else, while smash is as small as it gets
+	if (use_zygote && zygoteStart() == -1)
+	{
+		cout << "zygote" << endl;
+		exit(1);
+	}
+
+	if (evInit() == -1)
+	{
+		cout << "event loop" << endl;
+		exit(1);
+	}
+
+	if (listen_path != NULL && controlListen(listen_path) == -1)
+	{
+		exit(1);
+	}
+
+	if (metrics_path != NULL && metricsFile(metrics_path, metrics_period) == -1)
+	{
+		exit(1);
+	}
+
+	if (trace_path != NULL && traceStart(trace_path) == -1)
+	{
+		exit(1);
+	}
+
+	if (record_path != NULL && sessionRecord(record_path) == -1)
+	{
+		exit(1);
+	}
+
+	if (replay_path != NULL && sessionReplay(replay_path, speed) == -1)
+	{
+		exit(1);
+	}
 
 	//here we deal with signal declerations
 	if (setSignalHandlers() == -1)
@@ -51,19 +232,62 @@ int main(int argc, char *argv[])
 		exit(1);
 	}
 
+	varsInit(environ);
+
 	//globals
 	pid_running_in_fg = -1;
 	Job_Num = 1;
 
+	if (state_path != NULL && jobStateOpen(state_path) == -1)
+	{
+		exit(1);
+	}
+
+	// batch mode: the script instead of the prompt
+	if (script_arg != 0)
+	{
+		RunScript(argv[script_arg], argv + script_arg, argc - script_arg);
+		jobStateSave();
+		cout.flush();
+		return sm.last_status;
+	}
+
+	// the lines a command reads go through the session while recording or replaying
+	bool session = (record_path != NULL || replay_path != NULL);
+	LineReader more = session ? sessionReadLine : evReadLine;
+
     while (1)
     {
-	 	cout << "smash > ";
-	 	cin.getline(lineSize, MAX_SIZE, '\n');
+	 	jobStateSave();
+	 	if (sessionReplaying())
+	 	{
+	 		if (!sessionNextLine(lineSize, MAX_LINE_SIZE))
+	 			break;
+	 	}
+	 	else
+	 	{
+	 		cout << "smash > " << flush;
+	 		if (!evReadLine(lineSize, MAX_LINE_SIZE))
+	 		{
+	 			if (!controlActive())
+	 				break;
+	 			// no more input, keep serving the control socket and the state file
+	 			while (1)
+	 			{
+	 				jobStateSave();
+	 				evRunIdle(-1);
+	 			}
+	 		}
+	 	}
 	 	strcpy(cmdString, lineSize);
-	 	if(!BgCmd(lineSize, cmdString)) continue;
-		ExeCmd(lineSize, cmdString);
+	 	unsigned long long start_ns = session ? metricsNow() : 0;
+	 	RunCmd(lineSize, cmdString, more);
+	 	if (session)
+	 		sessionDone(cmdString, start_ns, sm.last_status);
 	}
 
+	if (sessionReplaying())
+		sessionReport();
     return SUCCESS;
 }
 
@@ -0,0 +1,263 @@
+/* ####################################################################################
+ *                                  TRACE.CC
+ *  smash --trace FILE: records command lifecycle spans (parse, builtin, spawn, wait,
+ *  reap) and per job intervals (running, stopped) into a preallocated buffer, and
+ *  writes them as Chrome/Perfetto trace-event JSON on exit or on "trace flush".
+ *
+ *  Signals are handled from the event loop (see signals.cc), so records never
+ *  interleave; a slot is claimed with a relaxed atomic increment all the same. When
+ *  the buffer is full new events are counted and dropped.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include "eventloop.h"
+#include "metrics.h"
+#include "trace.h"
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+struct TraceEvent
+{
+	const char* name;		// static string
+	char phase;				// X = complete span, b/e = async begin/end (per job)
+	unsigned long long ts_ns;
+	unsigned long long dur_ns;
+	pid_t id;				// job pid of async events
+	char label[TRACE_LABEL_SIZE];
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+bool trace_enabled = false;
+
+static TraceEvent* events = NULL;
+static unsigned long next_event = 0;
+static unsigned long dropped = 0;
+static unsigned long long base_ns = 0;
+static string trace_path;
+static pid_t trace_pid;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static TraceEvent* claim();
+static void append_json_str(string& out, const char* s);
+
+
+/**
+ * claim function
+ * @return a free slot, or NULL if the buffer is full
+ */
+static TraceEvent* claim()
+{
+	unsigned long slot = __atomic_fetch_add(&next_event, 1, __ATOMIC_RELAXED);
+	if (slot >= TRACE_MAX_EVENTS)
+	{
+		__atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+		return NULL;
+	}
+	return &events[slot];
+}
+/****************************************************************************************/
+/**
+ * append_json_str function
+ * @param out
+ * @param s appended as a quoted JSON string
+ */
+static void append_json_str(string& out, const char* s)
+{
+	out += '"';
+	for (; *s; s++)
+	{
+		unsigned char c = *s;
+		if (c == '"' || c == '\\')
+		{
+			out += '\\';
+			out += c;
+		}
+		else if (c >= 0x20)
+			out += c;
+	}
+	out += '"';
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * traceStart function
+ * @param path the JSON file written by traceFlush (and at exit)
+ * @return 0 on success, -1 if the buffer can not be allocated
+ */
+int traceStart(const char* path)
+{
+	events = (TraceEvent*)calloc(TRACE_MAX_EVENTS, sizeof(TraceEvent));
+	if (events == NULL)
+	{
+		perror("trace");
+		return -1;
+	}
+	trace_path = path;
+	trace_pid = getpid();
+	base_ns = metricsNow();
+	trace_enabled = true;
+	atexit(traceFlush);
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * traceBegin function
+ * @return the start time to pass to traceSpan, 0 if tracing is off
+ */
+unsigned long long traceBegin()
+{
+	return trace_enabled ? metricsNow() : 0;
+}
+/****************************************************************************************/
+/**
+ * traceSpan function
+ * records a span of smash itself, from start_ns until now
+ * @param name static string
+ * @param start_ns from traceBegin()
+ * @param label shown as the span's argument (copied, truncated)
+ */
+void traceSpan(const char* name, unsigned long long start_ns, const char* label)
+{
+	if (!trace_enabled)
+		return;
+	TraceEvent* e = claim();
+	if (e == NULL)
+		return;
+	e->name = name;
+	e->phase = 'X';
+	e->ts_ns = start_ns;
+	e->dur_ns = metricsNow() - start_ns;
+	e->id = 0;
+	e->label[0] = '\0';
+	if (label != NULL)
+		strncat(e->label, label, TRACE_LABEL_SIZE - 1);
+}
+/****************************************************************************************/
+/**
+ * traceAsync function
+ * begins or ends an interval of a job, on the job's own track
+ * @param phase 'b' or 'e'
+ * @param name static string, begin and end must match
+ * @param pid of the job
+ * @param label
+ */
+void traceAsync(char phase, const char* name, pid_t pid, const char* label)
+{
+	if (!trace_enabled)
+		return;
+	TraceEvent* e = claim();
+	if (e == NULL)
+		return;
+	e->name = name;
+	e->phase = phase;
+	e->ts_ns = metricsNow();
+	e->dur_ns = 0;
+	e->id = pid;
+	e->label[0] = '\0';
+	if (label != NULL)
+		strncat(e->label, label, TRACE_LABEL_SIZE - 1);
+}
+/****************************************************************************************/
+/**
+ * traceFlush function
+ * (re)writes every event recorded so far, so the file is always a complete trace
+ */
+void traceFlush()
+{
+	if (!trace_enabled || getpid() != trace_pid)
+		return;
+	unsigned long count = __atomic_load_n(&next_event, __ATOMIC_RELAXED);
+	if (count > TRACE_MAX_EVENTS)
+		count = TRACE_MAX_EVENTS;
+
+	string out;
+	out.reserve(count * 128 + 256);
+	char buf[256];
+	snprintf(buf, sizeof(buf), "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+			 "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"smash\"}}",
+			 (int)trace_pid, (int)trace_pid);
+	out += buf;
+	for (unsigned long i = 0; i < count; i++)
+	{
+		const TraceEvent& e = events[i];
+		if (e.name == NULL)		// claimed but not filled in
+			continue;
+		snprintf(buf, sizeof(buf), ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+				 e.name, e.phase == 'X' ? "smash" : "job", e.phase, (e.ts_ns - base_ns) / 1000.0,
+				 (int)trace_pid, (int)trace_pid);
+		out += buf;
+		if (e.phase == 'X')
+		{
+			snprintf(buf, sizeof(buf), ",\"dur\":%.3f", e.dur_ns / 1000.0);
+			out += buf;
+		}
+		else
+		{
+			snprintf(buf, sizeof(buf), ",\"id\":%d", (int)e.id);
+			out += buf;
+		}
+		if (e.label[0] != '\0')
+		{
+			out += ",\"args\":{\"arg\":";
+			append_json_str(out, e.label);
+			out += '}';
+		}
+		out += '}';
+	}
+	out += "\n]}\n";
+
+	string tmp = trace_path + ".tmp";
+	int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd == -1)
+	{
+		perror("trace");
+		return;
+	}
+	writeAll(fd, out.data(), out.size());
+	close(fd);
+	if (rename(tmp.c_str(), trace_path.c_str()) == -1)
+		perror("trace");
+}
+/****************************************************************************************/
+/**
+ * tracePrint function
+ * prints how full the trace buffer is
+ */
+void tracePrint()
+{
+	if (!trace_enabled)
+	{
+		cout << "tracing is off (smash --trace FILE)" << endl;
+		return;
+	}
+	unsigned long count = next_event < TRACE_MAX_EVENTS ? next_event : TRACE_MAX_EVENTS;
+	cout << "trace " << trace_path << ": " << count << "/" << TRACE_MAX_EVENTS << " events, "
+		 << dropped << " dropped" << endl;
+}
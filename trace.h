@@ -0,0 +1,37 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define TRACE_MAX_EVENTS (1 << 18)
+#define TRACE_LABEL_SIZE 32
+
+
+/* ####################################################################################
+ *                                 GLOBALS
+#####################################################################################*/
+
+extern bool trace_enabled;
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int  traceStart(const char* path);
+unsigned long long traceBegin();
+void traceSpan(const char* name, unsigned long long start_ns, const char* label = NULL);
+void traceAsync(char phase, const char* name, pid_t pid, const char* label = NULL);
+void traceFlush();
+void tracePrint();
+
+
+#endif
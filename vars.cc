@@ -0,0 +1,397 @@
+/* ####################################################################################
+ *                                  VARS.CC
+ *  Shell variables, export/unset, and the environment of the commands smash runs.
+ *
+ *  Every variable lives in one table; smash's environment is imported at startup as
+ *  exported variables. The envp handed to exec and to the zygote is built from the
+ *  exported ones only when one of them changed, and is reused by every spawn until
+ *  then. varEnvGeneration() tells a consumer (the zygote) whether it changed. smash's
+ *  own environment is kept in step, so getenv() and the PATH search of execvpe agree.
+ *
+ *  NAME=value before a command sets it for that command only: it is saved, assigned
+ *  and exported, and restored once the command was started (varTempRestore). While
+ *  such assignments are in effect, commands get a one-off envp and the shared one is
+ *  left as it is, so it need not be rebuilt when they are undone.
+ *
+ *  A function call sees its arguments as $1..$9, $# and $@ (or $*): varPushArgs keeps
+ *  a pointer to them for the length of the call, nothing is copied.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <map>
+#include <vector>
+#include "commands.h"
+#include "vars.h"
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+/**
+ * a variable as it was before a NAME=value prefix changed it
+ */
+struct SavedVar
+{
+	string name;
+	bool existed;
+	Var var;
+};
+
+/**
+ * the arguments of a function call
+ */
+struct ArgFrame
+{
+	char** argv;	// argv[0] is the function's name
+	int argc;
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+extern smashManager sm;
+
+static map<string, Var> vars;
+static vector<SavedVar> saved;		// a stack, see varTempMark
+static vector<ArgFrame> frames;		// a stack, see varPushArgs
+
+static vector<string> env_strings;	// NAME=value of the exported variables
+static vector<char*> env_ptrs;		// env_strings as a NULL terminated envp
+static vector<string> temp_strings;	// the same, with the temporary assignments
+static vector<char*> temp_ptrs;
+static bool env_dirty = true;
+static unsigned int env_gen = 0;
+static pid_t shell_pid = -1;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static void set_var(const string& name, const char* value, bool exported, bool temp = false);
+static void exported_changed(const string& name, bool temp = false);
+static char** build_env(vector<string>& strings, vector<char*>& ptrs);
+
+
+/**
+ * set_var function
+ * @param name
+ * @param value NULL keeps the current value
+ * @param exported
+ * @param temp for the next command only (see varAssign)
+ */
+static void set_var(const string& name, const char* value, bool exported, bool temp)
+{
+	Var& v = vars[name];
+	bool was_exported = v.exported;
+	if (value != NULL)
+		v.value = value;
+	v.exported = exported;
+	if (exported || was_exported)
+		exported_changed(name, temp);
+}
+/****************************************************************************************/
+/**
+ * exported_changed function
+ * the environment must be rebuilt, and smash's own is updated
+ * @param name
+ * @param temp a temporary assignment or its undoing: only the one-off envp sees it
+ */
+static void exported_changed(const string& name, bool temp)
+{
+	if (!temp)
+		env_dirty = true;
+	map<string, Var>::iterator v = vars.find(name);
+	if (v != vars.end() && v->second.exported)
+		setenv(name.c_str(), v->second.value.c_str(), 1);
+	else
+		unsetenv(name.c_str());
+}
+/****************************************************************************************/
+/**
+ * build_env function
+ * @param strings receives NAME=value of the exported variables
+ * @param ptrs receives them as a NULL terminated envp
+ * @return the envp
+ */
+static char** build_env(vector<string>& strings, vector<char*>& ptrs)
+{
+	strings.clear();
+	for (map<string, Var>::iterator v = vars.begin(); v != vars.end(); ++v)
+	{
+		if (v->second.exported)
+			strings.push_back(v->first + "=" + v->second.value);
+	}
+	ptrs.clear();
+	for (size_t i = 0; i < strings.size(); i++)
+		ptrs.push_back((char*)strings[i].c_str());
+	ptrs.push_back(NULL);
+	return &ptrs[0];
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * varsInit function
+ * imports the environment smash was started with
+ * @param envp
+ */
+void varsInit(char** envp)
+{
+	shell_pid = getpid();
+	for (int i = 0; envp[i] != NULL; i++)
+	{
+		const char* eq = strchr(envp[i], '=');
+		if (eq == NULL || !varIsName(envp[i], eq - envp[i]))
+			continue;
+		Var& v = vars[string(envp[i], eq - envp[i])];
+		v.value = eq + 1;
+		v.exported = true;
+	}
+	env_dirty = true;
+}
+/****************************************************************************************/
+/**
+ * varLookup function
+ * also knows the special parameters: $? (the last exit status), $$ (smash's pid),
+ * and the arguments of the current function: $0..$9, $# and $@ or $*
+ * @param name
+ * @param len
+ * @return the value, NULL if it is not set
+ */
+const char* varLookup(const char* name, size_t len)
+{
+	static char number[16];
+	if (len == 1 && (name[0] == '?' || name[0] == '$'))
+	{
+		snprintf(number, sizeof(number), "%d", (name[0] == '?') ? sm.last_status : (int)shell_pid);
+		return number;
+	}
+	if (len == 1 && (isdigit((unsigned char)name[0]) || name[0] == '#' || name[0] == '@' || name[0] == '*'))
+	{
+		static string joined;
+		char* top[] = { (char*)"smash", NULL };
+		ArgFrame frame = { top, 1 };
+		if (!frames.empty())
+			frame = frames.back();
+		if (name[0] == '#')
+		{
+			snprintf(number, sizeof(number), "%d", frame.argc - 1);
+			return number;
+		}
+		if (isdigit((unsigned char)name[0]))
+			return (name[0] - '0' < frame.argc) ? frame.argv[name[0] - '0'] : NULL;
+		joined.clear();
+		for (int i = 1; i < frame.argc; i++)
+		{
+			if (i > 1)
+				joined += ' ';
+			joined += frame.argv[i];
+		}
+		return joined.c_str();
+	}
+	static string key;	// reused, so that a lookup does not allocate
+	key.assign(name, len);
+	map<string, Var>::iterator v = vars.find(key);
+	return (v != vars.end()) ? v->second.value.c_str() : NULL;
+}
+/****************************************************************************************/
+/**
+ * varIsName function
+ * @param name
+ * @param len
+ * @return true if name is a letter or '_', followed by letters, digits and '_'
+ */
+bool varIsName(const char* name, size_t len)
+{
+	if (len == 0 || !(isalpha((unsigned char)name[0]) || name[0] == '_'))
+		return false;
+	for (size_t i = 1; i < len; i++)
+	{
+		if (!(isalnum((unsigned char)name[i]) || name[i] == '_'))
+			return false;
+	}
+	return true;
+}
+/****************************************************************************************/
+/**
+ * varAssignments function
+ * @param args
+ * @param num_arg
+ * @return how many of the first args are NAME=value assignments
+ */
+int varAssignments(char* args[], int num_arg)
+{
+	int i = 0;
+	while (i < num_arg)
+	{
+		const char* eq = strchr(args[i], '=');
+		if (eq == NULL || !varIsName(args[i], eq - args[i]))
+			break;
+		i++;
+	}
+	return i;
+}
+/****************************************************************************************/
+/**
+ * varAssign function
+ * @param word NAME=value
+ * @param temp if true, for the next command only: it is exported and restored by varTempRestore
+ */
+void varAssign(const char* word, bool temp)
+{
+	const char* eq = strchr(word, '=');
+	string name(word, eq - word);
+	map<string, Var>::iterator v = vars.find(name);
+	if (temp)
+	{
+		SavedVar s;
+		s.name = name;
+		s.existed = (v != vars.end());
+		if (s.existed)
+			s.var = v->second;
+		saved.push_back(s);
+	}
+	bool exported = temp || (v != vars.end() && v->second.exported);
+	set_var(name, eq + 1, exported, temp);
+}
+/****************************************************************************************/
+/**
+ * varExport function
+ * @param word NAME or NAME=value
+ * @return false if NAME is not a valid name
+ */
+bool varExport(const char* word)
+{
+	const char* eq = strchr(word, '=');
+	size_t len = (eq != NULL) ? (size_t)(eq - word) : strlen(word);
+	if (!varIsName(word, len))
+		return false;
+	set_var(string(word, len), (eq != NULL) ? eq + 1 : NULL, true);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * varUnset function
+ * @param name
+ * @return false if name is not a valid name
+ */
+bool varUnset(const char* name)
+{
+	if (!varIsName(name, strlen(name)))
+		return false;
+	map<string, Var>::iterator v = vars.find(name);
+	if (v == vars.end())
+		return true;
+	bool was_exported = v->second.exported;
+	vars.erase(v);
+	if (was_exported)
+		exported_changed(name);
+	return true;
+}
+/****************************************************************************************/
+/**
+ * varTempMark function
+ * @return the mark to pass to varTempRestore after the temporary assignments
+ */
+size_t varTempMark()
+{
+	return saved.size();
+}
+/****************************************************************************************/
+/**
+ * varTempRestore function
+ * undoes the temporary assignments made since mark, the last one first
+ * @param mark
+ */
+void varTempRestore(size_t mark)
+{
+	while (saved.size() > mark)
+	{
+		SavedVar& s = saved.back();
+		if (s.existed)
+			vars[s.name] = s.var;
+		else
+			vars.erase(s.name);
+		exported_changed(s.name, true);
+		saved.pop_back();
+	}
+}
+/****************************************************************************************/
+/**
+ * varPrintExported function
+ * lists the exported variables as "export NAME=value", by name
+ */
+void varPrintExported()
+{
+	for (map<string, Var>::iterator v = vars.begin(); v != vars.end(); ++v)
+	{
+		if (v->second.exported)
+			cout << "export " << v->first << "=" << v->second.value << endl;
+	}
+}
+/****************************************************************************************/
+/**
+ * varEnvp function
+ * @return the environment of a command, NULL terminated. Valid until an exported variable changes.
+ * While temporary assignments are in effect it is built for this command only.
+ */
+char** varEnvp()
+{
+	if (!saved.empty())
+		return build_env(temp_strings, temp_ptrs);
+	if (env_dirty)
+	{
+		build_env(env_strings, env_ptrs);
+		env_dirty = false;
+		env_gen++;
+	}
+	return &env_ptrs[0];
+}
+/****************************************************************************************/
+/**
+ * varEnvGeneration function
+ * @return a number that changes whenever varEnvp() was rebuilt, 0 for a one-off envp
+ */
+unsigned int varEnvGeneration()
+{
+	if (!saved.empty())
+		return 0;
+	varEnvp();
+	return env_gen;
+}
+/****************************************************************************************/
+/**
+ * varPushArgs function
+ * makes argv the arguments ($0, $1...) until varPopArgs
+ * @param argv must stay valid until then
+ * @param argc
+ */
+void varPushArgs(char** argv, int argc)
+{
+	ArgFrame frame = { argv, argc };
+	frames.push_back(frame);
+}
+/****************************************************************************************/
+/**
+ * varPopArgs function
+ * the arguments of the caller are back
+ */
+void varPopArgs()
+{
+	frames.pop_back();
+}
@@ -0,0 +1,52 @@
+#ifndef _VARS_H
+#define _VARS_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <stddef.h>
+#include <string>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  CLASSES
+#####################################################################################*/
+/**
+ * a shell variable
+ */
+class Var
+{
+	public:
+		string value;
+		bool exported;		// in the environment of the commands smash runs
+
+		Var()
+		{
+			exported = false;
+		}
+};
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+void         varsInit(char** envp);
+const char*  varLookup(const char* name, size_t len);
+bool         varIsName(const char* name, size_t len);
+int          varAssignments(char* args[], int num_arg);
+void         varAssign(const char* word, bool temp = false);
+bool         varExport(const char* word);
+bool         varUnset(const char* name);
+size_t       varTempMark();
+void         varTempRestore(size_t mark);
+void         varPrintExported();
+char**       varEnvp();
+unsigned int varEnvGeneration();
+void         varPushArgs(char** argv, int argc);
+void         varPopArgs();
+
+
+#endif
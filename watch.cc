@@ -0,0 +1,215 @@
+/* ####################################################################################
+ *                                  WATCH.CC
+ *  watch -n SECS cmd: reruns cmd every SECS seconds and prints its output (stdout and
+ *  stderr) again only when it changed.
+ *
+ *  The watch job is a fork of smash, so fg, bg, kill and CTRL+C/CTRL+Z treat it like
+ *  any other job. Inside it a timerfd paces the ticks, and each tick posix_spawn()s the
+ *  executable resolved once up front: no PATH search, no shell, no copy of smash's
+ *  page tables (glibc's posix_spawn uses CLONE_VFORK). The output is read into a
+ *  reused buffer and compared by its FNV-1a hash, so an unchanged tick costs a pipe,
+ *  a spawn, the reads and a wait, and prints nothing.
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+#include "eventloop.h"
+#include "watch.h"
+
+extern char** environ;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static uint64_t fnv1a(const char* data, size_t len);
+static bool run_tick(const char* path, char* args[], string& out);
+
+
+/**
+ * fnv1a function
+ * @param data
+ * @param len
+ * @return the 64 bit FNV-1a hash of data
+ */
+static uint64_t fnv1a(const char* data, size_t len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < len; i++)
+	{
+		h ^= (unsigned char)data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+/****************************************************************************************/
+/**
+ * run_tick function
+ * runs the command once and collects its output
+ * @param path
+ * @param args
+ * @param out receives the output
+ * @return false if the command could not be started
+ */
+static bool run_tick(const char* path, char* args[], string& out)
+{
+	int out_pipe[2];
+	if (pipe2(out_pipe, O_CLOEXEC) == -1)
+	{
+		perror("pipe");
+		return false;
+	}
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDERR_FILENO);
+	pid_t pid;
+	int err = posix_spawn(&pid, path, &actions, NULL, args, environ);
+	posix_spawn_file_actions_destroy(&actions);
+	close(out_pipe[1]);
+	if (err != 0)
+	{
+		close(out_pipe[0]);
+		errno = err;
+		perror(path);
+		return false;
+	}
+
+	out.clear();
+	char buf[WATCH_READ_SIZE];
+	while (1)
+	{
+		ssize_t n = read(out_pipe[0], buf, sizeof(buf));
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		out.append(buf, n);
+	}
+	close(out_pipe[0]);
+	while (waitpid(pid, NULL, 0) == -1 && errno == EINTR)
+		;
+	return true;
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * watchResolve function
+ * searches PATH like execvp would, once, so the ticks exec the file directly
+ * @param name
+ * @param path receives the executable's path
+ * @return true if an executable was found
+ */
+bool watchResolve(const char* name, string& path)
+{
+	if (strchr(name, '/') != NULL)
+	{
+		path = name;
+		return access(name, X_OK) == 0;
+	}
+	const char* dirs = getenv("PATH");
+	if (dirs == NULL)
+		dirs = "/bin:/usr/bin";
+	while (1)
+	{
+		const char* end = strchr(dirs, ':');
+		size_t len = end ? (size_t)(end - dirs) : strlen(dirs);
+		path.assign(dirs, len);
+		if (path.empty())
+			path = ".";
+		path += '/';
+		path += name;
+		struct stat st;
+		if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && access(path.c_str(), X_OK) == 0)
+			return true;
+		if (end == NULL)
+			return false;
+		dirs = end + 1;
+	}
+}
+/****************************************************************************************/
+/**
+ * watchRun function
+ * the body of the watch job, never returns
+ * @param path the executable, from watchResolve
+ * @param args its argv
+ * @param secs the interval
+ */
+void watchRun(const char* path, char* args[], double secs)
+{
+	string title;
+	for (int i = 0; args[i] != NULL; i++)
+	{
+		title += (i ? " " : "");
+		title += args[i];
+	}
+
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	if (tfd == -1)
+	{
+		perror("timerfd_create");
+		_exit(1);
+	}
+	struct itimerspec period;
+	period.it_interval.tv_sec = (time_t)secs;
+	period.it_interval.tv_nsec = (long)((secs - (time_t)secs) * 1e9);
+	if (period.it_interval.tv_sec == 0 && period.it_interval.tv_nsec == 0)
+		period.it_interval.tv_nsec = 1;	// a zero interval would disarm it after the first tick
+	period.it_value.tv_sec = 0;
+	period.it_value.tv_nsec = 1;	// first tick right away
+	if (timerfd_settime(tfd, 0, &period, NULL) == -1)
+	{
+		perror("timerfd_settime");
+		_exit(1);
+	}
+	char header[WATCH_HEADER_SIZE];
+	snprintf(header, sizeof(header), "Every %gs: ", secs);
+	title.insert(0, header);
+
+	string out;
+	out.reserve(WATCH_READ_SIZE);
+	uint64_t last_hash = 0;
+	bool first = true;
+	while (1)
+	{
+		uint64_t expirations;
+		if (read(tfd, &expirations, sizeof(expirations)) == -1 && errno != EINTR)
+		{
+			perror("watch");
+			_exit(1);
+		}
+		if (!run_tick(path, args, out))
+			_exit(1);
+		uint64_t h = fnv1a(out.data(), out.size());
+		if (!first && h == last_hash)
+			continue;
+		first = false;
+		last_hash = h;
+
+		time_t now = time(NULL);
+		strftime(header, sizeof(header), "  (%H:%M:%S)\n\n", localtime(&now));
+		writeAll(STDOUT_FILENO, title.data(), title.size());
+		writeAll(STDOUT_FILENO, header, strlen(header));
+		writeAll(STDOUT_FILENO, out.data(), out.size());
+	}
+}
@@ -0,0 +1,30 @@
+#ifndef _WATCH_H
+#define _WATCH_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <string>
+
+using namespace std;
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define WATCH_DEFAULT_SECS 2.0
+#define WATCH_MIN_SECS 1e-9			// the timerfd counts in nanoseconds
+#define WATCH_READ_SIZE 65536
+#define WATCH_HEADER_SIZE 64
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+bool watchResolve(const char* name, string& path);
+void watchRun(const char* path, char* args[], double secs);
+
+
+#endif
@@ -0,0 +1,370 @@
+/* ####################################################################################
+ *                                  ZYGOTE.CC
+ *  A small helper process, forked at startup while smash is still small, that launches
+ *  external commands for it. fork() copies the page tables of the caller, so launching
+ *  from the helper keeps the cost flat however big smash's history/captures/caches get.
+ *
+ *  smash sends argv, envp, stdio and its working directory over a SOCK_SEQPACKET pair
+ *  (fds as SCM_RIGHTS). envp is sent only when it changed since the previous request,
+ *  the helper keeps a copy of the last one. The helper clones the command with CLONE_PARENT, so the command
+ *  is smash's child: waitpid, SIGCHLD and job control work exactly as with fork().
+#####################################################################################*/
+
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "zygote.h"
+
+
+/* ####################################################################################
+ *                                  TYPES
+#####################################################################################*/
+
+#define ZYGOTE_NUM_FDS 4	// stdin, stdout, stderr, working directory
+
+/**
+ * spawn request header, followed by argc + envc NUL terminated strings
+ */
+struct ZygoteRequest
+{
+	int argc;
+	int envc;	// -1: the environment of the previous request
+};
+
+/**
+ * spawn reply
+ */
+struct ZygoteReply
+{
+	pid_t pid;
+	int err;	// errno of a failed clone
+};
+
+/**
+ * what the cloned child needs to exec the command
+ */
+struct ZygoteChild
+{
+	char** argv;
+	char** envp;
+	int fds[ZYGOTE_NUM_FDS];
+};
+
+
+/* ####################################################################################
+ *                                  GLOBALS
+#####################################################################################*/
+
+static int zygote_sock = -1;	// smash's end, -1 if there is no helper
+static pid_t zygote_pid = -1;
+
+
+/* ####################################################################################
+ *                                  HELPING FUNCTIONS
+#####################################################################################*/
+
+static int  zygote_child(void* arg);
+static void zygote_serve(int sock);
+
+
+/**
+ * zygote_child function
+ * runs in the cloned command: sets up the job's process group, stdio and working directory and execs
+ * @param arg the ZygoteChild
+ * @return never returns on success
+ */
+static int zygote_child(void* arg)
+{
+	ZygoteChild* c = (ZygoteChild*)arg;
+	setpgrp();
+
+	// the helper ignores the terminal signals, the command must not
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTSTP, SIG_DFL);
+	signal(SIGCHLD, SIG_DFL);
+	prctl(PR_SET_PDEATHSIG, 0);
+
+	if (fchdir(c->fds[3]) == -1)
+		perror("chdir");
+	for (int i = 0; i < 3; i++)
+	{
+		if (c->fds[i] != i)
+			dup2(c->fds[i], i);
+	}
+	for (int i = 0; i < ZYGOTE_NUM_FDS; i++)
+	{
+		if (c->fds[i] > 2)
+			close(c->fds[i]);
+	}
+
+	// execvpe searches the PATH of the caller, it must be the command's
+	unsetenv("PATH");
+	for (int i = 0; c->envp[i] != NULL; i++)
+	{
+		if (!strncmp(c->envp[i], "PATH=", 5))
+			setenv("PATH", c->envp[i] + 5, 1);
+	}
+	execvpe(c->argv[0], c->argv, c->envp);
+	perror("external cmd");
+	_exit(1);
+}
+/****************************************************************************************/
+/**
+ * zygote_serve function
+ * the helper's main loop. Exits when smash closes its end of the socket.
+ * @param sock
+ */
+static void zygote_serve(int sock)
+{
+	static char msg[ZYGOTE_MSG_SIZE];
+	static char child_stack[ZYGOTE_STACK_SIZE];
+	static char* strings[ZYGOTE_MSG_SIZE / 2];
+	static char env_buf[ZYGOTE_MSG_SIZE];
+	static char* env[ZYGOTE_MSG_SIZE / 2];
+	bool have_env = false;
+
+	while (1)
+	{
+		char cbuf[CMSG_SPACE(sizeof(int) * ZYGOTE_NUM_FDS)];
+		struct iovec iov = { msg, sizeof(msg) - 1 };
+		struct msghdr mh;
+		memset(&mh, 0, sizeof(mh));
+		mh.msg_iov = &iov;
+		mh.msg_iovlen = 1;
+		mh.msg_control = cbuf;
+		mh.msg_controllen = sizeof(cbuf);
+
+		ssize_t n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+		if (n == 0)
+			_exit(0);
+		if (n == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			_exit(1);
+		}
+
+		ZygoteChild child;
+		int num_fds = 0;
+		struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+		if (cm != NULL && cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS)
+		{
+			num_fds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			if (num_fds > ZYGOTE_NUM_FDS)
+				num_fds = ZYGOTE_NUM_FDS;
+			memcpy(child.fds, CMSG_DATA(cm), sizeof(int) * num_fds);
+		}
+
+		ZygoteReply reply = { -1, EINVAL };
+		ZygoteRequest req;
+		if (num_fds == ZYGOTE_NUM_FDS && (size_t)n > sizeof(req))
+		{
+			memcpy(&req, msg, sizeof(req));
+			msg[n] = '\0';
+			int i = -1;
+			char* p = msg + sizeof(req);
+			char* end = msg + n;
+			if (req.argc > 0 && req.argc + 1 <= (int)(sizeof(strings) / sizeof(strings[0])))
+			{
+				// split the strings: argv, then envp if it changed
+				for (i = 0; i < req.argc && p < end; i++)
+				{
+					strings[i] = p;
+					p += strlen(p) + 1;
+				}
+			}
+			if (i == req.argc && req.envc >= 0 && req.envc + 1 <= (int)(sizeof(env) / sizeof(env[0])))
+			{
+				memcpy(env_buf, p, end - p + 1);
+				char* e = env_buf;
+				char* e_end = env_buf + (end - p);
+				int j;
+				for (j = 0; j < req.envc && e < e_end; j++)
+				{
+					env[j] = e;
+					e += strlen(e) + 1;
+				}
+				env[j] = NULL;
+				have_env = (j == req.envc);
+			}
+			if (i == req.argc && have_env)
+			{
+				strings[req.argc] = NULL;
+				child.argv = strings;
+				child.envp = env;
+				reply.pid = clone(zygote_child, child_stack + sizeof(child_stack),
+								  CLONE_PARENT | SIGCHLD, &child);
+				reply.err = (reply.pid == -1) ? errno : 0;
+			}
+		}
+		// the child has its own copies; on EINVAL these are all that was received
+		for (int i = 0; i < num_fds; i++)
+			close(child.fds[i]);
+		send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+	}
+}
+
+
+/* ####################################################################################
+ *                               HEADER FUNCTIONS IMPLIMINTATION
+#####################################################################################*/
+
+/**
+ * zygoteStart function
+ * forks the helper. Call it as early as possible, while smash is small.
+ * @return 0 on success, -1 on failure
+ */
+int zygoteStart()
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+	{
+		perror("socketpair");
+		return -1;
+	}
+	pid_t pid = fork();
+	if (pid == -1)
+	{
+		perror("fork");
+		close(sv[0]);
+		close(sv[1]);
+		return -1;
+	}
+	if (pid == 0)
+	{
+		close(sv[0]);
+		// CTRL+C / CTRL+Z reach smash's whole process group, the helper must survive them
+		signal(SIGINT, SIG_IGN);
+		signal(SIGTSTP, SIG_IGN);
+		signal(SIGCHLD, SIG_DFL);
+		prctl(PR_SET_PDEATHSIG, SIGKILL);
+		zygote_serve(sv[1]);
+		_exit(0);
+	}
+	close(sv[1]);
+	zygote_sock = sv[0];
+	zygote_pid = pid;
+	return 0;
+}
+/****************************************************************************************/
+/**
+ * zygoteActive function
+ * @return true if spawns go through the helper
+ */
+bool zygoteActive()
+{
+	return zygote_sock != -1;
+}
+/****************************************************************************************/
+/**
+ * zygoteDetach function
+ * in a fork of smash: the helper clones its commands as children of smash, not of us,
+ * so we fork them ourselves
+ */
+void zygoteDetach()
+{
+	if (zygote_sock != -1)
+		close(zygote_sock);
+	zygote_sock = -1;
+	zygote_pid = -1;
+}
+/****************************************************************************************/
+/**
+ * zygoteSpawn function
+ * launches args in a new process group, as a child of the calling process
+ * @param args NULL terminated argv
+ * @param envp NULL terminated environment
+ * @param env_gen changes whenever envp does (see varEnvGeneration), 0 sends envp anyway
+ * @param in_fd becomes the command's stdin
+ * @param out_fd becomes the command's stdout
+ * @param err_fd becomes the command's stderr
+ * @return the command's pid, or -1 (errno set, E2BIG if argv and envp do not fit in a request).
+ * If the helper is gone it is disabled. The caller forks instead on any failure.
+ */
+pid_t zygoteSpawn(char* args[], char* envp[], unsigned int env_gen, int in_fd, int out_fd, int err_fd)
+{
+	static char msg[ZYGOTE_MSG_SIZE];
+	static unsigned int sent_gen = 0;	// of the environment the helper has
+	bool send_env = (env_gen == 0 || env_gen != sent_gen);
+	ZygoteRequest req = { 0, send_env ? 0 : -1 };
+	size_t len = sizeof(req);
+	for (int pass = 0; pass < (send_env ? 2 : 1); pass++)
+	{
+		char** list = (pass == 0) ? args : envp;
+		for (int i = 0; list[i] != NULL; i++)
+		{
+			size_t slen = strlen(list[i]) + 1;
+			if (len + slen >= sizeof(msg))
+			{
+				errno = E2BIG;
+				return -1;
+			}
+			memcpy(msg + len, list[i], slen);
+			len += slen;
+			if (pass == 0)
+				req.argc++;
+			else
+				req.envc++;
+		}
+	}
+	memcpy(msg, &req, sizeof(req));
+
+	int cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+	if (cwd_fd == -1)
+		return -1;
+	int fds[ZYGOTE_NUM_FDS] = { in_fd, out_fd, err_fd, cwd_fd };
+	char cbuf[CMSG_SPACE(sizeof(fds))];
+	memset(cbuf, 0, sizeof(cbuf));
+	struct iovec iov = { msg, len };
+	struct msghdr mh;
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cbuf;
+	mh.msg_controllen = sizeof(cbuf);
+	struct cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+
+	ssize_t n;
+	while ((n = sendmsg(zygote_sock, &mh, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+		;
+	close(cwd_fd);
+
+	ZygoteReply reply;
+	if (n != -1)
+	{
+		while ((n = recv(zygote_sock, &reply, sizeof(reply), 0)) == -1 && errno == EINTR)
+			;
+	}
+	if (n != (ssize_t)sizeof(reply))
+	{
+		// the helper died - the caller falls back to fork()
+		perror("zygote");
+		close(zygote_sock);
+		zygote_sock = -1;
+		waitpid(zygote_pid, NULL, WNOHANG);
+		errno = EPIPE;
+		return -1;
+	}
+	// a failed request may have left the helper without this environment
+	if (send_env)
+		sent_gen = (reply.pid != -1) ? env_gen : 0;
+	if (reply.pid == -1)
+		errno = reply.err;
+	return reply.pid;
+}
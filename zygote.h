@@ -0,0 +1,28 @@
+#ifndef _ZYGOTE_H
+#define _ZYGOTE_H
+
+/* ####################################################################################
+ *                                  INCLUDES
+#####################################################################################*/
+#include <sys/types.h>
+
+
+/* ####################################################################################
+ *                                  DEFINES
+#####################################################################################*/
+
+#define ZYGOTE_MSG_SIZE 65536	// argv + envp of one spawn request
+#define ZYGOTE_STACK_SIZE 65536
+
+
+/* ####################################################################################
+ *                                 HEADER FUNCTIONS
+#####################################################################################*/
+
+int   zygoteStart();
+bool  zygoteActive();
+void  zygoteDetach();
+pid_t zygoteSpawn(char* args[], char* envp[], unsigned int env_gen, int in_fd, int out_fd, int err_fd);
+
+
+#endif